@@ -5,8 +5,8 @@
   Hardware:
   - ESP32 Dev Module
   - LCD I2C (0x27) on GPIO 21/22
-  - pH Sensor on GPIO 35 (ADC)
-  - DS18B20 on GPIO 27
+  - pH Sensor on GPIO 35 (ADC1, continuous/DMA mode)
+  - DS18B20 probe(s) on GPIO 27 (up to TEMP_MAX_PROBES on one bus)
   - Relays (Active-Low):
     * Acid Pump: GPIO 16
     * Alkali Pump: GPIO 23
@@ -20,37 +20,76 @@
 
 // Include headers
 #include "config/config.h"
+#include "config/filterConfig.h"
+#include "config/configCache.h"
+#include "sensors/adcStream.h"
+#include "sensors/adcLinearizer.h"
 #include "sensors/ph.h"
 #include "sensors/temp.h"
+#include "sensors/adaptiveRate.h"
+#include "sensors/acquisition.h"
+#include "sensors/historyCodec.h"
+#include "sensors/history.h"
+#include "control/relayBank.h"
 #include "control/fan.h"
 #include "control/phControl.h"
+#include "control/dosingEngine.h"
+#include "control/thermalModel.h"
+#include "control/tempControl.h"
+#include "control/relayRules.h"
+#include "control/scheduler.h"
 #include "control/autoControl.h"
+#include "control/controlTask.h"
 #include "ui/lcd.h"
 #include "wifi/server.h"
 
 // Include implementations (Arduino IDE needs this)
 #include "config/config.cpp"
+#include "config/configCache.cpp"
+#include "sensors/adcStream.cpp"
+#include "sensors/adcLinearizer.cpp"
 #include "sensors/ph.cpp"
 #include "sensors/temp.cpp"
+#include "sensors/adaptiveRate.cpp"
+#include "sensors/acquisition.cpp"
+#include "sensors/historyCodec.cpp"
+#include "sensors/history.cpp"
+#include "control/relayBank.cpp"
 #include "control/fan.cpp"
 #include "control/phControl.cpp"
+#include "control/dosingEngine.cpp"
+#include "control/thermalModel.cpp"
+#include "control/tempControl.cpp"
+#include "control/relayRules.cpp"
+#include "control/scheduler.cpp"
 #include "control/autoControl.cpp"
+#include "control/controlTask.cpp"
 #include "ui/lcd.cpp"
 #include "wifi/server.cpp"
 
 // ======================= GLOBAL OBJECTS =======================
+RelayBank relayBank; // First: latches every relay OFF (light ON) before anything else runs
 PHSensor phSensor(PH_PIN);
 TempSensor tempSensor(TEMP_PIN);
-FanControl fanControl(REL_FAN);
-PHControl phControl(REL_ACID_PUMP, REL_BASE_PUMP);
-AutoControl autoControl(&phSensor, &tempSensor, &fanControl, &phControl);
+SensorAcquisition sensorAcquisition(&phSensor, &tempSensor);
+History history; // Fixed arrays: sizeof(History) is its whole RAM footprint
+FanControl fanControl(&relayBank, REL_COOLER_FAN);
+PHControl phControl(&relayBank);
+DosingEngine dosingEngine;
+TempControl tempControl(&relayBank);
+RelayRules relayRules;
+Scheduler controlJobs; // Ticked by AutoControl on the control task
+Scheduler loopJobs;    // Web and LCD, run from loop()
+AutoControl autoControl(&sensorAcquisition, &fanControl, &phControl, &relayBank, &dosingEngine,
+                        &tempControl, &relayRules, &controlJobs);
+ControlTask controlTask(&sensorAcquisition, &autoControl, &relayBank);
 LCDUI lcdUI;
-SmartBreederServer wifiServer(&phSensor, &tempSensor, &fanControl, &phControl);
+SmartBreederServer wifiServer(&phSensor, &tempSensor, &sensorAcquisition, &fanControl, &phControl,
+                              &controlTask, &relayBank, &dosingEngine, &tempControl, &relayRules,
+                              &loopJobs, &controlJobs, &history);
 
 // ======================= STATE VARIABLES =======================
-unsigned long lastSensorRead = 0;
-float currentPH = 7.0;
-float currentTemp = 25.0;
+uint32_t lastSnapshotSeq = 0;
 String phState = "Neutral";
 String tempState = "Normal";
 
@@ -71,147 +110,98 @@ String getTempState(float temp) {
   return "Normal";
 }
 
+// 64-bit esp_timer uptime: millis() / 1000 wraps after 49.7 days, inside the 30-day
+// quarter tier's reach, and History would then start over
+uint32_t uptimeSeconds() {
+  return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+// ======================= LOOP JOBS =======================
+void webJob(void*) {
+  wifiServer.update();
+}
+
+void historyJob(void*) {
+  const SensorSnapshot snap = sensorAcquisition.snapshot();
+  history.record(uptimeSeconds(), snap.phValid, snap.phMilli, snap.tempValid,
+                 toMilli(snap.temperature), relayBank.getMask());
+}
+
+void configFlushJob(void*) {
+  // Settings changed by the dashboard or learning reach NVS here, off the request path
+  configCache.flushDue(millis());
+}
+
+void displayJob(void*) {
+  // Acquisition and control run on the control task; loop() only displays the snapshot
+  const SensorSnapshot snap = sensorAcquisition.snapshot();
+  if (snap.sequence != lastSnapshotSeq) {
+    phState = getPHState(snap.ph());
+    tempState = getTempState(snap.temperature);
+    lastSnapshotSeq = snap.sequence;
+  }
+  
+  lcdUI.update(
+    snap.ph(), snap.temperature, phState, tempState,
+    fanControl.getState(),
+    phControl.getAcidState(),
+    phControl.getBaseState(),
+    phControl.getCooldownRemaining(),
+    wifiServer.isConnected(),
+    wifiServer.getIP()
+  );
+}
+
 // ======================= SETUP =======================
 void setup() {
-  // Note: GPIO23 is already initialized in PHControl constructor (runs before setup())
-  // But we'll reinforce it here to be absolutely sure
+  // Note: every relay is already latched OFF (light ON) by the RelayBank constructor,
+  // which runs before setup()
   
   Serial.begin(115200);
   delay(100);
   
-  // ======================= CRITICAL: REINFORCE GPIO23 STATE =======================
-  // Even though pins are initialized in constructor, reinforce here immediately
-  // For Active-Low relays: HIGH = OFF, LOW = ON
-  pinMode(REL_ALKALI_PUMP, OUTPUT);
-  digitalWrite(REL_ALKALI_PUMP, HIGH); // Explicitly set HIGH (OFF for Active-Low relay)
-  delay(10);
-  digitalWrite(REL_ALKALI_PUMP, HIGH); // Set again to ensure it's stable
-  delay(10);
-  
-  // Also reinforce Acid pump pin
-  pinMode(REL_ACID_PUMP, OUTPUT);
-  digitalWrite(REL_ACID_PUMP, HIGH); // Explicitly set HIGH (OFF for Active-Low relay)
-  delay(10);
-  digitalWrite(REL_ACID_PUMP, HIGH); // Set again to ensure it's stable
-  
-  delay(1000);
-  
   Serial.println("\n========================================");
   Serial.println("   Smart Breeder - Starting System");
   Serial.println("========================================\n");
   
-  // Verify GPIO23 is still OFF
-  int pin23State = digitalRead(REL_ALKALI_PUMP);
-  Serial.printf("GPIO23 state check: %s (should be HIGH/OFF)\n", pin23State == HIGH ? "HIGH ✓" : "LOW ✗ ERROR!");
-  if (pin23State != HIGH) {
-    Serial.println("WARNING: GPIO23 is LOW! Setting to HIGH...");
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
-    delay(100);
-    pin23State = digitalRead(REL_ALKALI_PUMP);
-    Serial.printf("GPIO23 state after fix: %s\n", pin23State == HIGH ? "HIGH ✓" : "LOW ✗ STILL ERROR!");
+  // ======================= RELAY INITIALIZATION =======================
+  // Boot levels come from RELAY_MAP; from here on RELAY_RULES decides (AutoControl)
+  relayBank.begin();
+  
+  // CRITICAL: Verify the output latches (GPIO23 included) match the OFF state
+  if (relayBank.verify() == 0) {
+    Serial.println("✓ All relay outputs confirmed (GPIO23 alkali pump OFF)");
   }
-  Serial.println("✓ GPIO23 (Alkali pump) confirmed OFF state");
-  Serial.println("✓ Acid pump pin confirmed OFF state");
   
   // Initialize LCD
   lcdUI.begin();
   
+  // Every saved setting, read from NVS once; sensors and controllers load from here
+  configCache.begin();
+  
   // Initialize sensors
   phSensor.begin();
   tempSensor.begin();
   
-  // ======================= RELAY INITIALIZATION =======================
-  // ALL RELAYS START OFF - They will only activate when a fish is selected
-  
-  // Initialize pH control relays (Acid & Alkali pumps)
-  // Note: Pins are already initialized above, this just sets up the control logic
+  // Initialize pH control (pumps OFF, dose timer) and fan control
   phControl.begin();
-  
-  // CRITICAL: Verify GPIO23 is still OFF after phControl.begin()
-  pin23State = digitalRead(REL_ALKALI_PUMP);
-  if (pin23State != HIGH) {
-    Serial.println("ERROR: GPIO23 changed to LOW after phControl.begin()! Fixing...");
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
-    delay(100);
-    pin23State = digitalRead(REL_ALKALI_PUMP);
-    Serial.printf("GPIO23 state after fix: %s\n", pin23State == HIGH ? "HIGH ✓" : "LOW ✗ STILL ERROR!");
-  } else {
-    Serial.println("✓ GPIO23 still HIGH after phControl.begin()");
-  }
-  
-  // Initialize fan control relay
   fanControl.begin();
-  
-  // Initialize water heater relay
-  pinMode(REL_WATER_HEATER, OUTPUT);
-  digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
-  
-  // Initialize all other relays
-  pinMode(REL_AIR_PUMP, OUTPUT);
-  pinMode(REL_WATER_FLOW, OUTPUT);
-  pinMode(REL_RAIN_PUMP, OUTPUT);
-  pinMode(REL_LIGHT_CTRL, OUTPUT);
-  
-  // Set relays to OFF (except light control which is always ON)
-  digitalWrite(REL_AIR_PUMP, getRelayLevel(false));
-  digitalWrite(REL_WATER_FLOW, getRelayLevel(false));
-  digitalWrite(REL_RAIN_PUMP, getRelayLevel(false));
-  
-  // Light control relay: Always ACTIVE/ON (for Active-Low: LOW = ON, HIGH = OFF)
-  digitalWrite(REL_LIGHT_CTRL, LOW); // LOW = Relay ON for Active-Low relays
-  Serial.println("✓ Light control relay (GPIO25) set to LOW = ACTIVE/ON (always on)");
-  
-  Serial.println("✓ All relays initialized");
-  Serial.println("  Light control: ALWAYS ON");
-  Serial.println("  Other relays: OFF (will activate when fish species is selected)");
-  
-  // RELAY HARDWARE TEST - DISABLED for GPIO23 to prevent startup activation
-  // GPIO23 (Alkali pump) test is skipped to prevent relay from turning on at startup
-  Serial.println("\n=== RELAY HARDWARE TEST ===");
-  Serial.println("GPIO23 (Alkali pump) test SKIPPED - keeping relay OFF");
-  Serial.println("Other relay tests can be added here if needed");
-  Serial.println("================================\n");
-  
-  // CRITICAL: Ensure GPIO23 is still HIGH after skipping test
-  digitalWrite(REL_ALKALI_PUMP, HIGH);
-  delay(100);
-  digitalWrite(REL_ALKALI_PUMP, HIGH);
-  delay(100);
-  pin23State = digitalRead(REL_ALKALI_PUMP); // Reuse existing variable
-  Serial.printf("GPIO23 state after test skip: %s\n", pin23State == HIGH ? "HIGH ✓ OFF" : "LOW ✗ ON - ERROR!");
-  if (pin23State != HIGH) {
-    Serial.println("FORCING GPIO23 to HIGH...");
-    for (int i = 0; i < 10; i++) {
-      digitalWrite(REL_ALKALI_PUMP, HIGH);
-      delay(50);
-    }
-    pin23State = digitalRead(REL_ALKALI_PUMP);
-    Serial.printf("GPIO23 after force: %s\n", pin23State == HIGH ? "HIGH ✓" : "LOW ✗");
-  }
+  relayBank.apply();
   
   // Load saved settings
   loadCalibration();
+  dosingEngine.begin(); // Tank volume and learned pump gains
+  tempControl.begin();  // Heater mode, deadband and learned thermal model
   loadFishType(); // Load saved fish type (for reference, but we'll reset it)
   
   // CRITICAL: Always start with FISH_NONE - user must select fish manually
-  // This ensures only light relay is ON at startup, all other relays OFF
+  // With no fish the rule table leaves only the light ON
   resetFishTypeAtStartup();
-  
-  // Ensure all relays are OFF except light (which is already ON)
-  digitalWrite(REL_ACID_PUMP, getRelayLevel(false));
-  digitalWrite(REL_ALKALI_PUMP, getRelayLevel(false));
-  digitalWrite(REL_COOLER_FAN, getRelayLevel(false));
-  digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
-  digitalWrite(REL_AIR_PUMP, getRelayLevel(false));
-  digitalWrite(REL_WATER_FLOW, getRelayLevel(false));
-  digitalWrite(REL_RAIN_PUMP, getRelayLevel(false));
-  // Light relay is already ON (set earlier)
+  autoControl.begin();
   
   Serial.println("\n=== STARTUP STATE ===");
   Serial.println("Active Fish Type: NONE (must be selected manually)");
-  Serial.println("Relay Status:");
-  Serial.println("  ✓ Light Control: ON (always)");
-  Serial.println("  ✗ All other relays: OFF");
+  Serial.printf("Relay mask: 0x%02X (light 0x%02X)\n", relayBank.getMask(), relayBit(REL_LIGHT_CTRL));
   Serial.println("  → Select a fish species to activate relays");
   Serial.println("=====================\n");
   
@@ -222,20 +212,9 @@ void setup() {
   Serial.println("   System Ready!");
   Serial.println("========================================\n");
   
-  // FINAL SAFETY CHECK: Ensure GPIO23 is OFF before entering main loop
-  digitalWrite(REL_ALKALI_PUMP, HIGH); // Explicit HIGH (OFF for Active-Low)
-  delay(100);
-  pin23State = digitalRead(REL_ALKALI_PUMP);
-  Serial.printf("FINAL GPIO23 check before main loop: %s\n", pin23State == HIGH ? "HIGH ✓ OFF" : "LOW ✗ ON - ERROR!");
-  if (pin23State != HIGH) {
-    Serial.println("CRITICAL: GPIO23 is ON! Forcing to OFF...");
-    for (int i = 0; i < 5; i++) {
-      digitalWrite(REL_ALKALI_PUMP, HIGH);
-      delay(50);
-    }
-    pin23State = digitalRead(REL_ALKALI_PUMP);
-    Serial.printf("GPIO23 after force OFF: %s\n", pin23State == HIGH ? "HIGH ✓" : "LOW ✗");
-  }
+  // FINAL SAFETY CHECK: relay outputs (GPIO23 included) must match the bank before the main loop
+  uint8_t relayFaults = relayBank.verify();
+  Serial.printf("FINAL relay check before main loop: %s\n", relayFaults == 0 ? "✓ OK" : "✗ re-asserted");
   
   if (wifiServer.isConnected()) {
     Serial.print("Dashboard: http://");
@@ -247,73 +226,27 @@ void setup() {
   // This gives time for all systems to stabilize
   Serial.println("\nSystem stabilizing... (3 seconds)");
   delay(3000);
+  
+  // From here on sensors, pumps and fan are owned by the control task
+  if (!controlTask.begin()) {
+    Serial.println("ERROR: Control task failed to start - automatic control disabled!");
+  }
+  
+  // loop() work: web requests polled, LCD redrawn at its own rate, settings written behind
+  loopJobs.addPeriodic("web", WEB_POLL_INTERVAL, webJob, nullptr, WEB_JOB_BUDGET_US);
+  loopJobs.addPeriodic("lcd", LCD_UPDATE_INTERVAL, displayJob, nullptr, LCD_JOB_BUDGET_US);
+  loopJobs.addPeriodic("history", HISTORY_SAMPLE_INTERVAL, historyJob, nullptr, HISTORY_JOB_BUDGET_US);
+  loopJobs.addPeriodic("config_flush", CONFIG_FLUSH_INTERVAL, configFlushJob, nullptr, CONFIG_FLUSH_BUDGET_US);
+  Serial.printf("History: %u bytes static (%u/%u/%u blocks of %u B for 1 s, %lu s, %lu s; spans %lu s, %lu s, %lu s)\n",
+                (unsigned)sizeof(History), HISTORY_RAW_BLOCKS, HISTORY_MINUTE_BLOCKS, HISTORY_QUARTER_BLOCKS,
+                HISTORY_BLOCK_BYTES, (unsigned long)HISTORY_MINUTE_S, (unsigned long)HISTORY_QUARTER_S,
+                (unsigned long)HISTORY_RAW_SPAN, (unsigned long)(HISTORY_MINUTE_SPAN * HISTORY_MINUTE_S),
+                (unsigned long)(HISTORY_QUARTER_SPAN * HISTORY_QUARTER_S));
   Serial.println("System ready - entering main loop\n");
 }
 
 // ======================= MAIN LOOP =======================
 void loop() {
-  unsigned long now = millis();
-  
-  // Light control relay: Always keep ACTIVE/ON (LOW = ON for Active-Low relays)
-  digitalWrite(REL_LIGHT_CTRL, LOW);
-  
-  // CRITICAL SAFETY: Continuously monitor GPIO23 to ensure it stays OFF when not in use
-  // This prevents any accidental activation - runs EVERY loop iteration
-  static unsigned long lastGPIO23Check = 0;
-  if (now - lastGPIO23Check >= 100) { // Check every 100ms
-    lastGPIO23Check = now;
-    
-    if (!phControl.getBaseState()) {
-      // Base pump should be OFF - verify pin is HIGH
-      int pin23State = digitalRead(REL_ALKALI_PUMP);
-      if (pin23State != HIGH) {
-        // Pin is LOW but pump should be OFF - force it HIGH immediately
-        Serial.println("WARNING: GPIO23 went LOW when it should be HIGH! Fixing...");
-        for (int i = 0; i < 5; i++) {
-          digitalWrite(REL_ALKALI_PUMP, HIGH);
-          delayMicroseconds(100);
-        }
-        pin23State = digitalRead(REL_ALKALI_PUMP);
-        if (pin23State != HIGH) {
-          Serial.println("ERROR: GPIO23 still LOW after fix attempt!");
-        }
-      }
-    } else {
-      // Base pump is supposed to be ON - verify pin is LOW
-      int pin23State = digitalRead(REL_ALKALI_PUMP);
-      if (pin23State != LOW) {
-        // Should be LOW but it's HIGH - this is also a problem
-        Serial.println("WARNING: GPIO23 is HIGH when base pump should be ON!");
-      }
-    }
-  }
-  
-  // Handle web server
-  wifiServer.update();
-  
-  // Read sensors
-  if (now - lastSensorRead >= PH_READ_INTERVAL) {
-    currentPH = phSensor.read();
-    currentTemp = tempSensor.read();
-    phState = getPHState(currentPH);
-    tempState = getTempState(currentTemp);
-    lastSensorRead = now;
-  }
-  
-  // Update auto control
-  autoControl.update();
-  
-  // Update LCD display
-  lcdUI.update(
-    currentPH, currentTemp, phState, tempState,
-    fanControl.getState(),
-    phControl.getAcidState(),
-    phControl.getBaseState(),
-    phControl.getCooldownRemaining(),
-    wifiServer.isConnected(),
-    wifiServer.getIP()
-  );
-  
-  // Small delay to prevent watchdog issues
-  delay(10);
+  // Run whatever is due, then sleep until the next deadline instead of spinning
+  loopJobs.sleep(loopJobs.runDue());
 }
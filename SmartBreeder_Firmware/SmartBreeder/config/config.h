@@ -10,19 +10,32 @@
 #define SDA_PIN 21          // I2C SDA for LCD
 #define SCL_PIN 22          // I2C SCL for LCD
 
-// Relay pins (Active-Low) - Updated pin mapping
-const uint8_t REL_ACID_PUMP   = 16; // Acid pump relay - G16
-const uint8_t REL_ALKALI_PUMP = 23; // Alkali pump relay - G23
-const uint8_t REL_COOLER_FAN  = 18; // Cooler fan relay - G18
-const uint8_t REL_WATER_HEATER= 19; // Water heater relay - G19
-const uint8_t REL_AIR_PUMP    = 26; // Air pump relay - G26
-const uint8_t REL_WATER_FLOW  = 32; // Water flow pump relay - G32
-const uint8_t REL_RAIN_PUMP   = 33; // Rain pump relay - G33
-const uint8_t REL_LIGHT_CTRL  = 25; // Light control relay - G25
+// Relays (Active-Low): pins, polarity and boot state live in RELAY_MAP below.
+// REL_* are typed RelayId values, not pin numbers, so digitalWrite(REL_x, HIGH)
+// does not compile - every relay write goes through RelayBank.
+enum class RelayId : uint8_t {
+  AcidPump = 0,
+  AlkaliPump,
+  CoolerFan,
+  WaterHeater,
+  AirPump,
+  WaterFlow,
+  RainPump,
+  LightCtrl
+};
+
+constexpr RelayId REL_ACID_PUMP    = RelayId::AcidPump;    // Acid pump relay - G16
+constexpr RelayId REL_ALKALI_PUMP  = RelayId::AlkaliPump;  // Alkali pump relay - G23
+constexpr RelayId REL_COOLER_FAN   = RelayId::CoolerFan;   // Cooler fan relay - G18
+constexpr RelayId REL_WATER_HEATER = RelayId::WaterHeater; // Water heater relay - G19
+constexpr RelayId REL_AIR_PUMP     = RelayId::AirPump;     // Air pump relay - G26
+constexpr RelayId REL_WATER_FLOW   = RelayId::WaterFlow;   // Water flow pump relay - G32
+constexpr RelayId REL_RAIN_PUMP    = RelayId::RainPump;    // Rain pump relay - G33
+constexpr RelayId REL_LIGHT_CTRL   = RelayId::LightCtrl;   // Light control relay - G25
 
 // Legacy aliases for backward compatibility
-#define REL_FAN REL_COOLER_FAN
-#define REL_BASE_PUMP REL_ALKALI_PUMP
+constexpr RelayId REL_FAN = REL_COOLER_FAN;
+constexpr RelayId REL_BASE_PUMP = REL_ALKALI_PUMP;
 
 // LCD Configuration
 #define LCD_ADDRESS 0x27
@@ -46,31 +59,323 @@ IPAddress subnet(255, 255, 255, 0);       // Subnet mask
 IPAddress dns(192, 168, 0, 1);            // DNS server (usually router IP)
 
 // ======================= RELAY CONFIG =======================
-const bool RELAY_ACTIVE_HIGH = false; // Active-Low relays
+enum class RelaySafety : uint8_t {
+  Dosing,       // Chemical pumps: time-limited by PHControl, never ON at boot
+  Thermal,      // Heater / cooler fan: forced safe on over-temperature
+  LifeSupport,  // Air pump, water flow
+  Auxiliary     // Rain, light
+};
+
+struct RelayDescriptor {
+  RelayId id;
+  uint8_t pin;
+  bool activeHigh;
+  bool defaultOn;
+  RelaySafety safety;
+};
+
+// One row per relay, in RelayId order (checked below)
+constexpr RelayDescriptor RELAY_MAP[] = {
+  // id                    pin  activeHigh defaultOn safety
+  { RelayId::AcidPump,     16,  false,     false,    RelaySafety::Dosing },
+  { RelayId::AlkaliPump,   23,  false,     false,    RelaySafety::Dosing },
+  { RelayId::CoolerFan,    18,  false,     false,    RelaySafety::Thermal },
+  { RelayId::WaterHeater,  19,  false,     false,    RelaySafety::Thermal },
+  { RelayId::AirPump,      26,  false,     false,    RelaySafety::LifeSupport },
+  { RelayId::WaterFlow,    32,  false,     false,    RelaySafety::LifeSupport },
+  { RelayId::RainPump,     33,  false,     false,    RelaySafety::Auxiliary },
+  { RelayId::LightCtrl,    25,  false,     true,     RelaySafety::Auxiliary }, // Light always ON
+};
+
+constexpr uint8_t RELAY_COUNT = sizeof(RELAY_MAP) / sizeof(RELAY_MAP[0]);
+
+constexpr uint8_t relayIndex(RelayId id) { return static_cast<uint8_t>(id); }
+constexpr uint8_t relayPin(RelayId id) { return RELAY_MAP[relayIndex(id)].pin; }
+constexpr uint8_t relayBit(RelayId id) { return (uint8_t)(1U << relayIndex(id)); } // Bit in RelayBank masks
+
+// Channel masks folded out of RELAY_MAP at compile time
+constexpr uint8_t relayDefaultMask() {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < RELAY_COUNT; i++) {
+    if (RELAY_MAP[i].defaultOn) mask |= 1U << i;
+  }
+  return mask;
+}
+
+constexpr uint8_t relayActiveHighMask() {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < RELAY_COUNT; i++) {
+    if (RELAY_MAP[i].activeHigh) mask |= 1U << i;
+  }
+  return mask;
+}
+
+constexpr uint8_t relaySafetyMask(RelaySafety safety) {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < RELAY_COUNT; i++) {
+    if (RELAY_MAP[i].safety == safety) mask |= 1U << i;
+  }
+  return mask;
+}
+
+constexpr uint8_t RELAY_ALL_MASK = (uint8_t)((1U << RELAY_COUNT) - 1);
+constexpr uint8_t RELAY_DEFAULT_MASK = relayDefaultMask();          // Boot state
+constexpr uint8_t RELAY_ACTIVE_HIGH_MASK = relayActiveHighMask();   // Polarity: one XOR per write
+constexpr uint8_t RELAY_DOSING_MASK = relaySafetyMask(RelaySafety::Dosing);
+
+constexpr bool relayMapValid() {
+  for (uint8_t i = 0; i < RELAY_COUNT; i++) {
+    if (relayIndex(RELAY_MAP[i].id) != i) return false;
+    if (RELAY_MAP[i].pin >= 34) return false; // GPIO34-39 are input-only
+    if (RELAY_MAP[i].safety == RelaySafety::Dosing && RELAY_MAP[i].defaultOn) return false;
+    for (uint8_t j = 0; j < i; j++) {
+      if (RELAY_MAP[j].pin == RELAY_MAP[i].pin) return false;
+    }
+  }
+  return true;
+}
+
+static_assert(RELAY_COUNT <= 8, "RelayBank masks are 8 bits wide");
+static_assert(relayMapValid(), "RELAY_MAP: rows must follow RelayId order, use distinct output pins, "
+                               "and dosing relays must default OFF");
+
+// ======================= RELAY RULES =======================
+// Facts the rule table can test, gathered by AutoControl once per control tick
+enum RuleCondition : uint16_t {
+  COND_FISH_SELECTED = 1U << 0,  // A species or custom profile is active
+  COND_TEMP_VALID    = 1U << 1,  // At least one temperature probe is trustworthy
+  COND_OVER_TEMP     = 1U << 2,  // Any probe above TEMP_MAX_SAFE
+  COND_HEAT_DEMAND   = 1U << 3,  // TempControl wants the heater
+  COND_COOL_DEMAND   = 1U << 4,  // TempControl wants the fan
+  COND_PROFILE_FLOW  = 1U << 5,  // Active profile asks for water flow
+  COND_PROFILE_RAIN  = 1U << 6   // Active profile asks for rain
+};
+
+struct RelayRule {
+  uint8_t relays;     // relayBit() mask the rule decides
+  uint16_t require;   // Every one of these conditions must hold...
+  uint16_t forbid;    // ...and none of these
+  bool on;
+  uint8_t priority;   // Documentation of intent; the table must be sorted by it (checked below)
+};
+
+constexpr uint8_t RULE_HEATER = relayBit(REL_WATER_HEATER);
+constexpr uint8_t RULE_FAN = relayBit(REL_COOLER_FAN);
+constexpr uint8_t RULE_AIR = relayBit(REL_AIR_PUMP);
+constexpr uint8_t RULE_FLOW = relayBit(REL_WATER_FLOW);
+constexpr uint8_t RULE_RAIN = relayBit(REL_RAIN_PUMP);
+constexpr uint8_t RULE_LIGHT = relayBit(REL_LIGHT_CTRL);
+
+// Per relay the first matching row wins; a relay no row matches is OFF.
+// Relays under manual override are skipped. Dosing pumps belong to PHControl.
+constexpr RelayRule RELAY_RULES[] = {
+  // relays                                                require                                 forbid              on     prio
+  { RULE_HEATER,                                           COND_OVER_TEMP,                         0,                  false, 100 }, // Emergency
+  { RULE_FAN,                                              COND_OVER_TEMP,                         0,                  true,  100 },
+  { RULE_HEATER,                                           0,                                      COND_TEMP_VALID,    false, 90 },  // Fail safe
+  { RULE_HEATER | RULE_FAN | RULE_AIR | RULE_FLOW | RULE_RAIN, 0,                                   COND_FISH_SELECTED, false, 80 },  // No fish
+  { RULE_AIR,                                              COND_FISH_SELECTED,                     0,                  true,  50 },
+  { RULE_FLOW,                                             COND_FISH_SELECTED | COND_PROFILE_FLOW, 0,                  true,  50 },
+  { RULE_RAIN,                                             COND_FISH_SELECTED | COND_PROFILE_RAIN, 0,                  true,  50 },
+  { RULE_HEATER,                                           COND_HEAT_DEMAND,                       0,                  true,  40 },
+  { RULE_FAN,                                              COND_COOL_DEMAND,                       0,                  true,  40 },
+  { RULE_LIGHT,                                            0,                                      0,                  true,  10 },  // Always ON
+};
+
+constexpr uint8_t RELAY_RULE_COUNT = sizeof(RELAY_RULES) / sizeof(RELAY_RULES[0]);
+
+constexpr uint8_t relayRuleMask() {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < RELAY_RULE_COUNT; i++) mask |= RELAY_RULES[i].relays;
+  return mask;
+}
+
+constexpr uint8_t RELAY_RULE_MASK = relayRuleMask(); // Relays the rule table owns
+
+constexpr bool relayRulesValid() {
+  for (uint8_t i = 1; i < RELAY_RULE_COUNT; i++) {
+    if (RELAY_RULES[i].priority > RELAY_RULES[i - 1].priority) return false;
+  }
+  return true;
+}
+
+static_assert(relayRulesValid(), "RELAY_RULES must be sorted by descending priority");
+static_assert((RELAY_RULE_MASK & RELAY_DOSING_MASK) == 0, "Dosing pumps are driven by PHControl, not rules");
+static_assert((RELAY_RULE_MASK & ~RELAY_ALL_MASK) == 0, "RELAY_RULES names a relay not in RELAY_MAP");
 
 // ======================= TIMING CONSTANTS =======================
-const unsigned long TEMP_READ_INTERVAL = 2000;    // 2 seconds
-const unsigned long PH_READ_INTERVAL = 500;        // 500ms
+// Sensor sampling adapts between floor (signal moving) and ceiling (signal stable)
+const unsigned long TEMP_READ_INTERVAL_MIN = 1000;   // 1 second (must exceed 750ms conversion)
+const unsigned long TEMP_READ_INTERVAL_MAX = 30000;  // 30 seconds
+const unsigned long TEMP_RESCAN_INTERVAL = TEMP_READ_INTERVAL_MAX; // Bus search while no probe is found
+// A change of at most one step is sensor quantisation, never a transient; the rate
+// threshold is one step per floor interval, so a one-step flicker can't reset backoff
+const int32_t TEMP_STABLE_STEP = 63;                 // m°C: one 12-bit DS18B20 LSB (62.5)
+const int32_t TEMP_STABLE_RATE = 63;                 // m°C/s below which temperature is stable
+const unsigned long PH_READ_INTERVAL_MIN = 250;      // 250ms
+const unsigned long PH_READ_INTERVAL_MAX = 5000;     // 5 seconds
+const int32_t PH_STABLE_STEP = 15;                   // milli-pH: ~3 ADC counts at 6 pH/V after the ADC median
+const int32_t PH_STABLE_RATE = 60;                   // milli-pH/s below which pH is stable
 const unsigned long LCD_UPDATE_INTERVAL = 500;     // 500ms
 const unsigned long LCD_PAGE_DURATION = 5000;     // 5 seconds per page
+const unsigned long SENSOR_STALE_MARGIN = 5000;    // Stale after two missed intervals plus this
+
+// Control task: acquisition + control run here at a fixed period, web/LCD stay in loop()
+// Core 0 keeps control off the loop() core; WiFi driver bursts there are sub-millisecond
+const uint32_t CONTROL_TASK_PERIOD_MS = 50;        // 20 Hz control tick
+const int CONTROL_TASK_CORE = 0;
+const uint32_t CONTROL_TASK_PRIORITY = 5;          // Above loop() (1), below WiFi/ADC drain
+const uint32_t CONTROL_TASK_STACK = 8192;          // Preferences + printf in control paths
+const unsigned long RELAY_VERIFY_INTERVAL = 100;   // Output latch readback watchdog
+const unsigned long PH_CHECK_INTERVAL = 60000;     // Dosing decision (also runs when a cooldown ends)
+
+// Cooperative job scheduler (loop() and the control task each run one)
+const uint8_t SCHED_MAX_JOBS = 8;
+const uint32_t SCHED_IDLE_SLEEP_MS = 100;          // Longest loop() sleep when nothing is due
+const unsigned long WEB_POLL_INTERVAL = 10;        // WebServer::handleClient() cadence
+// Run-time budgets; a job over budget is counted in its stats
+const uint32_t WEB_JOB_BUDGET_US = 20000;
+const uint32_t LCD_JOB_BUDGET_US = 30000;          // I2C character LCD rewrite
+const uint32_t RELAY_VERIFY_BUDGET_US = 200;
+const uint32_t PROFILE_JOB_BUDGET_US = 500;        // RAM reads from configCache
+const uint32_t PH_CHECK_BUDGET_US = 2000;
+
+// Settings persistence (ConfigCache write-behind)
+const unsigned long NVS_WRITE_BEHIND_MS = 5000;    // Changes within this window share one flash write
+const unsigned long CONFIG_FLUSH_INTERVAL = 1000;  // loop() job checking for due writes
+const uint32_t CONFIG_FLUSH_BUDGET_US = 30000;     // NVS page writes
+const uint32_t CONFIG_SHUTDOWN_LOCK_MS = 100;      // Restart-time flush gives up on a held cache
 
 // Safety timings
-const unsigned long PUMP_MAX_DURATION = 3000;     // 3 seconds max pump ON
-const unsigned long PUMP_COOLDOWN = 5UL * 60UL * 1000UL; // 5 minutes cooldown
+const unsigned long PUMP_MAX_DURATION = 3000;     // 3 seconds max pump ON (enforced by esp_timer)
+const unsigned long PUMP_DEADLINE_GRACE = 100;    // Software backstop if the dose timer never fires
+// Dosing lockout ends once pH has settled after the dose, within these bounds
+const unsigned long DOSE_COOLDOWN_MIN = 15000;            // Always let the dose start mixing
+const unsigned long DOSE_COOLDOWN_MAX = 5UL * 60UL * 1000UL; // 5 minutes, even if never settled
+const unsigned long DOSE_SETTLE_INITIAL = 60000;          // Settle estimate before anything is learned
+const unsigned long PH_SETTLE_WINDOW = 10000;             // pH slope measured over this span
+const int32_t PH_SETTLE_RATE = 2;                         // milli-pH/s; settled at or below this
+const int32_t SETTLE_LEARN_RATE_PCT = 30;                 // EMA weight of each measured settle time
 const unsigned long FAN_MIN_TOGGLE_INTERVAL = 10000; // 10 seconds between fan toggles
 
+// Temperature control: heater/fan hysteresis, or PID time-proportioning for the heater.
+// Temperatures in m°C; PID output is heater duty in permille of one window.
+const int32_t TEMP_DEADBAND_DEFAULT = 300;         // 0.3°C: heater runs to min + this, fan to max - this
+const int32_t TEMP_DEADBAND_MIN = 50;
+const int32_t TEMP_DEADBAND_MAX = 2000;
+const unsigned long HEATER_PID_WINDOW_MS = 30000;  // Slow PWM period of the heater relay
+const unsigned long HEATER_MIN_SWITCH_MS = 3000;   // Shorter on/off slices are skipped (relay wear)
+const int32_t TEMP_PID_KP = 800;                   // Permille duty per °C below setpoint
+const int32_t TEMP_PID_TI_S = 900;                 // Integral time, seconds
+const int32_t TEMP_PID_TD_S = 60;                  // Derivative time, seconds (on measurement)
+const unsigned long THERMAL_SAVE_INTERVAL = 30UL * 60UL * 1000UL; // Persist learned slopes at most this often
+
+// Thermal model (ThermalModel): rates in micro-°C per second
+const int32_t THERMAL_HEAT_RATE_DEFAULT = 500;     // ~1.8°C/h
+const int32_t THERMAL_FAN_RATE_DEFAULT = -200;
+const int32_t THERMAL_DRIFT_RATE_DEFAULT = -50;
+const int32_t THERMAL_LEARN_RATE_PCT = 20;         // EMA weight of each slope observation
+const int32_t THERMAL_COAST_LEARN_RATE_PCT = 40;   // Fewer, more telling coast observations
+const uint32_t THERMAL_SLOPE_WINDOW_MS = 600000;   // A slope is learned every 10 min in one state...
+const uint32_t THERMAL_MIN_SPAN_MS = 120000;       // ...or at a switch, if the stretch lasted 2 min (one
+                                                   // 1/16 °C step is then at most ~520 u°C/s of error)
+// Longer gap between two samples: missed samples, restart the stretch. Same
+// bound at which acquisition marks the temperature stale.
+const uint32_t THERMAL_MAX_SPAN_MS = 2 * TEMP_READ_INTERVAL_MAX + SENSOR_STALE_MARGIN;
+const uint32_t THERMAL_COAST_WINDOW_MS = 600000;   // Stop tracking a coast after 10 minutes
+const int32_t THERMAL_COAST_NOISE = 30;            // m°C past the peak that ends a coast
+
+// Proportional dosing: on-time = error * tank volume / gain, gain learned per pump.
+// Gain unit: milli-pH * litre per second of pump (10000 = 0.1 pH/s in a 100 L tank)
+const uint32_t TANK_VOLUME_DEFAULT_L = 100;
+const uint32_t TANK_VOLUME_MIN_L = 1;
+const uint32_t TANK_VOLUME_MAX_L = 5000;
+const int32_t DOSE_GAIN_DEFAULT = 10000;
+const int32_t DOSE_GAIN_MIN = 500;
+const int32_t DOSE_GAIN_MAX = 1000000;
+const int32_t DOSE_TARGET_PCT = 80;         // Correct this share of the error per dose (undershoot)
+const int32_t DOSE_LEARN_RATE_PCT = 30;     // EMA weight of each observed response
+const int32_t DOSE_MIN_RESPONSE = 20;       // milli-pH; smaller moves are probe noise, not learned...
+const int32_t DOSE_EXPECTED_RESPONSE = 40;  // ...unless the gain predicted this much: then the gain is too high
+const unsigned long PUMP_MIN_DOSE_MS = 200; // Shorter runs are mostly pump spin-up
+
 // ======================= SENSOR CONFIG =======================
 const int PH_MEDIAN_SAMPLES = 15;
-const float PH_MIN_SAFE = 5.5;
-const float PH_MAX_SAFE = 9.0;
+const int PH_ADC_MEDIAN_SAMPLES = 9;                  // Raw ADC samples per pH reading
+const uint32_t PH_ADC_SAMPLE_FREQ = 20000;            // Continuous ADC conversion rate (Hz)
+const uint32_t PH_ADC_CONVERSIONS_PER_SAMPLE = 20;    // Averaged per ring sample -> 1 kHz
+const size_t PH_ADC_RING_SIZE = 64;                   // Background sample ring (power of 2)
+const uint32_t ADC_DEFAULT_VREF_MV = 1100;            // Used only if the eFuse has no calibration
+const uint8_t PH_OVERSAMPLE_EXTRA_BITS = 2;           // Oversample mode: 12 + 2 = 14-bit steps (~1 bit real gain)
+const size_t PH_OVERSAMPLE_COUNT = 1u << (2 * PH_OVERSAMPLE_EXTRA_BITS); // 4^n samples per reading
+static_assert(PH_OVERSAMPLE_COUNT <= PH_ADC_RING_SIZE, "Oversample window must fit in the ADC ring");
+const int32_t PH_MIN_SAFE = 5500;  // milli-pH
+const int32_t PH_MAX_SAFE = 9000;  // milli-pH
+const int PH_SLOPE_FRAC_BITS = 20; // Fixed-point fraction bits of the pH calibration slope
 const float TEMP_MAX_SAFE = 40.0; // Emergency fan ON above this
+const int TEMP_MAX_PROBES = 4;    // DS18B20 probes on the OneWire bus (inlet/outlet/heater side...)
+const uint8_t TEMP_RESOLUTION_BITS = 12; // Written to every probe found: 0.0625 °C, 750 ms conversion
+const float TEMP_POWER_ON_C = 85.0;     // DS18B20 scratchpad reset value: no conversion has run since power-up
+const float TEMP_DISCONNECTED_C = -127.0; // DallasTemperature's DEVICE_DISCONNECTED_C
+
+// ======================= HISTORY =======================
+// Three tiers in static RAM (History): raw seconds, then min/max/mean buckets
+const unsigned long HISTORY_SAMPLE_INTERVAL = 1000; // 1 s tier, loop() job
+const uint32_t HISTORY_MINUTE_S = 60;
+const uint32_t HISTORY_QUARTER_S = 15 * 60;
+// Span each tier keeps, in its own slots; older blocks are dropped whole
+const uint32_t HISTORY_RAW_SPAN = 600;              // 10 minutes of 1 s samples
+const uint32_t HISTORY_MINUTE_SPAN = 24 * 60;       // 24 hours of 1 min buckets
+const uint32_t HISTORY_QUARTER_SPAN = 30 * 24 * 4;  // 30 days of 15 min buckets
+// Compressed 256 B blocks per tier (sensors/historyCodec.h); the oldest block is
+// also dropped whole when all are full. Raw is sized for the codec's worst case
+// (nothing compresses), so it always holds its span. Buckets are sized for the
+// typical rate (host/historyCodecBench): a noisy signal keeps less, reported as
+// coverageS in /api/history and /api/status.
+const uint16_t HISTORY_RAW_BLOCKS = 30;             // Worst case 95 bits/sample: >= 609 samples
+const uint16_t HISTORY_MINUTE_BLOCKS = 20;          // Typical ~2.1 B/bucket: full span; random noise ~10 hours
+const uint16_t HISTORY_QUARTER_BLOCKS = 56;         // Typical ~3.6 B/bucket: full span; random noise ~23 days
+const int16_t HISTORY_BUCKET_PH_STEP = 10;          // Bucket pH stored in 0.01 pH (samples: 0.001)
+const int16_t HISTORY_BUCKET_TEMP_STEP = 5;         // Bucket temperature in 0.05 °C (samples: 0.01)
+const int16_t HISTORY_BUCKET_DUTY_STEP = 5;         // Relay duty in 5% steps
+const uint16_t HISTORY_CHUNK_POINTS = 32;           // /api/history points per sendContent()
+const uint32_t HISTORY_JOB_BUDGET_US = 500;
 
 // ======================= CALIBRATION STORAGE =======================
 #define PREF_NAMESPACE "smartbreeder"
-#define PREF_PH7_KEY "ph7_voltage"
-#define PREF_PH4_KEY "ph4_voltage"
+#define PREF_CONFIG_KEY "config"        // Every setting below as one ConfigBlob (see configCache.h)
+const uint16_t CONFIG_BLOB_MAGIC = 0x4253;   // "SB"
+const uint8_t CONFIG_BLOB_VERSION = 1;
+const uint8_t CONFIG_NAME_LEN = 32;          // Custom fish name, NUL included
+// Per-key layout used before the config blob; read once to migrate, then removed
+#define PREF_PH7_KEY "ph7_voltage"      // Legacy float volts (migrated on load)
+#define PREF_PH4_KEY "ph4_voltage"      // Legacy float volts (migrated on load)
+#define PREF_PH_OFFSET_LEGACY_KEY "ph_offset" // Legacy float pH (migrated on load)
+#define PREF_PH7_UV_KEY "ph7_uv"        // pH 7 buffer voltage, microvolts
+#define PREF_PH4_UV_KEY "ph4_uv"        // pH 4 buffer voltage, microvolts
+#define PREF_PH_OFFSET_KEY "ph_off_mph" // pH offset, milli-pH
 #define PREF_TEMP_OFFSET_KEY "temp_offset"
 #define PREF_FISH_TYPE_KEY "fish_type"
+#define PREF_PH_MODE_KEY "ph_mode"
+#define PREF_DOSE_GAIN_ACID_KEY "dose_k_acid" // Learned acid pump gain (see DOSE_GAIN_DEFAULT)
+#define PREF_DOSE_GAIN_BASE_KEY "dose_k_base" // Learned base pump gain
+#define PREF_TANK_VOLUME_KEY "tank_l"         // Tank volume, litres
+#define PREF_TEMP_MODE_KEY "temp_mode"        // TempMode (hysteresis / PID heater)
+#define PREF_TEMP_DEADBAND_KEY "temp_db_mc"   // Temperature deadband, m°C
+#define PREF_THERMAL_KEY "thermal"            // ThermalParams blob (learned tank model)
+#define PREF_USE_CUSTOM_KEY "use_custom_profile"
+#define PREF_CUSTOM_PH_MIN_KEY "custom_ph_min"
+#define PREF_CUSTOM_PH_MAX_KEY "custom_ph_max"
+#define PREF_CUSTOM_TEMP_MIN_KEY "custom_temp_min"
+#define PREF_CUSTOM_TEMP_MAX_KEY "custom_temp_max"
+#define PREF_CUSTOM_NAME_KEY "custom_fish_name"
+#define PREF_CUSTOM_FLOW_KEY "custom_water_flow"
+#define PREF_CUSTOM_RAIN_KEY "custom_rain"
+#define PREF_MANUAL_HEATER_KEY "manual_water_heater" // Manual override flags, one per relay
+#define PREF_MANUAL_AIR_KEY "manual_air_pump"
+#define PREF_MANUAL_FLOW_KEY "manual_water_flow"
+#define PREF_MANUAL_RAIN_KEY "manual_rain_pump"
+#define PREF_MANUAL_LIGHT_KEY "manual_light_control"
 
 // ======================= FISH PROFILES =======================
 enum FishType {
@@ -106,17 +411,16 @@ const FishProfile FISH_PROFILES[] = {
 };
 
 // ======================= GLOBAL STATE =======================
-extern Preferences preferences;
 extern FishType activeFishType;
 
 // Helper functions
-int getRelayLevel(bool logicalOn);
+inline int32_t toMilli(float value) { return (int32_t)lroundf(value * 1000.0f); } // Profile/API -> fixed-point
 void loadCalibration();
 void saveCalibration();
 void loadFishType();
 void saveFishType();
 void resetFishTypeAtStartup(); // Reset to FISH_NONE at startup
-FishProfile getActiveFishProfile(); // Get active fish profile (custom or default)
+const FishProfile& getActiveFishProfile(); // Active fish profile (custom or default), cached in RAM
 
 #endif
 
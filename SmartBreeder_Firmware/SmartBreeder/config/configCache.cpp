@@ -0,0 +1,436 @@
+
+#include "configCache.h"
+#include <stddef.h>
+#include <string.h>
+#include <esp_system.h>
+#include "config/config.h"
+
+ConfigCache configCache;
+
+// Relays the dashboard can take over by hand, and the NVS flag for each
+static const struct {
+  RelayId id;
+  const char* key;
+} MANUAL_KEYS[] = {
+  { REL_WATER_HEATER, PREF_MANUAL_HEATER_KEY },
+  { REL_AIR_PUMP,     PREF_MANUAL_AIR_KEY },
+  { REL_WATER_FLOW,   PREF_MANUAL_FLOW_KEY },
+  { REL_RAIN_PUMP,    PREF_MANUAL_RAIN_KEY },
+  { REL_LIGHT_CTRL,   PREF_MANUAL_LIGHT_KEY },
+};
+
+// Every other key loadLegacy() reads; removed once the blob holds their values
+static const char* const LEGACY_KEYS[] = {
+  PREF_PH7_KEY, PREF_PH4_KEY, PREF_PH_OFFSET_LEGACY_KEY, PREF_PH7_UV_KEY, PREF_PH4_UV_KEY,
+  PREF_PH_OFFSET_KEY, PREF_PH_MODE_KEY, PREF_TEMP_OFFSET_KEY, PREF_FISH_TYPE_KEY,
+  PREF_USE_CUSTOM_KEY, PREF_CUSTOM_PH_MIN_KEY, PREF_CUSTOM_PH_MAX_KEY, PREF_CUSTOM_TEMP_MIN_KEY,
+  PREF_CUSTOM_TEMP_MAX_KEY, PREF_CUSTOM_NAME_KEY, PREF_CUSTOM_FLOW_KEY, PREF_CUSTOM_RAIN_KEY,
+  PREF_DOSE_GAIN_ACID_KEY, PREF_DOSE_GAIN_BASE_KEY, PREF_TANK_VOLUME_KEY, PREF_TEMP_MODE_KEY,
+  PREF_TEMP_DEADBAND_KEY, PREF_THERMAL_KEY
+};
+
+static const char* const ENTRY_NAMES[CFG_ENTRY_COUNT] = {
+  "ph_cal", "ph_offset", "ph_mode", "temp_offset", "fish_type", "custom_profile",
+  "manual", "dose_gains", "tank", "temp_mode", "temp_deadband", "thermal"
+};
+
+ConfigCache::ConfigCache() :
+  mutex(nullptr), dirty(0), dirtySince(0), generation(0), nvsWrites(0), nvsBytes(0), migrated(false) {
+  memset(stats, 0, sizeof(stats));
+  values.ph7Microvolts = 2500000;
+  values.ph4Microvolts = 3000000; // pH 4 typically ~3.0V
+  values.phOffsetMilli = -500;
+  values.phMode = 0;
+  values.tempOffset = 0.0f;
+  values.fishType = FISH_NONE;
+  values.useCustomProfile = false;
+  values.customProfile = { "Custom", 7.0f, 9.0f, 24.0f, 28.0f, false, false };
+  values.manualMask = 0;
+  values.doseGainAcid = DOSE_GAIN_DEFAULT;
+  values.doseGainBase = DOSE_GAIN_DEFAULT;
+  values.tankLitres = TANK_VOLUME_DEFAULT_L;
+  values.tempMode = 0;
+  values.tempDeadband = TEMP_DEADBAND_DEFAULT;
+  values.hasThermal = false;
+  values.thermal = ThermalParams{ 0, 0, 0, 0, 0, 0 };
+}
+
+void ConfigCache::begin() {
+  mutex = xSemaphoreCreateMutex();
+  esp_register_shutdown_handler(shutdownFlush); // esp_restart() still writes pending changes
+
+  Preferences prefs;
+  prefs.begin(PREF_NAMESPACE, true);
+  bool hasBlob = prefs.isKey(PREF_CONFIG_KEY);
+  bool loaded = hasBlob && loadBlob(prefs);
+  migrated = !hasBlob;
+  if (migrated) {
+    loadLegacy(prefs);
+  }
+  prefs.end();
+
+  if (hasBlob && !loaded) {
+    // The per-key settings may be years older than the blob: never resurrect them
+    Serial.println("ERROR: config blob unreadable - settings reset to defaults");
+  }
+  if (!loaded) {
+    // First boot on the blob layout, or a bad blob: write it straight away
+    markDirty((1U << CFG_ENTRY_COUNT) - 1);
+    flush();
+  }
+  if (migrated && dirty == 0) {
+    // Only once the blob holds them: a failed write migrates again next boot
+    removeLegacy();
+    Serial.println("Settings migrated to the config blob");
+  }
+  Serial.printf("Settings loaded into RAM (%u byte blob, v%u)\n", (unsigned)sizeof(ConfigBlob), CONFIG_BLOB_VERSION);
+}
+
+bool ConfigCache::loadBlob(Preferences& prefs) {
+  ConfigBlob blob;
+  if (prefs.getBytesLength(PREF_CONFIG_KEY) != sizeof(blob) ||
+      prefs.getBytes(PREF_CONFIG_KEY, &blob, sizeof(blob)) != sizeof(blob)) {
+    return false;
+  }
+  if (blob.crc != crc32((const uint8_t*)&blob, offsetof(ConfigBlob, crc))) {
+    Serial.println("ERROR: config blob CRC mismatch");
+    return false;
+  }
+  return unpack(blob);
+}
+
+void ConfigCache::loadLegacy(Preferences& prefs) {
+  if (prefs.isKey(PREF_PH7_UV_KEY)) {
+    values.ph7Microvolts = prefs.getInt(PREF_PH7_UV_KEY, values.ph7Microvolts);
+    values.ph4Microvolts = prefs.getInt(PREF_PH4_UV_KEY, values.ph4Microvolts);
+    values.phOffsetMilli = prefs.getInt(PREF_PH_OFFSET_KEY, values.phOffsetMilli);
+  } else {
+    // Calibration saved by older firmware as float volts / pH
+    values.ph7Microvolts = (int32_t)lroundf(prefs.getFloat(PREF_PH7_KEY, 2.50f) * 1000000.0f);
+    values.ph4Microvolts = (int32_t)lroundf(prefs.getFloat(PREF_PH4_KEY, 3.00f) * 1000000.0f);
+    values.phOffsetMilli = (int32_t)lroundf(prefs.getFloat(PREF_PH_OFFSET_LEGACY_KEY, -0.5f) * 1000.0f);
+  }
+  values.phMode = prefs.getUChar(PREF_PH_MODE_KEY, values.phMode);
+  values.tempOffset = prefs.getFloat(PREF_TEMP_OFFSET_KEY, values.tempOffset);
+  values.fishType = prefs.getUChar(PREF_FISH_TYPE_KEY, values.fishType);
+
+  values.useCustomProfile = prefs.getBool(PREF_USE_CUSTOM_KEY, false);
+  FishProfile& custom = values.customProfile;
+  custom.phMin = prefs.getFloat(PREF_CUSTOM_PH_MIN_KEY, custom.phMin);
+  custom.phMax = prefs.getFloat(PREF_CUSTOM_PH_MAX_KEY, custom.phMax);
+  custom.tempMin = prefs.getFloat(PREF_CUSTOM_TEMP_MIN_KEY, custom.tempMin);
+  custom.tempMax = prefs.getFloat(PREF_CUSTOM_TEMP_MAX_KEY, custom.tempMax);
+  custom.name = prefs.getString(PREF_CUSTOM_NAME_KEY, custom.name);
+  custom.waterFlow = prefs.getBool(PREF_CUSTOM_FLOW_KEY, custom.waterFlow);
+  custom.rain = prefs.getBool(PREF_CUSTOM_RAIN_KEY, custom.rain);
+
+  for (const auto& manual : MANUAL_KEYS) {
+    if (prefs.getBool(manual.key, false)) values.manualMask |= relayBit(manual.id);
+  }
+
+  values.doseGainAcid = prefs.getInt(PREF_DOSE_GAIN_ACID_KEY, values.doseGainAcid);
+  values.doseGainBase = prefs.getInt(PREF_DOSE_GAIN_BASE_KEY, values.doseGainBase);
+  values.tankLitres = prefs.getUInt(PREF_TANK_VOLUME_KEY, values.tankLitres);
+  values.tempMode = prefs.getUChar(PREF_TEMP_MODE_KEY, values.tempMode);
+  values.tempDeadband = prefs.getInt(PREF_TEMP_DEADBAND_KEY, values.tempDeadband);
+  values.hasThermal = prefs.getBytesLength(PREF_THERMAL_KEY) == sizeof(ThermalParams) &&
+                      prefs.getBytes(PREF_THERMAL_KEY, &values.thermal, sizeof(ThermalParams)) == sizeof(ThermalParams);
+}
+
+void ConfigCache::removeLegacy() {
+  Preferences prefs;
+  prefs.begin(PREF_NAMESPACE, false);
+  for (const char* key : LEGACY_KEYS) {
+    prefs.remove(key);
+  }
+  for (const auto& manual : MANUAL_KEYS) {
+    prefs.remove(manual.key);
+  }
+  prefs.end();
+}
+
+void ConfigCache::pack(const ConfigValues& v, ConfigBlob& blob) {
+  memset(&blob, 0, sizeof(blob));
+  blob.magic = CONFIG_BLOB_MAGIC;
+  blob.version = CONFIG_BLOB_VERSION;
+  blob.size = sizeof(ConfigBlob);
+  blob.ph7Microvolts = v.ph7Microvolts;
+  blob.ph4Microvolts = v.ph4Microvolts;
+  blob.phOffsetMilli = v.phOffsetMilli;
+  blob.phMode = v.phMode;
+  blob.tempOffset = v.tempOffset;
+  blob.fishType = v.fishType;
+  blob.useCustomProfile = v.useCustomProfile;
+  blob.customPhMin = v.customProfile.phMin;
+  blob.customPhMax = v.customProfile.phMax;
+  blob.customTempMin = v.customProfile.tempMin;
+  blob.customTempMax = v.customProfile.tempMax;
+  blob.customWaterFlow = v.customProfile.waterFlow;
+  blob.customRain = v.customProfile.rain;
+  strncpy(blob.customName, v.customProfile.name.c_str(), CONFIG_NAME_LEN - 1); // Longer names are cut
+  blob.manualMask = v.manualMask;
+  blob.doseGainAcid = v.doseGainAcid;
+  blob.doseGainBase = v.doseGainBase;
+  blob.tankLitres = v.tankLitres;
+  blob.tempMode = v.tempMode;
+  blob.tempDeadband = v.tempDeadband;
+  blob.hasThermal = v.hasThermal;
+  blob.thermal = v.thermal;
+  blob.crc = crc32((const uint8_t*)&blob, offsetof(ConfigBlob, crc));
+}
+
+bool ConfigCache::unpack(const ConfigBlob& blob) {
+  if (blob.magic != CONFIG_BLOB_MAGIC) return false;
+  switch (blob.version) {
+    case 1:
+      if (blob.size != sizeof(ConfigBlob)) return false;
+      break;
+    default:
+      // Written by newer firmware: its layout is unknown here
+      Serial.printf("ERROR: config blob v%u not supported\n", blob.version);
+      return false;
+  }
+
+  values.ph7Microvolts = blob.ph7Microvolts;
+  values.ph4Microvolts = blob.ph4Microvolts;
+  values.phOffsetMilli = blob.phOffsetMilli;
+  values.phMode = blob.phMode;
+  values.tempOffset = blob.tempOffset;
+  values.fishType = blob.fishType;
+  values.useCustomProfile = blob.useCustomProfile;
+  char name[CONFIG_NAME_LEN];
+  memcpy(name, blob.customName, CONFIG_NAME_LEN);
+  name[CONFIG_NAME_LEN - 1] = '\0';
+  values.customProfile = { String(name), blob.customPhMin, blob.customPhMax, blob.customTempMin,
+                           blob.customTempMax, blob.customWaterFlow != 0, blob.customRain != 0 };
+  values.manualMask = blob.manualMask;
+  values.doseGainAcid = blob.doseGainAcid;
+  values.doseGainBase = blob.doseGainBase;
+  values.tankLitres = blob.tankLitres;
+  values.tempMode = blob.tempMode;
+  values.tempDeadband = blob.tempDeadband;
+  values.hasThermal = blob.hasThermal != 0;
+  values.thermal = blob.thermal;
+  return true;
+}
+
+uint32_t ConfigCache::crc32(const uint8_t* data, size_t len) {
+  // Bitwise CRC-32 (IEEE, reflected); runs on a ~150 byte blob at boot and per flush
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0U - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+const FishProfile& ConfigCache::activeProfile(FishType type) {
+  return values.useCustomProfile ? values.customProfile : FISH_PROFILES[type];
+}
+
+const char* ConfigCache::getEntryName(uint8_t index) {
+  return index < CFG_ENTRY_COUNT ? ENTRY_NAMES[index] : "";
+}
+
+bool ConfigCache::lock(TickType_t wait) {
+  return mutex == nullptr || xSemaphoreTake(mutex, wait) == pdTRUE; // No mutex yet: still single-threaded setup()
+}
+
+void ConfigCache::unlock() {
+  if (mutex != nullptr) xSemaphoreGive(mutex);
+}
+
+void ConfigCache::markDirty(uint16_t entries) {
+  uint16_t pending = dirty & entries;
+  for (uint8_t i = 0; i < CFG_ENTRY_COUNT; i++) {
+    if ((pending >> i) & 1) stats[i].coalesced++;
+  }
+  if (dirty == 0) dirtySince = millis();
+  dirty |= entries;
+  generation++;
+}
+
+void ConfigCache::account(ConfigEntry entry, size_t bytes) {
+  ConfigWriteStats& entryStats = stats[__builtin_ctz(entry)];
+  entryStats.writes++;
+  entryStats.bytes += bytes;
+}
+
+void ConfigCache::flushDue(unsigned long now) {
+  if (dirty != 0 && now - dirtySince >= NVS_WRITE_BEHIND_MS) {
+    flush();
+  }
+}
+
+void ConfigCache::flush() {
+  flushWithin(portMAX_DELAY);
+}
+
+void ConfigCache::flushWithin(TickType_t wait) {
+  if (!lock(wait)) return;
+  uint16_t entries = dirty;
+  if (entries == 0) {
+    unlock();
+    return;
+  }
+  // Write from a copy so setters are only held off for the copy, not the flash write
+  ConfigValues snapshot = values;
+  dirty = 0;
+  unlock();
+
+  ConfigBlob blob;
+  pack(snapshot, blob);
+
+  // One putBytes: NVS writes the new blob before erasing the old, so a reset
+  // mid-write leaves the previous settings whole
+  Preferences prefs;
+  prefs.begin(PREF_NAMESPACE, false);
+  size_t bytes = prefs.putBytes(PREF_CONFIG_KEY, &blob, sizeof(blob));
+  prefs.end();
+  if (bytes != sizeof(blob)) {
+    Serial.println("Warning: config blob write failed, retrying on the next flush");
+    lock();
+    if (dirty == 0) dirtySince = millis();
+    dirty |= entries;
+    unlock();
+    return;
+  }
+
+  nvsWrites++;
+  nvsBytes += bytes;
+  for (uint8_t i = 0; i < CFG_ENTRY_COUNT; i++) {
+    if ((entries >> i) & 1) account((ConfigEntry)(1U << i), bytes);
+  }
+}
+
+void ConfigCache::shutdownFlush() {
+  // Bounded wait: the restarting task may be the one holding the cache
+  configCache.flushWithin(pdMS_TO_TICKS(CONFIG_SHUTDOWN_LOCK_MS));
+}
+
+void ConfigCache::setPHCalibration(int32_t ph7Microvolts, int32_t ph4Microvolts) {
+  lock();
+  if (values.ph7Microvolts != ph7Microvolts || values.ph4Microvolts != ph4Microvolts) {
+    values.ph7Microvolts = ph7Microvolts;
+    values.ph4Microvolts = ph4Microvolts;
+    markDirty(CFG_PH_CAL);
+  }
+  unlock();
+}
+
+void ConfigCache::setPHOffset(int32_t offsetMilli) {
+  lock();
+  if (values.phOffsetMilli != offsetMilli) {
+    values.phOffsetMilli = offsetMilli;
+    markDirty(CFG_PH_OFFSET);
+  }
+  unlock();
+}
+
+void ConfigCache::setPHMode(uint8_t mode) {
+  lock();
+  if (values.phMode != mode) {
+    values.phMode = mode;
+    markDirty(CFG_PH_MODE);
+  }
+  unlock();
+}
+
+void ConfigCache::setTempOffset(float offset) {
+  lock();
+  if (values.tempOffset != offset) {
+    values.tempOffset = offset;
+    markDirty(CFG_TEMP_OFFSET);
+  }
+  unlock();
+}
+
+void ConfigCache::setFishType(uint8_t type) {
+  lock();
+  if (values.fishType != type) {
+    values.fishType = type;
+    markDirty(CFG_FISH_TYPE);
+  }
+  unlock();
+}
+
+void ConfigCache::setCustomProfile(const String& name, float phMin, float phMax, float tempMin, float tempMax,
+                                   bool waterFlow, bool rain) {
+  FishProfile& custom = values.customProfile;
+  lock();
+  if (!values.useCustomProfile || custom.name != name || custom.phMin != phMin || custom.phMax != phMax ||
+      custom.tempMin != tempMin || custom.tempMax != tempMax || custom.waterFlow != waterFlow || custom.rain != rain) {
+    custom = { name, phMin, phMax, tempMin, tempMax, waterFlow, rain };
+    values.useCustomProfile = true;
+    markDirty(CFG_CUSTOM_PROFILE);
+  }
+  unlock();
+}
+
+void ConfigCache::setUseCustomProfile(bool use) {
+  lock();
+  if (values.useCustomProfile != use) {
+    values.useCustomProfile = use;
+    markDirty(CFG_CUSTOM_PROFILE);
+  }
+  unlock();
+}
+
+void ConfigCache::setManual(RelayId id, bool manual) {
+  lock();
+  uint8_t mask = manual ? (values.manualMask | relayBit(id)) : (values.manualMask & ~relayBit(id));
+  if (mask != values.manualMask) { // Repeated dashboard commands cost nothing
+    values.manualMask = mask;
+    markDirty(CFG_MANUAL);
+  }
+  unlock();
+}
+
+void ConfigCache::setDoseGains(int32_t acid, int32_t base) {
+  lock();
+  if (values.doseGainAcid != acid || values.doseGainBase != base) {
+    values.doseGainAcid = acid;
+    values.doseGainBase = base;
+    markDirty(CFG_DOSE_GAINS);
+  }
+  unlock();
+}
+
+void ConfigCache::setTankLitres(uint32_t litres) {
+  lock();
+  if (values.tankLitres != litres) {
+    values.tankLitres = litres;
+    markDirty(CFG_TANK);
+  }
+  unlock();
+}
+
+void ConfigCache::setTempMode(uint8_t mode) {
+  lock();
+  if (values.tempMode != mode) {
+    values.tempMode = mode;
+    markDirty(CFG_TEMP_MODE);
+  }
+  unlock();
+}
+
+void ConfigCache::setTempDeadband(int32_t milli) {
+  lock();
+  if (values.tempDeadband != milli) {
+    values.tempDeadband = milli;
+    markDirty(CFG_TEMP_DEADBAND);
+  }
+  unlock();
+}
+
+void ConfigCache::setThermal(const ThermalParams& params) {
+  lock();
+  if (!values.hasThermal || memcmp(&values.thermal, &params, sizeof(ThermalParams)) != 0) {
+    values.thermal = params;
+    values.hasThermal = true;
+    markDirty(CFG_THERMAL);
+  }
+  unlock();
+}
@@ -0,0 +1,151 @@
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config/config.h"
+#include "control/thermalModel.h"
+
+// Groups of NVS keys, one dirty bit each
+enum ConfigEntry : uint16_t {
+  CFG_PH_CAL         = 1U << 0,  // ph7_uv, ph4_uv
+  CFG_PH_OFFSET      = 1U << 1,
+  CFG_PH_MODE        = 1U << 2,
+  CFG_TEMP_OFFSET    = 1U << 3,
+  CFG_FISH_TYPE      = 1U << 4,
+  CFG_CUSTOM_PROFILE = 1U << 5,  // custom_* and use_custom_profile
+  CFG_MANUAL         = 1U << 6,  // manual_* override flags
+  CFG_DOSE_GAINS     = 1U << 7,
+  CFG_TANK           = 1U << 8,
+  CFG_TEMP_MODE      = 1U << 9,
+  CFG_TEMP_DEADBAND  = 1U << 10,
+  CFG_THERMAL        = 1U << 11
+};
+const uint8_t CFG_ENTRY_COUNT = 12;
+
+// Flash wear per entry since boot
+struct ConfigWriteStats {
+  uint32_t writes;     // Flushes this entry triggered
+  uint32_t bytes;      // Blob bytes those flushes wrote
+  uint32_t coalesced;  // Changes folded into a write that was already pending
+};
+
+// Every persisted setting, as loaded at boot and changed since
+struct ConfigValues {
+  int32_t ph7Microvolts;
+  int32_t ph4Microvolts;
+  int32_t phOffsetMilli;
+  uint8_t phMode;
+  float tempOffset;
+  uint8_t fishType;
+  bool useCustomProfile;
+  FishProfile customProfile;  // Built once here, so reads never touch NVS or the heap
+  uint8_t manualMask;         // relayBit() of relays under manual override
+  int32_t doseGainAcid;
+  int32_t doseGainBase;
+  uint32_t tankLitres;
+  uint8_t tempMode;
+  int32_t tempDeadband;
+  bool hasThermal;            // false until a thermal model has been saved
+  ThermalParams thermal;
+};
+
+// On-flash form of ConfigValues: one NVS blob, read in one call at boot and
+// replaced in one atomic write. A new field means a new CONFIG_BLOB_VERSION
+// and a case in ConfigCache::unpack() that fills it in for older blobs.
+struct __attribute__((packed)) ConfigBlob {
+  uint16_t magic;            // CONFIG_BLOB_MAGIC
+  uint8_t version;           // CONFIG_BLOB_VERSION
+  uint16_t size;             // sizeof(ConfigBlob) for this version
+  int32_t ph7Microvolts;
+  int32_t ph4Microvolts;
+  int32_t phOffsetMilli;
+  uint8_t phMode;
+  float tempOffset;
+  uint8_t fishType;
+  uint8_t useCustomProfile;
+  float customPhMin;
+  float customPhMax;
+  float customTempMin;
+  float customTempMax;
+  uint8_t customWaterFlow;
+  uint8_t customRain;
+  char customName[CONFIG_NAME_LEN];
+  uint8_t manualMask;
+  int32_t doseGainAcid;
+  int32_t doseGainBase;
+  uint32_t tankLitres;
+  uint8_t tempMode;
+  int32_t tempDeadband;
+  uint8_t hasThermal;
+  ThermalParams thermal;
+  uint32_t crc;              // CRC-32 of every byte above
+};
+
+// Loads the config blob once at boot and serves reads from RAM. Setters update RAM
+// and mark the entry dirty; the loop() flush job writes the blob once it has been dirty
+// for NVS_WRITE_BEHIND_MS, so a burst of changes costs one write and no request
+// handler waits on flash. Unchanged values are never marked. getGeneration() lets
+// control code notice a change with one integer compare. Setters run on the
+// control task or under ControlLock, like every other controller command.
+class ConfigCache {
+private:
+  ConfigValues values;
+  SemaphoreHandle_t mutex;        // values/dirty between setters and the flushing task
+  uint16_t dirty;
+  unsigned long dirtySince;       // millis() of the oldest unwritten change
+  uint32_t generation;
+  uint32_t nvsWrites;              // Blob writes
+  uint32_t nvsBytes;
+  ConfigWriteStats stats[CFG_ENTRY_COUNT];
+  bool migrated;                    // Loaded from the per-key layout of older firmware
+
+  bool lock(TickType_t wait = portMAX_DELAY);
+  void unlock();
+  void markDirty(uint16_t entries);
+  void account(ConfigEntry entry, size_t bytes);
+  bool loadBlob(Preferences& prefs);
+  void loadLegacy(Preferences& prefs);
+  void removeLegacy();
+  void pack(const ConfigValues& v, ConfigBlob& blob);
+  bool unpack(const ConfigBlob& blob);
+  static uint32_t crc32(const uint8_t* data, size_t len);
+  void flushWithin(TickType_t wait);
+  static void shutdownFlush();
+
+public:
+  ConfigCache();
+  void begin();                      // The only NVS read; registers the shutdown flush
+  void flush();                      // Writes the blob now if anything is dirty
+  void flushDue(unsigned long now);  // flush() once the oldest change is NVS_WRITE_BEHIND_MS old
+
+  const ConfigValues& get() { return values; }
+  const FishProfile& activeProfile(FishType type);
+  uint32_t getGeneration() { return generation; }
+  uint16_t getDirty() { return dirty; }
+  uint32_t getNvsWrites() { return nvsWrites; }
+  uint32_t getNvsBytes() { return nvsBytes; }
+  static const char* getEntryName(uint8_t index);
+  const ConfigWriteStats& getWriteStats(uint8_t index) { return stats[index < CFG_ENTRY_COUNT ? index : 0]; }
+
+  void setPHCalibration(int32_t ph7Microvolts, int32_t ph4Microvolts);
+  void setPHOffset(int32_t offsetMilli);
+  void setPHMode(uint8_t mode);
+  void setTempOffset(float offset);
+  void setFishType(uint8_t type);
+  void setCustomProfile(const String& name, float phMin, float phMax, float tempMin, float tempMax,
+                        bool waterFlow, bool rain); // Also switches the custom profile on
+  void setUseCustomProfile(bool use);
+  void setManual(RelayId id, bool manual);
+  void setDoseGains(int32_t acid, int32_t base);
+  void setTankLitres(uint32_t litres);
+  void setTempMode(uint8_t mode);
+  void setTempDeadband(int32_t milli);
+  void setThermal(const ThermalParams& params);
+};
+
+extern ConfigCache configCache;
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef FILTER_CONFIG_H
+#define FILTER_CONFIG_H
+
+#include "config/config.h"
+#include "sensors/filters.h"
+
+// ======================= PER-CHANNEL FILTER CHAINS =======================
+// Tune per tank here. Stages run left to right and are fully inlined;
+// thresholds are in milli-units (1000 = 1.0 pH / 1.0 °C).
+// Each chain's RAM cost is sizeof(chain) - no heap, no vtables.
+
+// Raw pH ADC samples (every sample from the DMA stream passes through this)
+typedef FilterChain<uint16_t,
+  MedianFilter<uint16_t, PH_ADC_MEDIAN_SAMPLES>
+> PHAdcFilter;
+
+// pH values in milli-pH after calibration math (one per read)
+typedef FilterChain<int32_t,
+  ClampFilter<int32_t, 0, 14000>,
+  MedianFilter<int32_t, PH_MEDIAN_SAMPLES>
+> PHValueFilter;
+
+// DS18B20 conversions (one per adaptive temperature interval).
+// Rejects single-sample glitches more than 5 °C from the last accepted value.
+// OutlierReject trusts its first sample, so the exact sentinel values are
+// dropped before the chain (see isTempSentinel) rather than left to it.
+typedef FilterChain<float,
+  OutlierReject<float, 5000, 2>,
+  MedianFilter<float, 3>
+> TempValueFilter;
+
+// 85 °C (probe reset, e.g. after a brown-out) and -127 °C (read failed) are
+// not measurements: the probe counts as invalid for that conversion
+inline bool isTempSentinel(float celsius) {
+  return celsius == TEMP_POWER_ON_C || celsius == TEMP_DISCONNECTED_C;
+}
+
+#endif
@@ -1,181 +1,205 @@
 #include "autoControl.h"
-#include "sensors/ph.h"
-#include "sensors/temp.h"
+#include "sensors/acquisition.h"
 #include "control/fan.h"
 #include "control/phControl.h"
+#include "control/relayBank.h"
+#include "control/dosingEngine.h"
+#include "control/tempControl.h"
+#include "control/relayRules.h"
+#include "control/scheduler.h"
 #include "config/config.h"
+#include "config/configCache.h"
 
-AutoControl::AutoControl(PHSensor* ph, TempSensor* temp, FanControl* fan, PHControl* phCtrl) {
-  phSensor = ph;
-  tempSensor = temp;
+AutoControl::AutoControl(SensorAcquisition* sensors, FanControl* fan, PHControl* phCtrl,
+                         RelayBank* relays, DosingEngine* dosing, TempControl* tempCtrl,
+                         RelayRules* rules, Scheduler* jobs) {
+  this->sensors = sensors;
+  this->relays = relays;
+  this->dosing = dosing;
+  this->rules = rules;
+  this->jobs = jobs;
+  verifyJob = profileJob = phJob = -1;
+  tempControl = tempCtrl;
+  fishSelected = false;
+  profileFlow = false;
+  profileRain = false;
+  manualMask = 0;
+  tempMinMilli = 0;
+  tempMaxMilli = 0;
   fanControl = fan;
   phControl = phCtrl;
-  lastTempCheck = 0;
-  lastPHCheck = 0;
+  lastPHSample = 0;
+  couldDose = false;
+  lastFishType = activeFishType;
+  lastConfigGeneration = 0;
+}
+
+void AutoControl::begin() {
+  // CRITICAL SAFETY: every relay output (GPIO23 included) must read back as commanded
+  verifyJob = jobs->addPeriodic("relay_verify", RELAY_VERIFY_INTERVAL,
+                                [](void* ctx) { static_cast<AutoControl*>(ctx)->relays->verify(); },
+                                this, RELAY_VERIFY_BUDGET_US);
+  // Profile and overrides live in RAM; re-read only when they change
+  profileJob = jobs->addOneShot("profile",
+                                [](void* ctx) { static_cast<AutoControl*>(ctx)->refreshProfile(); },
+                                this, PROFILE_JOB_BUDGET_US);
+  phJob = jobs->addPeriodic("ph_check", PH_CHECK_INTERVAL,
+                            [](void* ctx) { static_cast<AutoControl*>(ctx)->checkPH(); },
+                            this, PH_CHECK_BUDGET_US);
+  
+  lastFishType = activeFishType;
+  lastConfigGeneration = configCache.getGeneration();
+  refreshProfile();
+  tempControl->idle();
+  rules->invalidate();
+  applyRules(sensors->snapshot());
+  relays->apply();
+  Serial.printf("Relay rules: %u rules over mask 0x%02X, startup relays 0x%02X\n",
+                RELAY_RULE_COUNT, RELAY_RULE_MASK, relays->getMask());
 }
 
 void AutoControl::checkEmergency() {
-  float temp = tempSensor->read();
-  float ph = phSensor->read();
+  const SensorSnapshot& snap = sensors->snapshot();
   
-  // Emergency: Temperature too high
-  if (temp > TEMP_MAX_SAFE) {
+  // Emergency: Temperature too high at any probe
+  if (snap.tempValid && snap.tempMax > TEMP_MAX_SAFE) {
     fanControl->emergencyOn();
-    digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
+    relays->setNow(REL_WATER_HEATER, false);
   }
   
   // Emergency: pH extremely dangerous (only stop if < 1.0 or > 13.0)
-  if (ph < 1.0 || ph > 13.0) {
+  if (snap.phValid && (snap.phMilli < 1000 || snap.phMilli > 13000)) {
     phControl->stopAll();
   }
 }
 
-void AutoControl::checkTemperature() {
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  bool useCustom = prefs.getBool("use_custom_profile", false);
-  prefs.end();
-  
-  if (activeFishType == FISH_NONE && !useCustom) {
-    fanControl->set(false, false);
-    digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
-    // Air pump OFF when no fish selected
-    digitalWrite(REL_AIR_PUMP, getRelayLevel(false));
-    // Water flow and rain OFF when no fish selected
-    digitalWrite(REL_WATER_FLOW, getRelayLevel(false));
-    digitalWrite(REL_RAIN_PUMP, getRelayLevel(false));
-    return;
-  }
+void AutoControl::refreshProfile() {
+  const ConfigValues& cfg = configCache.get();
   
-  // Get active fish profile to check water flow and rain settings
-  FishProfile profile = getActiveFishProfile();
+  // Relays the dashboard switched by hand are left out of the rule table
+  manualMask = cfg.manualMask;
   
-  // Check for manual overrides
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  bool manualAirPump = prefs.getBool("manual_air_pump", false);
-  bool manualWaterFlow = prefs.getBool("manual_water_flow", false);
-  bool manualRainPump = prefs.getBool("manual_rain_pump", false);
-  bool manualWaterHeater = prefs.getBool("manual_water_heater", false);
-  bool manualLightControl = prefs.getBool("manual_light_control", false);
-  prefs.end();
-  
-  // Air pump ON when any fish is selected (unless manually overridden)
-  if (!manualAirPump) {
-    digitalWrite(REL_AIR_PUMP, getRelayLevel(true));
+  fishSelected = activeFishType != FISH_NONE || cfg.useCustomProfile;
+  if (!fishSelected) {
+    profileFlow = false;
+    profileRain = false;
+    return;
   }
   
-  // Control water flow relay based on fish profile (unless manually overridden)
-  if (!manualWaterFlow) {
-    if (profile.waterFlow) {
-      digitalWrite(REL_WATER_FLOW, getRelayLevel(true)); // ON
-    } else {
-      digitalWrite(REL_WATER_FLOW, getRelayLevel(false)); // OFF
-    }
+  const FishProfile& profile = getActiveFishProfile();
+  profileFlow = profile.waterFlow;
+  profileRain = profile.rain;
+  tempMinMilli = toMilli(profile.tempMin);
+  tempMaxMilli = toMilli(profile.tempMax);
+}
+
+void AutoControl::checkThermal(const SensorSnapshot& snap, unsigned long now) {
+  if (fishSelected && snap.tempValid) {
+    tempControl->update(toMilli(snap.temperature), snap.tempTimestamp, tempMinMilli, tempMaxMilli, now);
+  } else {
+    tempControl->idle();
   }
-  
-  // Control rain relay based on fish profile (unless manually overridden)
-  if (!manualRainPump) {
-    if (profile.rain) {
-      digitalWrite(REL_RAIN_PUMP, getRelayLevel(true)); // ON
-    } else {
-      digitalWrite(REL_RAIN_PUMP, getRelayLevel(false)); // OFF
+}
+
+void AutoControl::applyRules(const SensorSnapshot& snap) {
+  RuleInputs in;
+  in.conditions = 0;
+  if (fishSelected) in.conditions |= COND_FISH_SELECTED;
+  if (snap.tempValid) in.conditions |= COND_TEMP_VALID;
+  if (snap.tempValid && snap.tempMax > TEMP_MAX_SAFE) in.conditions |= COND_OVER_TEMP;
+  if (tempControl->getHeatDemand()) in.conditions |= COND_HEAT_DEMAND;
+  if (tempControl->getFanDemand()) in.conditions |= COND_COOL_DEMAND;
+  if (profileFlow) in.conditions |= COND_PROFILE_FLOW;
+  if (profileRain) in.conditions |= COND_PROFILE_RAIN;
+  in.manualMask = manualMask | (fanControl->isManual() ? relayBit(REL_COOLER_FAN) : 0);
+  
+  bool heaterWas = relays->get(REL_WATER_HEATER);
+  bool fanWas = fanControl->getState();
+  uint8_t target = rules->getTarget();
+  
+  if (rules->update(in)) {
+    target = rules->getTarget();
+    // The fan goes through FanControl below for its toggle limit
+    uint8_t drive = rules->getDriveMask() & ~relayBit(REL_COOLER_FAN);
+    for (uint8_t ch = 0; ch < RELAY_COUNT; ch++) {
+      if ((drive >> ch) & 1) {
+        relays->set(RELAY_MAP[ch].id, (target >> ch) & 1);
+      }
     }
   }
   
-  // Light control: Always ON (unless manually overridden)
-  if (!manualLightControl) {
-    digitalWrite(REL_LIGHT_CTRL, LOW); // Always ON for active-low
+  // Retried every tick until FAN_MIN_TOGGLE_INTERVAL allows it
+  bool fanWanted = target & relayBit(REL_COOLER_FAN);
+  if (!fanControl->isManual() && fanWanted != fanControl->getState() && fanControl->canToggle()) {
+    fanControl->set(fanWanted, false);
   }
   
-  float temp = tempSensor->read();
-  bool fanManual = fanControl->isManual();
-  
-  if (temp > profile.tempMax) {
-    if (!fanManual) {
-      fanControl->set(true, false);
-    }
-    // Only control water heater if not manually overridden
-    if (!manualWaterHeater) {
-      digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
-    }
-  } else if (temp < profile.tempMin) {
-    // Only control water heater if not manually overridden
-    if (!manualWaterHeater) {
-      digitalWrite(REL_WATER_HEATER, getRelayLevel(true));
-    }
-    if (!fanManual) {
-      fanControl->set(false, false);
-    }
-  } else {
-    if (!fanManual) {
-      fanControl->set(false, false);
-    }
-    digitalWrite(REL_WATER_HEATER, getRelayLevel(false));
+  // Heater/fan just switched: sample temperature fast to follow the transient
+  if (relays->get(REL_WATER_HEATER) != heaterWas || fanControl->getState() != fanWas) {
+    sensors->expectTempChange();
   }
 }
 
 void AutoControl::checkPH() {
-  // CRITICAL: Always ensure base pump is OFF first (safety check)
-  // This prevents any accidental activation
-  if (!phControl->getBaseState()) {
-    // Base pump should be OFF - double check by forcing it OFF
-    // This is a safety measure to prevent GPIO23 from accidentally going LOW
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
-  }
-  
   // Check if fish is selected
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  bool useCustom = prefs.getBool("use_custom_profile", false);
-  prefs.end();
-  
-  if (activeFishType == FISH_NONE && !useCustom) {
+  if (activeFishType == FISH_NONE && !configCache.get().useCustomProfile) {
     phControl->setAcid(false);
     phControl->setBase(false);
-    // Extra safety: Force GPIO23 HIGH
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
+    dosing->cancelPending();
     return;
   }
   
   // Check cooldown - CRITICAL: This must pass before any pump activation
   if (!phControl->canDose()) {
-    // In cooldown - ensure pumps are OFF
-    phControl->setAcid(false);
-    phControl->setBase(false);
-    // Extra safety: Force GPIO23 HIGH during cooldown
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
+    // A running dose ends at its own deadline; in cooldown, ensure pumps are OFF
+    if (!phControl->isDosing()) {
+      phControl->setAcid(false);
+      phControl->setBase(false);
+    }
     return;
   }
   
   // Read pH and get profile
-  float ph = phSensor->read();
-  FishProfile profile = getActiveFishProfile();
+  const SensorSnapshot& snap = sensors->snapshot();
+  if (!snap.phValid) {
+    return;
+  }
+  int32_t ph = snap.phMilli;
+  
+  // canDose() only after the post-dose cooldown ended: the last engine dose has
+  // mixed in (or DOSE_COOLDOWN_MAX passed), learn from its response
+  if (dosing->hasPendingDose()) {
+    dosing->doseSettled(ph, phControl->getLastDoseUs(), phControl->getDoseCount());
+  }
   
-  // pH Control Logic:
-  // pH > max → Run ACID pump (reduce pH)
-  // pH < min → Run ALKALINE pump (increase pH)
+  const FishProfile& profile = getActiveFishProfile();
+  int32_t phMin = toMilli(profile.phMin);
+  int32_t phMax = toMilli(profile.phMax);
+  int32_t phTarget = (phMin + phMax) / 2;
+  
+  // pH Control Logic (proportional):
+  // pH > max → ACID dose sized to bring pH back toward mid-range
+  // pH < min → ALKALINE dose sized the same way
   // pH in range → Both pumps OFF
   
-  if (ph > profile.phMax) {
-    phControl->setBase(false);
-    phControl->setAcid(true);
-    // Ensure GPIO23 is HIGH when base pump should be OFF
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
-  } else if (ph < profile.phMin) {
-    phControl->setAcid(false);
-    // Only activate base pump if pH is really low AND cooldown passed
-    if (phControl->canDose()) {
-      phControl->setBase(true);
-    } else {
-      phControl->setBase(false);
-      digitalWrite(REL_ALKALI_PUMP, HIGH);
-    }
-  } else {
+  DosePump pump = DOSE_NONE;
+  if (ph > phMax) {
+    pump = DOSE_ACID;
+  } else if (ph < phMin) {
+    pump = DOSE_BASE;
+  }
+  
+  if (pump == DOSE_NONE) {
     phControl->setAcid(false);
     phControl->setBase(false);
-    // Extra safety: Force GPIO23 HIGH when pH is in range
-    digitalWrite(REL_ALKALI_PUMP, HIGH);
+    return;
+  }
+  
+  unsigned long durationMs = dosing->planDose(pump, pump == DOSE_ACID ? ph - phTarget : phTarget - ph);
+  uint32_t doseSeq = phControl->getDoseCount() + 1;
+  if (phControl->dose(pump, durationMs)) {
+    dosing->doseStarted(pump, ph, doseSeq);
+    sensors->expectPHChange(); // Follow the dose response closely
   }
 }
 
@@ -185,19 +209,38 @@ void AutoControl::update() {
   // Check emergency conditions first
   checkEmergency();
   
-  // Update control timers
+  const SensorSnapshot& snap = sensors->snapshot();
+  
+  // Feed each new pH sample to the cooldown settle detector
+  if (snap.phValid && snap.phTimestamp != lastPHSample) {
+    lastPHSample = snap.phTimestamp;
+    phControl->observePH(snap.phMilli, snap.phTimestamp);
+  }
+  
+  // Dose deadline backstop, cooldown and fan override expiry: every tick
   phControl->update();
   fanControl->update();
   
-  // Check temperature every 5 seconds
-  if (now - lastTempCheck >= TEMP_CHECK_INTERVAL) {
-    checkTemperature();
-    lastTempCheck = now;
+  // New species or settings: re-read the profile now (switches air pump / water flow / rain this tick)
+  uint32_t generation = configCache.getGeneration();
+  if (activeFishType != lastFishType || generation != lastConfigGeneration) {
+    lastFishType = activeFishType;
+    lastConfigGeneration = generation;
+    jobs->trigger(profileJob);
   }
-  
-  // Check pH every 1 minute
-  if (now - lastPHCheck >= PH_CHECK_INTERVAL) {
-    checkPH();
-    lastPHCheck = now;
+  // Post-dose cooldown just settled: next pH check now rather than up to a minute later
+  bool canDose = phControl->canDose();
+  if (canDose && !couldDose) {
+    jobs->trigger(phJob);
   }
+  couldDose = canDose;
+  
+  // Relay verify, profile refresh, pH check - whichever are due
+  jobs->runDue();
+  
+  // Heater and fan demand: deadband / PID every tick, so PWM windows and hysteresis edges are on time
+  checkThermal(snap, now);
+  
+  // Relay policy: re-evaluated only when one of its inputs changed
+  applyRules(snap);
 }
@@ -5,30 +5,54 @@
 #include "config/config.h"
 
 // Forward declarations
-class PHSensor;
-class TempSensor;
+class SensorAcquisition;
 class FanControl;
 class PHControl;
+class RelayBank;
+class DosingEngine;
+class TempControl;
+class RelayRules;
+class Scheduler;
+struct SensorSnapshot;
 
 class AutoControl {
 private:
-  PHSensor* phSensor;
-  TempSensor* tempSensor;
+  SensorAcquisition* sensors;
   FanControl* fanControl;
   PHControl* phControl;
+  RelayBank* relays;
+  DosingEngine* dosing;
+  TempControl* tempControl;
+  RelayRules* rules;
+  Scheduler* jobs;                // Control-task scheduler, ticked from update()
+  int8_t verifyJob;
+  int8_t profileJob;
+  int8_t phJob;
   
-  unsigned long lastTempCheck;
-  unsigned long lastPHCheck;
-  const unsigned long TEMP_CHECK_INTERVAL = 5000; // 5 seconds
-  const unsigned long PH_CHECK_INTERVAL = 1UL * 60UL * 1000UL;  // 1 minute (60000ms)
+  // Refreshed by refreshProfile() from configCache; rules and TempControl run on them every tick
+  bool fishSelected;              // A fish (or custom profile) is selected
+  bool profileFlow;
+  bool profileRain;
+  uint8_t manualMask;             // relayBit() of relays the dashboard took over
+  int32_t tempMinMilli;
+  int32_t tempMaxMilli;
+  
+  unsigned long lastPHSample;     // phTimestamp last handed to PHControl::observePH()
+  bool couldDose;                 // canDose() on the previous tick
+  FishType lastFishType;
+  uint32_t lastConfigGeneration;  // configCache generation the profile was last read at
   
   void checkEmergency();
-  void checkTemperature();
+  void refreshProfile();
+  void checkThermal(const SensorSnapshot& snap, unsigned long now);
+  void applyRules(const SensorSnapshot& snap);
   void checkPH();
   
 public:
-  AutoControl(PHSensor* ph, TempSensor* temp, FanControl* fan, PHControl* phCtrl);
-  void update();
+  AutoControl(SensorAcquisition* sensors, FanControl* fan, PHControl* phCtrl, RelayBank* relays,
+              DosingEngine* dosing, TempControl* tempCtrl, RelayRules* rules, Scheduler* jobs);
+  void begin();  // Registers the control jobs, settles the startup relay state from the rule table
+  void update(); // Runs on the control task
 };
 
 #endif
@@ -0,0 +1,94 @@
+
+#include "controlTask.h"
+#include "sensors/acquisition.h"
+#include "control/autoControl.h"
+#include "control/relayBank.h"
+#include "config/config.h"
+
+ControlTask::ControlTask(SensorAcquisition* sensors, AutoControl* autoCtrl, RelayBank* relays) :
+  sensors(sensors), autoControl(autoCtrl), relays(relays), handle(nullptr), mutex(nullptr) {
+  statsMux = portMUX_INITIALIZER_UNLOCKED;
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool ControlTask::begin() {
+  if (handle != nullptr) return true;
+
+  mutex = xSemaphoreCreateMutex();
+  if (mutex == nullptr) {
+    Serial.println("Control task: mutex creation failed");
+    return false;
+  }
+
+  if (xTaskCreatePinnedToCore(taskMain, "control", CONTROL_TASK_STACK, this,
+                              CONTROL_TASK_PRIORITY, &handle, CONTROL_TASK_CORE) != pdPASS) {
+    Serial.println("Control task: creation failed");
+    handle = nullptr;
+    return false;
+  }
+
+  Serial.printf("Control task started on core %d: %lu ms period, priority %lu\n",
+                CONTROL_TASK_CORE, CONTROL_TASK_PERIOD_MS, CONTROL_TASK_PRIORITY);
+  return true;
+}
+
+void ControlTask::lock() {
+  // Before begin() everything runs in setup(), so there is nothing to exclude
+  if (mutex != nullptr) xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void ControlTask::unlock() {
+  if (mutex != nullptr) xSemaphoreGive(mutex);
+}
+
+ControlTaskStats ControlTask::getStats() {
+  portENTER_CRITICAL(&statsMux);
+  ControlTaskStats copy = stats;
+  portEXIT_CRITICAL(&statsMux);
+  return copy;
+}
+
+void ControlTask::taskMain(void* arg) {
+  static_cast<ControlTask*>(arg)->run();
+}
+
+void ControlTask::run() {
+  const TickType_t period = pdMS_TO_TICKS(CONTROL_TASK_PERIOD_MS);
+  const uint32_t periodUs = CONTROL_TASK_PERIOD_MS * 1000UL;
+
+  // Align to a tick edge so the micros() release times line up with the scheduler
+  vTaskDelay(1);
+  TickType_t lastWake = xTaskGetTickCount();
+  uint32_t releaseUs = micros();
+  uint32_t prevWakeUs = releaseUs;
+
+  for (;;) {
+    // pdFALSE means the release time had already passed: the previous tick overran
+    bool onTime = xTaskDelayUntil(&lastWake, period) == pdTRUE;
+    uint32_t wakeUs = micros();
+    releaseUs += periodUs;
+
+    lock();
+    sensors->update();
+    autoControl->update();
+    relays->apply(); // Also flushes web commands queued since the last tick
+    unlock();
+
+    uint32_t execUs = micros() - wakeUs;
+    int32_t late = (int32_t)(wakeUs - releaseUs);
+    uint32_t latenessUs = late > 0 ? (uint32_t)late : 0;
+    int32_t jitter = (int32_t)(wakeUs - prevWakeUs - periodUs);
+    uint32_t jitterUs = jitter < 0 ? (uint32_t)(-jitter) : (uint32_t)jitter;
+    prevWakeUs = wakeUs;
+
+    portENTER_CRITICAL(&statsMux);
+    stats.cycles++;
+    if (!onTime) stats.overruns++;
+    stats.lastLatenessUs = latenessUs;
+    if (latenessUs > stats.maxLatenessUs) stats.maxLatenessUs = latenessUs;
+    if (jitterUs > stats.maxJitterUs) stats.maxJitterUs = jitterUs;
+    stats.lastExecUs = execUs;
+    if (execUs > stats.maxExecUs) stats.maxExecUs = execUs;
+    portEXIT_CRITICAL(&statsMux);
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef CONTROL_TASK_H
+#define CONTROL_TASK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "config/config.h"
+
+// Forward declarations
+class SensorAcquisition;
+class AutoControl;
+class RelayBank;
+
+// Timing health of the control loop, all in microseconds
+struct ControlTaskStats {
+  uint32_t cycles;
+  uint32_t overruns;        // Ticks that started after the next release was already due
+  uint32_t lastLatenessUs;  // Wake-up delay behind the scheduled release time
+  uint32_t maxLatenessUs;
+  uint32_t maxJitterUs;     // Worst |wake-to-wake period - nominal period|
+  uint32_t lastExecUs;      // Time spent in acquisition + control for one tick
+  uint32_t maxExecUs;
+};
+
+// Runs sensor acquisition and AutoControl (which drives PHControl/FanControl)
+// at a fixed period on its own core, independent of web and LCD work in loop().
+// Relay changes made during a tick reach the pins in one RelayBank::apply() at its end.
+class ControlTask {
+private:
+  SensorAcquisition* sensors;
+  AutoControl* autoControl;
+  RelayBank* relays;
+  TaskHandle_t handle;
+  SemaphoreHandle_t mutex;  // Held for every tick and every command from other tasks
+  portMUX_TYPE statsMux;
+  ControlTaskStats stats;
+
+  static void taskMain(void* arg);
+  void run();
+
+public:
+  ControlTask(SensorAcquisition* sensors, AutoControl* autoCtrl, RelayBank* relays);
+  bool begin();
+  bool isRunning() { return handle != nullptr; }
+
+  // Other tasks take this before touching controllers, relays or sensors
+  void lock();
+  void unlock();
+
+  ControlTaskStats getStats();
+};
+
+// Scoped ControlTask::lock() for web handlers
+class ControlLock {
+private:
+  ControlTask* task;
+public:
+  explicit ControlLock(ControlTask* task) : task(task) { task->lock(); }
+  ~ControlLock() { task->unlock(); }
+};
+
+#endif
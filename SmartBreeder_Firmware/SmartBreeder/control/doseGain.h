@@ -0,0 +1,48 @@
+#ifndef DOSE_GAIN_H
+#define DOSE_GAIN_H
+
+#include <stdint.h>
+#include "config/config.h"
+
+// Pump gain arithmetic behind DosingEngine, kept free of NVS and pumps so the
+// learning loop can be replayed on the host. Gain unit: milli-pH * litre per
+// second of pump (see DOSE_GAIN_DEFAULT).
+
+inline int32_t clampDoseGain(int64_t gain) {
+  if (gain < DOSE_GAIN_MIN) return DOSE_GAIN_MIN;
+  if (gain > DOSE_GAIN_MAX) return DOSE_GAIN_MAX;
+  return (int32_t)gain;
+}
+
+// on-time (ms) = error * target share * volume / gain, within the pump limits
+inline unsigned long doseOnTimeMs(int32_t errorMilli, uint32_t litres, int32_t gain) {
+  int64_t ms = (int64_t)errorMilli * DOSE_TARGET_PCT * litres * 1000 / (100LL * gain);
+  if (ms < (int64_t)PUMP_MIN_DOSE_MS) ms = PUMP_MIN_DOSE_MS;
+  if (ms > (int64_t)PUMP_MAX_DURATION) ms = PUMP_MAX_DURATION;
+  return (unsigned long)ms;
+}
+
+// milli-pH a dose of onTimeUs moves a tank of litres by, at gain
+inline int32_t doseResponse(int32_t gain, uint32_t litres, uint32_t onTimeUs) {
+  return (int32_t)((int64_t)gain * onTimeUs / (litres * 1000000LL));
+}
+
+// Gain a settled response implies, or 0 if it says nothing. A sub-floor response
+// is only noise when the gain predicted little too; after a dose the gain expected
+// to clear DOSE_EXPECTED_RESPONSE it means the gain is too high, and it counts as
+// a low gain (a stalled or wrong-way move clamps to DOSE_GAIN_MIN).
+inline int32_t observedDoseGain(int32_t gain, int32_t observedMilli, uint32_t litres, uint32_t onTimeUs) {
+  if (onTimeUs == 0) return 0;
+  if (observedMilli < DOSE_MIN_RESPONSE) {
+    if (doseResponse(gain, litres, onTimeUs) < DOSE_EXPECTED_RESPONSE) return 0;
+    if (observedMilli < 0) observedMilli = 0;
+  }
+  return clampDoseGain((int64_t)observedMilli * litres * 1000000LL / onTimeUs);
+}
+
+// One learning step of the per-pump gain towards a measured one
+inline int32_t learnDoseGain(int32_t gain, int32_t measured) {
+  return clampDoseGain(gain + (int64_t)(measured - gain) * DOSE_LEARN_RATE_PCT / 100);
+}
+
+#endif
@@ -0,0 +1,83 @@
+
+#include "dosingEngine.h"
+#include "config/config.h"
+#include "config/configCache.h"
+
+DosingEngine::DosingEngine() :
+  gainAcid(DOSE_GAIN_DEFAULT), gainBase(DOSE_GAIN_DEFAULT), tankLitres(TANK_VOLUME_DEFAULT_L),
+  pendingPump(DOSE_NONE), pendingStartMilli(0), pendingDoseSeq(0),
+  lastPlannedMs(0), lastObservedGain(0), learnCount(0) {}
+
+void DosingEngine::begin() {
+  load();
+  Serial.printf("Dosing engine: %lu L tank, gain acid %ld / base %ld mpH*L/s\n",
+                tankLitres, gainAcid, gainBase);
+}
+
+void DosingEngine::load() {
+  const ConfigValues& cfg = configCache.get();
+  gainAcid = clampDoseGain(cfg.doseGainAcid);
+  gainBase = clampDoseGain(cfg.doseGainBase);
+  tankLitres = cfg.tankLitres;
+
+  if (tankLitres < TANK_VOLUME_MIN_L || tankLitres > TANK_VOLUME_MAX_L) {
+    tankLitres = TANK_VOLUME_DEFAULT_L;
+  }
+}
+
+void DosingEngine::saveGains() {
+  configCache.setDoseGains(gainAcid, gainBase);
+}
+
+bool DosingEngine::setTankLitres(uint32_t litres) {
+  if (litres < TANK_VOLUME_MIN_L || litres > TANK_VOLUME_MAX_L) {
+    return false;
+  }
+  tankLitres = litres;
+
+  configCache.setTankLitres(tankLitres);
+  Serial.printf("Tank volume set to %lu L\n", tankLitres);
+  return true;
+}
+
+unsigned long DosingEngine::planDose(DosePump pump, int32_t errorMilli) {
+  if (pump == DOSE_NONE || errorMilli <= 0) return 0;
+
+  lastPlannedMs = doseOnTimeMs(errorMilli, tankLitres, gainFor(pump));
+  return lastPlannedMs;
+}
+
+void DosingEngine::doseStarted(DosePump pump, int32_t phMilli, uint32_t doseSeq) {
+  pendingPump = pump;
+  pendingStartMilli = phMilli;
+  pendingDoseSeq = doseSeq;
+}
+
+void DosingEngine::doseSettled(int32_t phMilli, uint32_t onTimeUs, uint32_t doseSeq) {
+  DosePump pump = pendingPump;
+  pendingPump = DOSE_NONE;
+  if (pump == DOSE_NONE || onTimeUs == 0) return;
+  if (doseSeq != pendingDoseSeq) {
+    Serial.println("Another dose ran before settling - dose response not learned");
+    return;
+  }
+
+  // Acid lowers pH, base raises it: observed is positive when the dose worked
+  int32_t observed = pump == DOSE_ACID ? pendingStartMilli - phMilli : phMilli - pendingStartMilli;
+  int32_t& gain = gainFor(pump);
+  int32_t measured = observedDoseGain(gain, observed, tankLitres, onTimeUs);
+  if (measured == 0) {
+    // Within probe noise, and the gain didn't predict more: nothing trustworthy to learn from
+    Serial.printf("Dose response %ld mpH below noise floor - gain unchanged\n", observed);
+    return;
+  }
+
+  gain = learnDoseGain(gain, measured);
+  lastObservedGain = measured;
+  learnCount++;
+  saveGains();
+
+  Serial.printf("%s dose moved pH %ld mpH in %lu ms: measured gain %ld, learned %ld\n",
+                pump == DOSE_ACID ? "Acid" : "Base", observed,
+                (unsigned long)(onTimeUs / 1000), measured, gain);
+}
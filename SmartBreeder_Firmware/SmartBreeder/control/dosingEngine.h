@@ -0,0 +1,53 @@
+#ifndef DOSING_ENGINE_H
+#define DOSING_ENGINE_H
+
+#include <Arduino.h>
+#include "config/config.h"
+#include "control/phControl.h"
+#include "control/doseGain.h"
+
+// Sizes each pH correction from the error, the tank volume and a per-pump gain
+// (milli-pH * litre per second of pump). The gain is re-estimated after every
+// dose from the pH change actually observed once the tank has settled.
+class DosingEngine {
+private:
+  int32_t gainAcid;
+  int32_t gainBase;
+  uint32_t tankLitres;
+
+  // Dose waiting for its settled response
+  DosePump pendingPump;
+  int32_t pendingStartMilli;
+  uint32_t pendingDoseSeq;     // PHControl dose count once this dose has ended
+
+  unsigned long lastPlannedMs;
+  int32_t lastObservedGain;   // 0 until the first dose has been learned from
+  uint32_t learnCount;
+
+  int32_t& gainFor(DosePump pump) { return pump == DOSE_ACID ? gainAcid : gainBase; }
+  void load();
+  void saveGains();
+
+public:
+  DosingEngine();
+  void begin();
+
+  // errorMilli: distance still to correct (always positive, pump picks the direction)
+  unsigned long planDose(DosePump pump, int32_t errorMilli);
+  // doseSeq: PHControl::getDoseCount() the pump will report once this dose ends
+  void doseStarted(DosePump pump, int32_t phMilli, uint32_t doseSeq);
+  bool hasPendingDose() { return pendingPump != DOSE_NONE; }
+  // phMilli: settled reading; onTimeUs: measured pump on-time from PHControl.
+  // A different doseSeq means a manual dose intervened and the sample is dropped.
+  void doseSettled(int32_t phMilli, uint32_t onTimeUs, uint32_t doseSeq);
+  void cancelPending() { pendingPump = DOSE_NONE; }
+
+  bool setTankLitres(uint32_t litres);
+  uint32_t getTankLitres() { return tankLitres; }
+  int32_t getGain(DosePump pump) { return gainFor(pump); }
+  unsigned long getLastPlannedMs() { return lastPlannedMs; }
+  int32_t getLastObservedGain() { return lastObservedGain; }
+  uint32_t getLearnCount() { return learnCount; }
+};
+
+#endif
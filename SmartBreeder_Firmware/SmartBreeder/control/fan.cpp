@@ -1,12 +1,13 @@
 #include "fan.h"
+#include "control/relayBank.h"
 #include "config/config.h"
 
-FanControl::FanControl(int pin) : pin(pin), state(false), manualOverride(false),
-                                    lastToggleTime(0), overrideTime(0) {}
+FanControl::FanControl(RelayBank* relays, RelayId relay) :
+  relays(relays), relay(relay), state(false), manualOverride(false),
+  lastToggleTime(0), overrideTime(0) {}
 
 void FanControl::begin() {
-  pinMode(pin, OUTPUT);
-  digitalWrite(pin, getRelayLevel(false));
+  relays->set(relay, false);
   Serial.println("Fan control initialized");
 }
 
@@ -20,7 +21,7 @@ void FanControl::set(bool on, bool manual) {
   }
   
   state = on;
-  digitalWrite(pin, getRelayLevel(on));
+  relays->set(relay, on);
   lastToggleTime = now;
   
   if (manual) {
@@ -45,7 +46,7 @@ void FanControl::update() {
 void FanControl::emergencyOn() {
   state = true;
   manualOverride = false; // Emergency overrides manual
-  digitalWrite(pin, getRelayLevel(true));
+  relays->setNow(relay, true); // Don't wait for the end of the control tick
   Serial.println("FAN EMERGENCY ON");
 }
 
@@ -4,9 +4,12 @@
 #include <Arduino.h>
 #include "config/config.h"
 
+class RelayBank;
+
 class FanControl {
 private:
-  int pin;
+  RelayBank* relays;
+  RelayId relay;
   bool state;
   bool manualOverride;
   unsigned long lastToggleTime;
@@ -14,11 +17,12 @@ private:
   const unsigned long MANUAL_OVERRIDE_TIMEOUT = 30000; // 30 seconds
   
 public:
-  FanControl(int pin);
+  FanControl(RelayBank* relays, RelayId relay);
   void begin();
   void set(bool on, bool manual = false);
   bool getState() { return state; }
   bool isManual() { return manualOverride; }
+  bool canToggle() { return millis() - lastToggleTime >= FAN_MIN_TOGGLE_INTERVAL; }
   void update(); // Check for expired overrides
   void emergencyOn(); // Force ON for emergency
 };
@@ -1,144 +1,272 @@
 #include "phControl.h"
+#include "control/relayBank.h"
 #include "config/config.h"
 
-PHControl::PHControl(int acidPin, int basePin) : 
-  acidPin(acidPin), basePin(basePin), 
+// Pump relays are initialized OFF by the RelayBank constructor, before setup()
+PHControl::PHControl(RelayBank* relays) :
+  relays(relays),
   acidState(false), baseState(false),
-  pumpStartTime(0), cooldownStartTime(0), inCooldown(true) {
-  // CRITICAL: Initialize pins IMMEDIATELY in constructor (runs before setup())
-  // This prevents relay activation during boot phase
-  // For Active-Low relays: HIGH = OFF, LOW = ON
-  pinMode(basePin, OUTPUT);
-  digitalWrite(basePin, HIGH); // Set to OFF immediately
-  pinMode(acidPin, OUTPUT);
-  digitalWrite(acidPin, HIGH); // Set to OFF immediately
+  pumpStartTime(0), doseDurationMs(PUMP_MAX_DURATION), cooldownStartTime(0), inCooldown(true),
+  settlingAfterDose(false), settleAnchored(false), settleAnchorMilli(0), settleAnchorTime(0),
+  lastSettleMs(0), learnedSettleMs(DOSE_SETTLE_INITIAL), settleTimeouts(0),
+  doseTimer(nullptr), activePump(DOSE_NONE), doseStartUs(0), doseEndUs(0), doseDeadlineUs(0), doseGen(0), doseEnded(false),
+  lastDoseUs(0), lastDosePump(DOSE_NONE), doseCount(0) {
+  doseMux = portMUX_INITIALIZER_UNLOCKED;
 }
 
 void PHControl::begin() {
-  // Note: Pins may already be initialized in setup(), but we ensure they're set correctly here
-  pinMode(acidPin, OUTPUT);
-  pinMode(basePin, OUTPUT);
-  
-  // CRITICAL: For Active-Low relays, explicitly set to HIGH (OFF) to prevent activation
-  // Set multiple times to ensure stable state
-  digitalWrite(acidPin, HIGH); // Explicit HIGH for Active-Low (OFF state)
-  digitalWrite(basePin, HIGH);  // Explicit HIGH for Active-Low (OFF state)
-  delay(10);
-  digitalWrite(acidPin, HIGH); // Set again to ensure stability
-  digitalWrite(basePin, HIGH);
-  
-  // Also use getRelayLevel for consistency
-  digitalWrite(acidPin, getRelayLevel(false));
-  digitalWrite(basePin, getRelayLevel(false));
-  
-  // Start with cooldown active - prevents immediate activation
-  cooldownStartTime = millis();
-  inCooldown = true;
+  // CRITICAL: both pumps OFF before anything else can run
+  relays->set(REL_ACID_PUMP, false);
+  relays->setNow(REL_ALKALI_PUMP, false);
+  
+  // Start with cooldown active - prevents immediate activation until pH is steady
+  startCooldown(millis(), false);
+  
+  if (doseTimer == nullptr) {
+    esp_timer_create_args_t args = {};
+    args.callback = &PHControl::onDoseTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "ph_dose";
+    if (esp_timer_create(&args, &doseTimer) != ESP_OK) {
+      doseTimer = nullptr;
+      Serial.println("WARNING: Dose timer creation failed - falling back to update() polling");
+    }
+  }
+}
+
+void PHControl::onDoseTimer(void* arg) {
+  // esp_timer task context: switch off and record, logging happens in update().
+  // The timer never fires early, so a dose not yet due was started after it fired.
+  static_cast<PHControl*>(arg)->endDose(DOSE_NONE, true);
+}
+
+void PHControl::startDose(DosePump pump, unsigned long durationMs) {
+  // Pumps bypass the per-tick batch: the measured on-time must match the relay
+  portENTER_CRITICAL(&doseMux);
+  relays->setNow(pump == DOSE_ACID ? REL_ACID_PUMP : REL_ALKALI_PUMP, true);
+  doseStartUs = esp_timer_get_time();
+  doseDeadlineUs = doseStartUs + (int64_t)durationMs * 1000;
+  doseGen++;
+  activePump = pump;
+  if (pump == DOSE_ACID) {
+    acidState = true;
+  } else {
+    baseState = true;
+  }
+  portEXIT_CRITICAL(&doseMux);
+  
+  pumpStartTime = millis();
+  doseDurationMs = durationMs;
+  if (doseTimer != nullptr) {
+    esp_timer_stop(doseTimer); // Not running normally; start_once fails on an armed timer
+    if (esp_timer_start_once(doseTimer, (uint64_t)durationMs * 1000ULL) != ESP_OK) {
+      Serial.println("WARNING: Dose timer failed to arm - falling back to update() polling");
+    }
+  }
+}
+
+bool PHControl::endDose(DosePump pump, bool fromTimer) {
+  portENTER_CRITICAL(&doseMux);
+  DosePump ended = activePump;
+  uint32_t gen = doseGen;
+  int64_t nowUs = esp_timer_get_time();
+  if (ended == DOSE_NONE || (pump != DOSE_NONE && pump != ended) ||
+      (fromTimer && nowUs < doseDeadlineUs)) {
+    portEXIT_CRITICAL(&doseMux);
+    return false;
+  }
+  relays->setNow(ended == DOSE_ACID ? REL_ACID_PUMP : REL_ALKALI_PUMP, false);
+  doseEndUs = nowUs;
+  if (ended == DOSE_ACID) {
+    acidState = false;
+  } else {
+    baseState = false;
+  }
+  activePump = DOSE_NONE;
+  lastDoseUs = (uint32_t)(doseEndUs - doseStartUs);
+  lastDosePump = ended;
+  doseCount++;
+  doseEnded = true;
+  portEXIT_CRITICAL(&doseMux);
+  
+  // Stopped early (manual/emergency): the timer must not fire into the next dose.
+  // The callback's own one-shot has already expired, and a dose started since the
+  // mux was released owns the timer now - stopping it would cancel that deadline.
+  if (!fromTimer && doseTimer != nullptr) {
+    portENTER_CRITICAL(&doseMux);
+    bool current = doseGen == gen;
+    portEXIT_CRITICAL(&doseMux);
+    if (current) esp_timer_stop(doseTimer);
+  }
+  return true;
 }
 
 void PHControl::setAcid(bool on) {
-  // Block if in cooldown
-  if (inCooldown && on) {
+  if (!on) {
+    endDose(DOSE_ACID);
+    acidState = false;
+    relays->setNow(REL_ACID_PUMP, false);
+    return;
+  }
+  
+  // Block if in cooldown or a finished dose hasn't started its cooldown yet;
+  // never extend a running dose past its deadline
+  if (inCooldown || doseEnded || acidState) {
     return;
   }
   
   // Turn off base pump first
-  if (on && baseState) {
+  if (baseState) {
     setBase(false);
   }
   
-  acidState = on;
-  digitalWrite(acidPin, getRelayLevel(on));
-  
-  if (on) {
-    pumpStartTime = millis();
-  }
+  startDose(DOSE_ACID, PUMP_MAX_DURATION);
 }
 
 void PHControl::setBase(bool on) {
-  // Block if in cooldown
-  if (inCooldown && on) {
-    Serial.println("Base pump blocked - in cooldown period");
+  if (!on) {
+    bool wasOn = endDose(DOSE_BASE);
+    baseState = false;
+    relays->setNow(REL_ALKALI_PUMP, false);
+    if (wasOn) {
+      Serial.println("Base pump deactivated");
+    }
     return;
   }
   
-  // CRITICAL SAFETY: If trying to turn OFF, explicitly set to HIGH (OFF for Active-Low)
-  if (!on) {
-    digitalWrite(basePin, HIGH); // Explicit HIGH to ensure OFF state
-    delay(10);
+  // Block if in cooldown, or a finished dose hasn't started its cooldown yet
+  if (inCooldown || doseEnded) {
+    Serial.println("Base pump blocked - in cooldown period");
+    return;
+  }
+  // Never extend a running dose past its deadline
+  if (baseState) {
+    return;
   }
   
   // Turn off acid pump first
-  if (on && acidState) {
+  if (acidState) {
     setAcid(false);
   }
   
-  baseState = on;
-  digitalWrite(basePin, getRelayLevel(on));
-  
-  // Double-check: If OFF, ensure it's really HIGH
-  if (!on) {
-    digitalWrite(basePin, HIGH);
+  startDose(DOSE_BASE, PUMP_MAX_DURATION);
+  Serial.println("Base pump activated");
+}
+
+bool PHControl::dose(DosePump pump, unsigned long durationMs) {
+  if (pump == DOSE_NONE || !canDose() || acidState || baseState) {
+    return false;
   }
   
-  if (on) {
-    pumpStartTime = millis();
-    Serial.println("Base pump activated");
-  } else {
-    Serial.println("Base pump deactivated");
-  }
+  // PUMP_MAX_DURATION stays the hard ceiling whatever the dosing engine asks for
+  if (durationMs > PUMP_MAX_DURATION) durationMs = PUMP_MAX_DURATION;
+  if (durationMs < PUMP_MIN_DOSE_MS) durationMs = PUMP_MIN_DOSE_MS;
+  
+  startDose(pump, durationMs);
+  Serial.printf("%s pump dosing for %lu ms\n", pump == DOSE_ACID ? "Acid" : "Base", durationMs);
+  return true;
 }
 
 void PHControl::stopAll() {
+  endDose(DOSE_NONE);
   acidState = false;
   baseState = false;
   
-  // CRITICAL: Explicitly set to HIGH (OFF for Active-Low relays)
-  digitalWrite(acidPin, HIGH);
-  digitalWrite(basePin, HIGH);
-  delay(10);
-  digitalWrite(acidPin, HIGH);
-  digitalWrite(basePin, HIGH);
-  
-  // Also use getRelayLevel for consistency
-  digitalWrite(acidPin, getRelayLevel(false));
-  digitalWrite(basePin, getRelayLevel(false));
-  
-  // Start cooldown after pump stops
-  if (pumpStartTime > 0) {
-    cooldownStartTime = millis();
-    inCooldown = true;
-    pumpStartTime = 0;
-  }
+  // CRITICAL: both pumps OFF immediately, not at the end of the tick
+  relays->set(REL_ACID_PUMP, false);
+  relays->setNow(REL_ALKALI_PUMP, false);
 }
 
 void PHControl::update() {
   unsigned long now = millis();
   
-  // Stop pump after 3 seconds
+  // Backstop only: the dose timer normally switched the pump off at its deadline
   if ((acidState || baseState) && pumpStartTime > 0) {
-    if (now - pumpStartTime >= PUMP_DURATION) {
+    if (now - pumpStartTime >= doseDurationMs + PUMP_DEADLINE_GRACE) {
+      Serial.println("WARNING: Dose timer missed its deadline - stopping pumps");
       stopAll();
     }
   }
   
-  // Check cooldown - wait 1 minute
-  if (inCooldown && cooldownStartTime > 0) {
-    if (now - cooldownStartTime >= COOLDOWN_DURATION) {
-      inCooldown = false;
-      cooldownStartTime = 0;
-    }
+  // A dose finished (timer, manual or emergency stop): start cooldown from the real off time
+  if (doseEnded) {
+    portENTER_CRITICAL(&doseMux);
+    doseEnded = false;
+    int64_t endUs = doseEndUs;
+    uint32_t onUs = lastDoseUs;
+    DosePump pump = lastDosePump;
+    portEXIT_CRITICAL(&doseMux);
+    
+    startCooldown((unsigned long)(endUs / 1000), true);
+    Serial.printf("%s dose complete: %lu.%03lu ms on (planned %lu ms)\n",
+                  pump == DOSE_ACID ? "Acid" : "Base",
+                  (unsigned long)(onUs / 1000), (unsigned long)(onUs % 1000), doseDurationMs);
+  }
+  
+  // Hard ceiling: unlock even if the pH never looked settled
+  if (inCooldown && now - cooldownStartTime >= DOSE_COOLDOWN_MAX) {
+    endCooldown(now, false);
   }
 }
 
-unsigned long PHControl::getCooldownRemaining() {
-  if (!inCooldown || cooldownStartTime == 0) return 0;
+void PHControl::startCooldown(unsigned long startTime, bool afterDose) {
+  cooldownStartTime = startTime;
+  inCooldown = true;
+  settlingAfterDose = afterDose;
+  settleAnchored = false;
+}
+
+void PHControl::endCooldown(unsigned long now, bool settled) {
+  unsigned long elapsed = now - cooldownStartTime;
+  inCooldown = false;
   
-  unsigned long now = millis();
-  if (now < cooldownStartTime) return COOLDOWN_DURATION; // Overflow
+  if (!settlingAfterDose) return;
+  settlingAfterDose = false;
+  lastSettleMs = elapsed;
+  if (!settled) settleTimeouts++;
   
-  unsigned long elapsed = now - cooldownStartTime;
-  if (elapsed >= COOLDOWN_DURATION) return 0;
+  long delta = (long)elapsed - (long)learnedSettleMs;
+  learnedSettleMs = (unsigned long)((long)learnedSettleMs + delta * SETTLE_LEARN_RATE_PCT / 100);
+  Serial.printf("pH %s after %lu ms (learned settle time %lu ms)\n",
+                settled ? "settled" : "cooldown timed out", elapsed, learnedSettleMs);
+}
+
+void PHControl::observePH(int32_t phMilli, unsigned long sampleTime) {
+  if (!inCooldown || acidState || baseState) return;
+  
+  // Slope over a window rather than sample-to-sample, so probe noise doesn't look like motion
+  if (!settleAnchored) {
+    settleAnchorMilli = phMilli;
+    settleAnchorTime = sampleTime;
+    settleAnchored = true;
+    return;
+  }
+  unsigned long span = sampleTime - settleAnchorTime;
+  if (span < PH_SETTLE_WINDOW) return;
+  
+  int32_t change = phMilli - settleAnchorMilli;
+  if (change < 0) change = -change;
+  int32_t rate = (int32_t)((int64_t)change * 1000 / span); // milli-pH per second
+  
+  if (rate <= PH_SETTLE_RATE && sampleTime - cooldownStartTime >= DOSE_COOLDOWN_MIN) {
+    endCooldown(sampleTime, true);
+    return;
+  }
+  settleAnchorMilli = phMilli;
+  settleAnchorTime = sampleTime;
+}
+
+unsigned long PHControl::getCooldownRemaining() {
+  if (!inCooldown) return 0;
+  
+  // Expected unlock: the learned settle time, within the lockout bounds
+  unsigned long expected = learnedSettleMs;
+  if (expected < DOSE_COOLDOWN_MIN) expected = DOSE_COOLDOWN_MIN;
+  if (expected > DOSE_COOLDOWN_MAX) expected = DOSE_COOLDOWN_MAX;
   
-  return COOLDOWN_DURATION - elapsed;
+  unsigned long elapsed = millis() - cooldownStartTime;
+  if (elapsed >= DOSE_COOLDOWN_MAX) return 0;
+  if (elapsed >= expected) return 1000; // Overdue but still settling
+  return expected - elapsed;
 }
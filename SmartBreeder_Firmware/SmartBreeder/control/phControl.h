@@ -2,32 +2,85 @@
 #define PH_CONTROL_H
 
 #include <Arduino.h>
+#include <esp_timer.h>
 #include "config/config.h"
 
+class RelayBank;
+
+enum DosePump : uint8_t {
+  DOSE_NONE = 0,
+  DOSE_ACID,
+  DOSE_BASE
+};
+
 class PHControl {
 private:
-  int acidPin;
-  int basePin;
-  bool acidState;
-  bool baseState;
+  RelayBank* relays;
+  volatile bool acidState;
+  volatile bool baseState;
   unsigned long pumpStartTime;
+  unsigned long doseDurationMs;  // Deadline of the running dose (<= PUMP_MAX_DURATION)
   unsigned long cooldownStartTime;
   bool inCooldown;
-  
-  const unsigned long PUMP_DURATION = 3000;      // 3 seconds
-  const unsigned long COOLDOWN_DURATION = 60000; // 1 minute (60 seconds)
-  
+
+  // Adaptive cooldown: unlock once the pH slope over PH_SETTLE_WINDOW drops to
+  // PH_SETTLE_RATE, but never before DOSE_COOLDOWN_MIN or after DOSE_COOLDOWN_MAX
+  bool settlingAfterDose;         // Only post-dose lockouts teach the settle time
+  bool settleAnchored;
+  int32_t settleAnchorMilli;
+  unsigned long settleAnchorTime;
+  unsigned long lastSettleMs;     // How long the last dose took to settle
+  unsigned long learnedSettleMs;  // EMA of settle times (drives the remaining estimate)
+  uint32_t settleTimeouts;        // Lockouts that hit DOSE_COOLDOWN_MAX unsettled
+
+  void startCooldown(unsigned long startTime, bool afterDose);
+  void endCooldown(unsigned long now, bool settled);
+
+  // Dose deadline: a one-shot esp_timer switches the pump off at PUMP_MAX_DURATION,
+  // independent of how late the control task gets to update()
+  esp_timer_handle_t doseTimer;
+  portMUX_TYPE doseMux;         // Shared with the esp_timer task
+  volatile DosePump activePump;
+  int64_t doseStartUs;          // esp_timer_get_time() right after the relay went ON
+  int64_t doseEndUs;            // ... and right after it went OFF
+  int64_t doseDeadlineUs;       // Start + planned duration; the timer is armed after this
+  uint32_t doseGen;             // Bumped by startDose(); endDose() only stops its own dose's timer
+  volatile bool doseEnded;      // Set by endDose(), consumed by update()
+  uint32_t lastDoseUs;          // Measured on-time of the last completed dose
+  DosePump lastDosePump;
+  uint32_t doseCount;
+
+  void startDose(DosePump pump, unsigned long durationMs);
+  // DOSE_NONE ends whichever pump is running. fromTimer (the dose timer callback) leaves
+  // a dose before its deadline alone - a callback already running when a new dose replaced
+  // the old one - and never stops the timer; only task context does that
+  bool endDose(DosePump pump, bool fromTimer = false);
+  static void onDoseTimer(void* arg);
+
 public:
-  PHControl(int acidPin, int basePin);
+  PHControl(RelayBank* relays);
   void begin();
-  void setAcid(bool on);
+  void setAcid(bool on);   // ON runs a full PUMP_MAX_DURATION dose (manual control)
   void setBase(bool on);
+  bool dose(DosePump pump, unsigned long durationMs); // Sized dose; false if blocked
   void stopAll();
   bool getAcidState() { return acidState; }
   bool getBaseState() { return baseState; }
-  bool canDose() { return !inCooldown; }
-  unsigned long getCooldownRemaining();
+  // False from dose start until its post-dose cooldown has ended, including the
+  // gap between the dose timer firing and update() starting that cooldown
+  bool canDose() { return activePump == DOSE_NONE && !doseEnded && !inCooldown; }
+  bool isDosing() { return activePump != DOSE_NONE; }
+  unsigned long getCooldownRemaining(); // Estimate from the learned settle time
   void update();
+  void observePH(int32_t phMilli, unsigned long sampleTime); // Feed each new pH sample
+  unsigned long getLastSettleMs() { return lastSettleMs; }
+  unsigned long getLearnedSettleMs() { return learnedSettleMs; }
+  uint32_t getSettleTimeouts() { return settleTimeouts; }
+
+  // Dose verification
+  uint32_t getLastDoseUs() { return lastDoseUs; }
+  DosePump getLastDosePump() { return lastDosePump; }
+  uint32_t getDoseCount() { return doseCount; }
 };
 
 #endif
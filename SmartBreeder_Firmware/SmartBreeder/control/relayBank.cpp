@@ -0,0 +1,98 @@
+
+#include "relayBank.h"
+#include "config/config.h"
+#include <soc/gpio_reg.h>
+
+RelayBank::RelayBank() :
+  target(RELAY_DEFAULT_MASK), applied(RELAY_DEFAULT_MASK),
+  registerWrites(0), transitions(0), verifyFaults(0) {
+  mux = portMUX_INITIALIZER_UNLOCKED;
+  // CRITICAL: runs before setup() so no relay can click on during boot.
+  // Latch the OFF levels first, then enable the drivers, so there is no glitch.
+  writeLevels(RELAY_ALL_MASK, RELAY_DEFAULT_MASK);
+  for (uint8_t ch = 0; ch < RELAY_COUNT; ch++) {
+    pinMode(RELAY_MAP[ch].pin, OUTPUT);
+  }
+}
+
+void RelayBank::begin() {
+  portENTER_CRITICAL(&mux);
+  writeLevels(RELAY_ALL_MASK, applied);
+  portEXIT_CRITICAL(&mux);
+  for (uint8_t ch = 0; ch < RELAY_COUNT; ch++) {
+    pinMode(RELAY_MAP[ch].pin, OUTPUT);
+  }
+  Serial.printf("Relay bank initialized: mask 0x%02X\n", applied);
+}
+
+uint8_t RelayBank::writeLevels(uint8_t channels, uint8_t onMask) {
+  // Pin must be HIGH where ON matches an active-high relay or OFF an active-low one
+  uint8_t highMask = (uint8_t)~(onMask ^ RELAY_ACTIVE_HIGH_MASK);
+  uint32_t setBits[2] = { 0, 0 };
+  uint32_t clearBits[2] = { 0, 0 };
+  for (uint8_t ch = 0; ch < RELAY_COUNT; ch++) {
+    if (!((channels >> ch) & 1)) continue;
+    uint8_t pin = RELAY_MAP[ch].pin;
+    uint32_t* bank = ((highMask >> ch) & 1) ? setBits : clearBits;
+    bank[pin >> 5] |= 1UL << (pin & 31);
+  }
+
+  // W1TS/W1TC only touch the bits written, so no read-modify-write of the OUT registers
+  uint8_t writes = 0;
+  if (setBits[0])   { REG_WRITE(GPIO_OUT_W1TS_REG, setBits[0]); writes++; }
+  if (clearBits[0]) { REG_WRITE(GPIO_OUT_W1TC_REG, clearBits[0]); writes++; }
+  if (setBits[1])   { REG_WRITE(GPIO_OUT1_W1TS_REG, setBits[1]); writes++; }
+  if (clearBits[1]) { REG_WRITE(GPIO_OUT1_W1TC_REG, clearBits[1]); writes++; }
+  return writes;
+}
+
+uint8_t RelayBank::readLatchedOn() {
+  uint32_t out[2] = { REG_READ(GPIO_OUT_REG), REG_READ(GPIO_OUT1_REG) };
+  uint8_t highMask = 0;
+  for (uint8_t ch = 0; ch < RELAY_COUNT; ch++) {
+    uint8_t pin = RELAY_MAP[ch].pin;
+    if ((out[pin >> 5] >> (pin & 31)) & 1) highMask |= 1 << ch;
+  }
+  return (uint8_t)~(highMask ^ RELAY_ACTIVE_HIGH_MASK) & RELAY_ALL_MASK;
+}
+
+void RelayBank::set(RelayId id, bool on) {
+  portENTER_CRITICAL(&mux);
+  if (on) {
+    target |= relayBit(id);
+  } else {
+    target &= ~relayBit(id);
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+bool RelayBank::apply() {
+  portENTER_CRITICAL(&mux);
+  uint8_t changed = target ^ applied;
+  if (changed == 0) {
+    portEXIT_CRITICAL(&mux);
+    return false;
+  }
+  registerWrites += writeLevels(changed, target);
+  transitions += __builtin_popcount(changed);
+  applied = target;
+  portEXIT_CRITICAL(&mux);
+  return true;
+}
+
+uint8_t RelayBank::verify() {
+  portENTER_CRITICAL(&mux);
+  uint8_t bad = (readLatchedOn() ^ applied) & RELAY_ALL_MASK;
+  if (bad != 0) {
+    registerWrites += writeLevels(bad, applied);
+    verifyFaults++;
+  }
+  portEXIT_CRITICAL(&mux);
+
+  if (bad & RELAY_DOSING_MASK) {
+    Serial.printf("CRITICAL: Dosing pump output latch mismatch (mask 0x%02X) - re-asserted\n", bad);
+  } else if (bad != 0) {
+    Serial.printf("WARNING: Relay output latch mismatch (mask 0x%02X) - re-asserted\n", bad);
+  }
+  return bad;
+}
@@ -0,0 +1,41 @@
+#ifndef RELAY_BANK_H
+#define RELAY_BANK_H
+
+#include <Arduino.h>
+#include "config/config.h"
+
+// Owns every relay in RELAY_MAP. Callers change a shadow bitmask (bit = relayBit(id),
+// 1 = ON); apply() pushes only the changed bits with one W1TS and one W1TC write per
+// GPIO bank (GPIO0-31, GPIO32-39). Status comes from the mask, never from the pins.
+// Polarity is folded in from RELAY_ACTIVE_HIGH_MASK, so callers only ever say ON/OFF.
+class RelayBank {
+private:
+  portMUX_TYPE mux;         // set() runs on several tasks, apply() on the control and timer tasks
+  volatile uint8_t target;  // Commanded state
+  volatile uint8_t applied; // State last written to the output registers
+  uint32_t registerWrites;
+  uint32_t transitions;
+  uint32_t verifyFaults;
+
+  static uint8_t writeLevels(uint8_t channels, uint8_t onMask); // Returns register writes issued
+  static uint8_t readLatchedOn();
+
+public:
+  RelayBank();
+  void begin();
+
+  void set(RelayId id, bool on);   // Takes effect on the next apply()
+  void setNow(RelayId id, bool on) { set(id, on); apply(); }
+  bool get(RelayId id) { return target & relayBit(id); }     // Commanded
+  bool isOn(RelayId id) { return applied & relayBit(id); }   // On the pins
+  uint8_t getMask() { return applied; }
+
+  bool apply();     // Write pending changes; false when nothing changed
+  uint8_t verify(); // Re-assert channels whose output latch disagrees; returns their mask
+
+  uint32_t getRegisterWrites() { return registerWrites; }
+  uint32_t getTransitions() { return transitions; }
+  uint32_t getVerifyFaults() { return verifyFaults; }
+};
+
+#endif
@@ -0,0 +1,34 @@
+
+#include "relayRules.h"
+#include "config/config.h"
+
+RelayRules::RelayRules() :
+  inputs{ 0, 0 }, evaluated(false), target(RELAY_DEFAULT_MASK & RELAY_RULE_MASK),
+  evaluations(0), skipped(0) {}
+
+uint8_t RelayRules::evaluate(uint16_t conditions) {
+  uint8_t decided = 0;
+  uint8_t on = 0;
+  for (uint8_t i = 0; i < RELAY_RULE_COUNT && decided != RELAY_RULE_MASK; i++) {
+    const RelayRule& rule = RELAY_RULES[i];
+    if ((conditions & rule.require) != rule.require || (conditions & rule.forbid) != 0) continue;
+
+    // First (highest priority) matching rule per relay wins
+    uint8_t fresh = rule.relays & ~decided;
+    if (rule.on) on |= fresh;
+    decided |= fresh;
+  }
+  return on; // Undecided relays stay OFF
+}
+
+bool RelayRules::update(const RuleInputs& in) {
+  if (evaluated && in == inputs) {
+    skipped++;
+    return false;
+  }
+  inputs = in;
+  target = evaluate(in.conditions);
+  evaluated = true;
+  evaluations++;
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef RELAY_RULES_H
+#define RELAY_RULES_H
+
+#include <Arduino.h>
+#include "config/config.h"
+
+// Everything RELAY_RULES may depend on. Equal inputs give an equal result,
+// so evaluation is skipped until one of these changes.
+struct RuleInputs {
+  uint16_t conditions;  // RuleCondition bits
+  uint8_t manualMask;   // relayBit() of relays under manual override (left alone)
+
+  bool operator==(const RuleInputs& other) const {
+    return conditions == other.conditions && manualMask == other.manualMask;
+  }
+  bool operator!=(const RuleInputs& other) const { return !(*this == other); }
+};
+
+// Folds RELAY_RULES into a target relay mask once per control tick, only when dirty
+class RelayRules {
+private:
+  RuleInputs inputs;
+  bool evaluated;       // false until the first evaluation (and after invalidate())
+  uint8_t target;       // Desired state of the RELAY_RULE_MASK relays
+  uint32_t evaluations;
+  uint32_t skipped;
+
+public:
+  RelayRules();
+
+  // Returns true if the inputs were dirty and target was recomputed
+  bool update(const RuleInputs& in);
+  void invalidate() { evaluated = false; }
+
+  static uint8_t evaluate(uint16_t conditions);
+
+  uint8_t getTarget() { return target; }
+  // Relays whose target update() would write: owned by the table and not manual
+  uint8_t getDriveMask() { return RELAY_RULE_MASK & ~inputs.manualMask; }
+  uint16_t getConditions() { return inputs.conditions; }
+  uint32_t getEvaluations() { return evaluations; }
+  uint32_t getSkipped() { return skipped; }
+};
+
+#endif
@@ -0,0 +1,108 @@
+
+#include "scheduler.h"
+#include "config/config.h"
+
+Scheduler::Scheduler() : jobCount(0) {
+  statsMux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+int8_t Scheduler::add(const char* name, uint32_t periodMs, JobFn fn, void* ctx, uint32_t budgetUs, bool armed) {
+  if (jobCount >= SCHED_MAX_JOBS || fn == nullptr) {
+    Serial.printf("Scheduler: cannot add job %s\n", name);
+    return -1;
+  }
+  Job& job = jobs[jobCount];
+  job.name = name;
+  job.fn = fn;
+  job.ctx = ctx;
+  job.periodMs = periodMs;
+  job.budgetUs = budgetUs;
+  job.due = millis();
+  job.armed = armed;
+  job.stats = JobStats{ 0, 0, 0, 0, 0, 0 };
+  return (int8_t)jobCount++;
+}
+
+int8_t Scheduler::addPeriodic(const char* name, uint32_t periodMs, JobFn fn, void* ctx, uint32_t budgetUs) {
+  return add(name, periodMs > 0 ? periodMs : 1, fn, ctx, budgetUs, true);
+}
+
+int8_t Scheduler::addOneShot(const char* name, JobFn fn, void* ctx, uint32_t budgetUs) {
+  return add(name, 0, fn, ctx, budgetUs, false);
+}
+
+void Scheduler::trigger(int8_t id, uint32_t delayMs) {
+  if (id < 0 || id >= jobCount) return;
+  jobs[id].due = millis() + delayMs;
+  jobs[id].armed = true;
+}
+
+void Scheduler::cancel(int8_t id) {
+  if (id < 0 || id >= jobCount) return;
+  jobs[id].armed = false;
+}
+
+void Scheduler::run(Job& job, unsigned long now) {
+  uint32_t lateMs = now - job.due;
+  bool overrun = false;
+  if (job.periodMs == 0) {
+    job.armed = false;
+  } else {
+    // Keep the phase; if a whole period was missed, skip ahead rather than run back to back
+    job.due += job.periodMs;
+    if ((long)(now - job.due) >= 0) {
+      overrun = true;
+      job.due = now + job.periodMs;
+    }
+  }
+
+  uint32_t start = micros();
+  job.fn(job.ctx);
+  uint32_t execUs = micros() - start;
+
+  portENTER_CRITICAL(&statsMux);
+  job.stats.runs++;
+  if (overrun) job.stats.overruns++;
+  if (job.budgetUs > 0 && execUs > job.budgetUs) job.stats.budgetMisses++;
+  if (lateMs > job.stats.maxLatenessMs) job.stats.maxLatenessMs = lateMs;
+  job.stats.lastExecUs = execUs;
+  if (execUs > job.stats.maxExecUs) job.stats.maxExecUs = execUs;
+  portEXIT_CRITICAL(&statsMux);
+}
+
+uint32_t Scheduler::runDue() {
+  unsigned long now = millis();
+  for (;;) {
+    // Earliest deadline among the due jobs
+    int8_t next = -1;
+    for (uint8_t i = 0; i < jobCount; i++) {
+      if (!jobs[i].armed || (long)(now - jobs[i].due) < 0) continue;
+      if (next < 0 || (long)(jobs[i].due - jobs[next].due) < 0) next = i;
+    }
+    if (next < 0) break;
+    run(jobs[next], now);
+    now = millis();
+  }
+
+  uint32_t wait = SCHED_IDLE_SLEEP_MS;
+  for (uint8_t i = 0; i < jobCount; i++) {
+    if (!jobs[i].armed) continue;
+    uint32_t until = jobs[i].due - now; // Not due: runDue() just ran everything that was
+    if (until < wait) wait = until;
+  }
+  return wait;
+}
+
+void Scheduler::sleep(uint32_t ms) {
+  TickType_t ticks = pdMS_TO_TICKS(ms);
+  vTaskDelay(ticks > 0 ? ticks : 1);
+}
+
+JobStats Scheduler::getStats(uint8_t id) {
+  JobStats copy = JobStats{ 0, 0, 0, 0, 0, 0 };
+  if (id >= jobCount) return copy;
+  portENTER_CRITICAL(&statsMux);
+  copy = jobs[id].stats;
+  portEXIT_CRITICAL(&statsMux);
+  return copy;
+}
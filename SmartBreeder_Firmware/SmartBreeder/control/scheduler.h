@@ -0,0 +1,62 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config/config.h"
+
+typedef void (*JobFn)(void* ctx);
+
+// Per-job timing health; times behind the deadline in ms, run times in us
+struct JobStats {
+  uint32_t runs;
+  uint32_t overruns;       // Released a whole period late: at least one run was skipped
+  uint32_t budgetMisses;   // Ran longer than its budget
+  uint32_t maxLatenessMs;
+  uint32_t lastExecUs;
+  uint32_t maxExecUs;
+};
+
+// Cooperative deadline scheduler: periodic and one-shot jobs run from one task,
+// earliest deadline first (registration order breaks ties). Jobs must not block.
+class Scheduler {
+private:
+  struct Job {
+    const char* name;
+    JobFn fn;
+    void* ctx;
+    uint32_t periodMs;     // 0 = one-shot
+    uint32_t budgetUs;     // 0 = unbudgeted
+    unsigned long due;     // millis() deadline
+    bool armed;
+    JobStats stats;
+  };
+
+  Job jobs[SCHED_MAX_JOBS];
+  uint8_t jobCount;
+  portMUX_TYPE statsMux;   // Stats are read from other tasks (web status)
+
+  int8_t add(const char* name, uint32_t periodMs, JobFn fn, void* ctx, uint32_t budgetUs, bool armed);
+  void run(Job& job, unsigned long now);
+
+public:
+  Scheduler();
+
+  // Both return the job id, or -1 if SCHED_MAX_JOBS is exhausted.
+  // Periodic jobs are first due right away; one-shots wait for trigger().
+  int8_t addPeriodic(const char* name, uint32_t periodMs, JobFn fn, void* ctx, uint32_t budgetUs = 0);
+  int8_t addOneShot(const char* name, JobFn fn, void* ctx, uint32_t budgetUs = 0);
+  void trigger(int8_t id, uint32_t delayMs = 0); // (Re)arm to run after delayMs; a period restarts from there
+  void cancel(int8_t id);
+
+  uint32_t runDue();        // Runs every due job; returns ms until the next deadline
+  void sleep(uint32_t ms);  // Blocks the calling task (at least one tick)
+
+  uint8_t getJobCount() { return jobCount; }
+  const char* getName(uint8_t id) { return id < jobCount ? jobs[id].name : ""; }
+  uint32_t getPeriod(uint8_t id) { return id < jobCount ? jobs[id].periodMs : 0; }
+  JobStats getStats(uint8_t id);
+};
+
+#endif
@@ -0,0 +1,184 @@
+
+#include "tempControl.h"
+#include "control/relayBank.h"
+#include "config/config.h"
+#include "config/configCache.h"
+
+TempControl::TempControl(RelayBank* relays) :
+  relays(relays), mode(TEMP_MODE_HYSTERESIS), deadbandMilli(TEMP_DEADBAND_DEFAULT),
+  heatDemand(false), fanDemand(false), lastSample(0), setpointMilli(0),
+  integral(0), lastTempMilli(0), lastTempTime(0), hasLastTemp(false), dutyPermille(0), windowStart(0),
+  heaterCycles(0), fanCycles(0), savedSamples(0), savedCoasts(0), lastModelSave(0) {}
+
+void TempControl::begin() {
+  load();
+  Serial.printf("Temperature control: %s, deadband %ld m°C\n",
+                mode == TEMP_MODE_PID ? "PID heater" : "hysteresis", deadbandMilli);
+  const ThermalParams& p = model.getParams();
+  Serial.printf("Thermal model: heat %ld / fan %ld / drift %ld u°C/s, coast %ld / %ld m°C\n",
+                p.heatRate, p.fanRate, p.driftRate, p.heatCoast, p.fanCoast);
+}
+
+void TempControl::load() {
+  const ConfigValues& cfg = configCache.get();
+  uint8_t savedMode = cfg.tempMode;
+  int32_t savedDeadband = cfg.tempDeadband;
+  
+  if (cfg.hasThermal) {
+    model.setParams(cfg.thermal); // Ignored if implausible: defaults stay
+  }
+  savedSamples = model.getParams().samples;
+
+  mode = savedMode == TEMP_MODE_PID ? TEMP_MODE_PID : TEMP_MODE_HYSTERESIS;
+  if (savedDeadband >= TEMP_DEADBAND_MIN && savedDeadband <= TEMP_DEADBAND_MAX) {
+    deadbandMilli = savedDeadband;
+  }
+}
+
+bool TempControl::setMode(TempMode newMode) {
+  if (newMode != TEMP_MODE_HYSTERESIS && newMode != TEMP_MODE_PID) {
+    return false;
+  }
+  if (newMode != mode) {
+    mode = newMode;
+    resetPID();
+  }
+
+  configCache.setTempMode(mode);
+  Serial.printf("Temperature control mode: %s\n", mode == TEMP_MODE_PID ? "PID heater" : "hysteresis");
+  return true;
+}
+
+bool TempControl::setDeadband(int32_t milli) {
+  if (milli < TEMP_DEADBAND_MIN || milli > TEMP_DEADBAND_MAX) {
+    return false;
+  }
+  deadbandMilli = milli;
+
+  configCache.setTempDeadband(deadbandMilli);
+  Serial.printf("Temperature deadband set to %ld m°C\n", deadbandMilli);
+  return true;
+}
+
+void TempControl::saveModel(unsigned long now) {
+  configCache.setThermal(model.getParams());
+  savedSamples = model.getParams().samples;
+  savedCoasts = model.getCoastCount();
+  lastModelSave = now;
+}
+
+void TempControl::setHeat(bool on) {
+  if (on && !heatDemand) heaterCycles++;
+  heatDemand = on;
+}
+
+void TempControl::resetPID() {
+  integral = 0;
+  hasLastTemp = false;
+  dutyPermille = 0;
+  windowStart = millis();
+}
+
+void TempControl::updateFan(int32_t estimate, int32_t maxMilli, int32_t deadband) {
+  bool was = fanDemand;
+
+  // ON above the band, OFF once back below max - deadband (early by the learned coast)
+  int32_t coast = model.fanCoast();
+  if (coast > deadband) coast = deadband;
+  if (estimate > maxMilli) {
+    fanDemand = true;
+  } else if (estimate - coast <= maxMilli - deadband) {
+    fanDemand = false;
+  }
+
+  if (fanDemand && !was) fanCycles++;
+}
+
+void TempControl::updatePID(int32_t tempMilli, unsigned long sampleTime) {
+  int32_t error = setpointMilli - tempMilli;
+  int32_t rate = 0; // m°C/s
+  if (hasLastTemp && sampleTime != lastTempTime) {
+    unsigned long dt = sampleTime - lastTempTime;
+    rate = (int32_t)((int64_t)(tempMilli - lastTempMilli) * 1000 / (int64_t)dt);
+
+    // Anti-windup: the integral term alone can never ask for more than 0..100% duty
+    integral += (int64_t)error * (int64_t)dt / 1000;
+    int64_t integralMax = 1000LL * 1000LL * TEMP_PID_TI_S / TEMP_PID_KP;
+    if (integral < 0) integral = 0;
+    if (integral > integralMax) integral = integralMax;
+  }
+  lastTempMilli = tempMilli;
+  lastTempTime = sampleTime;
+  hasLastTemp = true;
+
+  // Derivative on measurement, so a setpoint change (new species) doesn't kick the output
+  int64_t out = (int64_t)TEMP_PID_KP * (error + integral / TEMP_PID_TI_S - (int64_t)TEMP_PID_TD_S * rate) / 1000;
+  if (out < 0) out = 0;
+  if (out > 1000) out = 1000;
+  dutyPermille = (int32_t)out;
+}
+
+void TempControl::update(int32_t tempMilli, unsigned long sampleTime, int32_t minMilli, int32_t maxMilli,
+                         unsigned long now) {
+  bool heaterWas = relays->isOn(REL_WATER_HEATER);
+  bool fanWas = relays->isOn(REL_COOLER_FAN);
+
+  // A narrow band can't hold a wide deadband: never cross the middle
+  int32_t deadband = deadbandMilli;
+  if (deadband > (maxMilli - minMilli) / 2) deadband = (maxMilli - minMilli) / 2;
+  if (deadband < 0) deadband = 0;
+
+  // Learn from each new sample under the relay state it was taken with
+  bool newSample = sampleTime != lastSample;
+  if (newSample) {
+    model.observe(tempMilli, sampleTime, heaterWas, fanWas);
+    const ThermalParams& p = model.getParams();
+    if (model.getCoastCount() != savedCoasts ||
+        (p.samples != savedSamples && now - lastModelSave >= THERMAL_SAVE_INTERVAL)) {
+      saveModel(now);
+    }
+  }
+  // Samples can be up to TEMP_READ_INTERVAL_MAX old: carry them forward to now
+  int32_t estimate = model.predict(tempMilli, now - sampleTime, heaterWas, fanWas);
+
+  updateFan(estimate, maxMilli, deadband);
+
+  if (mode == TEMP_MODE_PID) {
+    setpointMilli = minMilli + (maxMilli - minMilli) / 2;
+    if (newSample) {
+      updatePID(tempMilli, sampleTime);
+    }
+  } else {
+    setpointMilli = minMilli + deadband;
+  }
+  lastSample = sampleTime;
+
+  if (estimate >= maxMilli) {
+    // Never heat above the band, whatever the PID state
+    setHeat(false);
+  } else if (mode == TEMP_MODE_PID) {
+    // Time-proportioning: ON for duty of each window, slices below HEATER_MIN_SWITCH_MS dropped
+    if (now - windowStart >= HEATER_PID_WINDOW_MS) {
+      windowStart = now;
+    }
+    unsigned long onTime = (unsigned long)dutyPermille * HEATER_PID_WINDOW_MS / 1000;
+    if (onTime < HEATER_MIN_SWITCH_MS) onTime = 0;
+    if (HEATER_PID_WINDOW_MS - onTime < HEATER_MIN_SWITCH_MS) onTime = HEATER_PID_WINDOW_MS;
+    setHeat(now - windowStart < onTime);
+  } else {
+    // ON below the band, OFF once the coast will carry it to min + deadband, hold in between
+    int32_t coast = model.heaterCoast();
+    if (coast > deadband) coast = deadband;
+    if (estimate < minMilli) {
+      setHeat(true);
+    } else if (estimate + coast >= minMilli + deadband) {
+      setHeat(false);
+    }
+  }
+}
+
+void TempControl::idle() {
+  resetPID();
+  heatDemand = false;
+  fanDemand = false;
+}
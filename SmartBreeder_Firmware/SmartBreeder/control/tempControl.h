@@ -0,0 +1,76 @@
+#ifndef TEMP_CONTROL_H
+#define TEMP_CONTROL_H
+
+#include <Arduino.h>
+#include "config/config.h"
+#include "control/thermalModel.h"
+
+class RelayBank;
+
+enum TempMode : uint8_t {
+  TEMP_MODE_HYSTERESIS = 0, // Heater and fan both switch on the band edges with a deadband
+  TEMP_MODE_PID             // Heater duty from PID over HEATER_PID_WINDOW_MS, fan still hysteresis
+};
+
+// Decides heater and cooler-fan demand from the profile temperature band; RELAY_RULES
+// turns the demand into relay states (COND_HEAT_DEMAND / COND_COOL_DEMAND).
+// Runs every control tick; the PID output is only recomputed on a new sample.
+// A learned ThermalModel drops the demand early by the expected coast.
+class TempControl {
+private:
+  RelayBank* relays;         // Read only: the model learns from the applied relay state
+  TempMode mode;
+  int32_t deadbandMilli;
+
+  bool heatDemand;
+  bool fanDemand;
+  unsigned long lastSample;  // tempTimestamp of the last sample seen
+  int32_t setpointMilli;
+
+  // PID state
+  int64_t integral;          // m°C * s, clamped so its term stays within 0..1000 permille
+  int32_t lastTempMilli;
+  unsigned long lastTempTime;
+  bool hasLastTemp;
+  int32_t dutyPermille;
+  unsigned long windowStart;
+
+  uint32_t heaterCycles;     // Demand OFF->ON transitions since boot
+  uint32_t fanCycles;
+
+  ThermalModel model;
+  uint32_t savedSamples;     // model samples at the last save
+  uint32_t savedCoasts;
+  unsigned long lastModelSave;
+  void saveModel(unsigned long now);
+
+  void load();
+  void setHeat(bool on);
+  void updateFan(int32_t estimate, int32_t maxMilli, int32_t deadband);
+  void updatePID(int32_t tempMilli, unsigned long sampleTime);
+  void resetPID();
+
+public:
+  TempControl(RelayBank* relays);
+  void begin();
+
+  // One control tick with a valid temperature and an active profile
+  void update(int32_t tempMilli, unsigned long sampleTime, int32_t minMilli, int32_t maxMilli,
+              unsigned long now);
+  // No fish selected or no valid temperature: no demand, PID reset
+  void idle();
+
+  bool setMode(TempMode newMode);
+  bool setDeadband(int32_t milli);
+  TempMode getMode() { return mode; }
+  int32_t getDeadband() { return deadbandMilli; }
+  int32_t getSetpoint() { return setpointMilli; }
+  int32_t getDuty() { return dutyPermille; }
+  bool getHeatDemand() { return heatDemand; }
+  bool getFanDemand() { return fanDemand; }
+  uint32_t getHeaterCycles() { return heaterCycles; }
+  uint32_t getFanCycles() { return fanCycles; }
+  const ThermalModel& getModel() { return model; }
+};
+
+#endif
@@ -0,0 +1,132 @@
+
+#include "thermalModel.h"
+
+ThermalModel::ThermalModel() {
+  reset();
+}
+
+void ThermalModel::reset() {
+  params.heatRate = THERMAL_HEAT_RATE_DEFAULT;
+  params.fanRate = THERMAL_FAN_RATE_DEFAULT;
+  params.driftRate = THERMAL_DRIFT_RATE_DEFAULT;
+  params.heatCoast = 0;
+  params.fanCoast = 0;
+  params.samples = 0;
+  hasLast = false;
+  lastTemp = 0;
+  lastTime = 0;
+  lastHeater = false;
+  lastFan = false;
+  slopeStartTemp = 0;
+  slopeStartTime = 0;
+  heatCoasting = false;
+  heatOffTemp = heatPeak = 0;
+  heatOffTime = 0;
+  fanCoasting = false;
+  fanOffTemp = fanTrough = 0;
+  fanOffTime = 0;
+  coastCount = 0;
+}
+
+void ThermalModel::setParams(const ThermalParams& p) {
+  // Reject a corrupt or sign-flipped set rather than drive the heater from it
+  if (p.heatRate <= 0 || p.fanRate >= 0 || p.heatCoast < 0 || p.fanCoast < 0) {
+    return;
+  }
+  params = p;
+}
+
+int32_t ThermalModel::blend(int32_t current, int32_t measured, int32_t weightPct) {
+  return current + (int32_t)((int64_t)(measured - current) * weightPct / 100);
+}
+
+void ThermalModel::observe(int32_t tempMilli, uint32_t timeMs, bool heaterOn, bool fanOn) {
+  // Switch-offs start a coast: keep following the temperature until it turns around
+  if (hasLast && lastHeater && !heaterOn) {
+    heatCoasting = true;
+    heatOffTemp = heatPeak = tempMilli;
+    heatOffTime = timeMs;
+  }
+  if (hasLast && lastFan && !fanOn) {
+    fanCoasting = true;
+    fanOffTemp = fanTrough = tempMilli;
+    fanOffTime = timeMs;
+  }
+  // Switching back on before the turn spoils the measurement
+  if (heaterOn || fanOn) {
+    heatCoasting = false;
+    fanCoasting = false;
+  }
+
+  if (heatCoasting) {
+    if (tempMilli > heatPeak) heatPeak = tempMilli;
+    if (tempMilli < heatPeak - THERMAL_COAST_NOISE || timeMs - heatOffTime >= THERMAL_COAST_WINDOW_MS) {
+      params.heatCoast = blend(params.heatCoast, heatPeak - heatOffTemp, THERMAL_COAST_LEARN_RATE_PCT);
+      heatCoasting = false;
+      coastCount++;
+    }
+  }
+  if (fanCoasting) {
+    if (tempMilli < fanTrough) fanTrough = tempMilli;
+    if (tempMilli > fanTrough + THERMAL_COAST_NOISE || timeMs - fanOffTime >= THERMAL_COAST_WINDOW_MS) {
+      params.fanCoast = blend(params.fanCoast, fanOffTemp - fanTrough, THERMAL_COAST_LEARN_RATE_PCT);
+      fanCoasting = false;
+      coastCount++;
+    }
+  }
+
+  // Slopes: over a stretch in one relay state, closed by a switch, a gap or a full window
+  if (!hasLast) {
+    slopeStartTemp = tempMilli;
+    slopeStartTime = timeMs;
+  } else if (heaterOn != lastHeater || fanOn != lastFan || timeMs - lastTime > THERMAL_MAX_SPAN_MS) {
+    learnSlope(lastTemp, lastTime, lastHeater, lastFan); // The stretch ended at the previous sample
+    slopeStartTemp = tempMilli;
+    slopeStartTime = timeMs;
+  } else if (timeMs - slopeStartTime >= THERMAL_SLOPE_WINDOW_MS) {
+    learnSlope(tempMilli, timeMs, heaterOn, fanOn);
+    slopeStartTemp = tempMilli;
+    slopeStartTime = timeMs;
+  }
+  // Drift only once stored heat/cold from the last switch-off has played out
+  if (!heaterOn && !fanOn && (heatCoasting || fanCoasting)) {
+    slopeStartTemp = tempMilli;
+    slopeStartTime = timeMs;
+  }
+
+  hasLast = true;
+  lastTemp = tempMilli;
+  lastTime = timeMs;
+  lastHeater = heaterOn;
+  lastFan = fanOn;
+}
+
+void ThermalModel::learnSlope(int32_t tempMilli, uint32_t timeMs, bool heaterOn, bool fanOn) {
+  uint32_t span = timeMs - slopeStartTime;
+  if (span < THERMAL_MIN_SPAN_MS) return;
+  int32_t rate = (int32_t)((int64_t)(tempMilli - slopeStartTemp) * 1000000LL / span);
+  // A stretch cut short by a switch counts for less than a full window
+  int32_t weight = (int32_t)((uint64_t)THERMAL_LEARN_RATE_PCT * (span < THERMAL_SLOPE_WINDOW_MS ? span : THERMAL_SLOPE_WINDOW_MS) /
+                             THERMAL_SLOPE_WINDOW_MS);
+  if (weight < 1) weight = 1;
+
+  if (heaterOn && !fanOn) {
+    params.heatRate = blend(params.heatRate, rate, weight);
+    if (params.heatRate < 1) params.heatRate = 1;
+    params.samples++;
+  } else if (fanOn && !heaterOn) {
+    params.fanRate = blend(params.fanRate, rate, weight);
+    if (params.fanRate > -1) params.fanRate = -1;
+    params.samples++;
+  } else if (!heaterOn && !fanOn) {
+    params.driftRate = blend(params.driftRate, rate, weight);
+    params.samples++;
+  }
+}
+
+int32_t ThermalModel::predict(int32_t tempMilli, uint32_t horizonMs, bool heaterOn, bool fanOn) const {
+  int64_t rate = params.driftRate;
+  if (heaterOn) rate += params.heatRate - params.driftRate;
+  if (fanOn) rate += params.fanRate - params.driftRate;
+  return tempMilli + (int32_t)(rate * horizonMs / 1000000LL);
+}
@@ -0,0 +1,70 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+#include "config/config.h"
+
+// Online first-order thermal model of the tank. No hardware access beyond
+// config/config.h (host/stubs covers it), so a recorded (time, temperature,
+// heater, fan) trace can be replayed on the host.
+//
+// Learns, from stretches of samples taken with the same relay state:
+//   - the temperature slope with the heater ON, the fan ON and with neither (drift),
+//     measured across up to THERMAL_SLOPE_WINDOW_MS so 1/16 °C probe steps average out
+//   - the "coast": how far temperature keeps moving after the heater/fan switches OFF
+// Rates are in micro-°C per second, temperatures in m°C, times in ms.
+// Tuning (THERMAL_*) is in config/config.h.
+
+struct ThermalParams {
+  int32_t heatRate;    // Slope with the heater ON (positive)
+  int32_t fanRate;     // Slope with the fan ON (negative)
+  int32_t driftRate;   // Slope with both OFF (room losses, usually negative)
+  int32_t heatCoast;   // Rise after heater OFF, m°C
+  int32_t fanCoast;    // Fall after fan OFF, m°C
+  uint32_t samples;    // Slope observations learned from
+};
+
+class ThermalModel {
+private:
+  ThermalParams params;
+
+  bool hasLast;
+  int32_t lastTemp;
+  uint32_t lastTime;
+  bool lastHeater;
+  bool lastFan;
+  int32_t slopeStartTemp;  // Start of the stretch the next slope is measured over
+  uint32_t slopeStartTime;
+
+  // Coast tracking after a switch-off
+  bool heatCoasting;
+  int32_t heatOffTemp;
+  int32_t heatPeak;
+  uint32_t heatOffTime;
+  bool fanCoasting;
+  int32_t fanOffTemp;
+  int32_t fanTrough;
+  uint32_t fanOffTime;
+  uint32_t coastCount;
+
+  static int32_t blend(int32_t current, int32_t measured, int32_t weightPct);
+  void learnSlope(int32_t tempMilli, uint32_t timeMs, bool heaterOn, bool fanOn);
+
+public:
+  ThermalModel();
+  void reset();
+  void setParams(const ThermalParams& p);
+  const ThermalParams& getParams() const { return params; }
+
+  // Feed each new temperature sample with the relay state it was taken under
+  void observe(int32_t tempMilli, uint32_t timeMs, bool heaterOn, bool fanOn);
+
+  // Predicted temperature after horizonMs holding the given relay state
+  int32_t predict(int32_t tempMilli, uint32_t horizonMs, bool heaterOn, bool fanOn) const;
+  // Expected overshoot if the heater / fan were switched OFF now (m°C, >= 0)
+  int32_t heaterCoast() const { return params.heatCoast > 0 ? params.heatCoast : 0; }
+  int32_t fanCoast() const { return params.fanCoast > 0 ? params.fanCoast : 0; }
+  uint32_t getCoastCount() const { return coastCount; }
+};
+
+#endif
@@ -0,0 +1,91 @@
+
+#include "acquisition.h"
+#include "sensors/ph.h"
+#include "sensors/temp.h"
+#include "config/config.h"
+
+SensorAcquisition::SensorAcquisition(PHSensor* ph, TempSensor* temp) :
+  phSensor(ph), tempSensor(temp), lastPHSample(0),
+  phRate(PH_READ_INTERVAL_MIN, PH_READ_INTERVAL_MAX, PH_STABLE_STEP, PH_STABLE_RATE),
+  tempRate(TEMP_READ_INTERVAL_MIN, TEMP_READ_INTERVAL_MAX, TEMP_STABLE_STEP, TEMP_STABLE_RATE) {
+  current.phMilli = 7000;
+  current.temperature = 25.0f;
+  current.tempMin = 25.0f;
+  current.tempMax = 25.0f;
+  current.probeCount = 0;
+  for (int i = 0; i < TEMP_MAX_PROBES; i++) {
+    current.probeTemp[i] = 25.0f;
+    current.probeValid[i] = false;
+  }
+  current.phTimestamp = 0;
+  current.tempTimestamp = 0;
+  current.phValid = false;
+  current.tempValid = false;
+  current.sequence = 0;
+  snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+SensorSnapshot SensorAcquisition::snapshot() {
+  portENTER_CRITICAL(&snapshotMux);
+  SensorSnapshot copy = current;
+  portEXIT_CRITICAL(&snapshotMux);
+  return copy;
+}
+
+void SensorAcquisition::update() {
+  unsigned long now = millis();
+  SensorSnapshot next = current; // Only this task writes current, so no lock to read it
+  bool changed = false;
+  
+  // Temperature: the sensor runs its own async conversion, we only pick up new results
+  tempSensor->update();
+  if (tempSensor->getLastUpdate() != next.tempTimestamp) {
+    next.temperature = tempSensor->read();
+    next.tempMin = tempSensor->getMin();
+    next.tempMax = tempSensor->getMax();
+    next.probeCount = tempSensor->getProbeCount();
+    for (uint8_t i = 0; i < next.probeCount; i++) {
+      next.probeTemp[i] = tempSensor->getProbeTemp(i);
+      next.probeValid[i] = tempSensor->isProbeValid(i);
+    }
+    next.tempTimestamp = tempSensor->getLastUpdate();
+    changed = true;
+    
+    // Unfiltered: the per-probe median would delay a real step by a whole interval
+    tempRate.observe(toMilli(tempSensor->readUnfiltered()), next.tempTimestamp);
+    tempSensor->setReadInterval(tempRate.getInterval());
+  }
+  
+  // Mark temperature stale if conversions stopped arriving (probe unplugged)
+  bool tempValid = tempSensor->hasReading() &&
+                   !tempRate.isStale(next.tempTimestamp, now, SENSOR_STALE_MARGIN);
+  if (tempValid != next.tempValid) {
+    next.tempValid = tempValid;
+    changed = true;
+  }
+  
+  // pH: one filtered ADC pass per (adaptive) interval
+  if (lastPHSample == 0 || now - lastPHSample >= phRate.getInterval()) {
+    next.phMilli = phSensor->readMilli();
+    next.phTimestamp = now;
+    next.phValid = true;
+    lastPHSample = now;
+    changed = true;
+    
+    // Before the value median: at the 5 s ceiling it would hide a step for ~40 s
+    phRate.observe(phSensor->getUnfilteredMilli(), now);
+  }
+  
+  if (changed) {
+    next.sequence = current.sequence + 1;
+    portENTER_CRITICAL(&snapshotMux);
+    current = next;
+    portEXIT_CRITICAL(&snapshotMux);
+  }
+}
+
+void SensorAcquisition::expectTempChange() {
+  tempRate.kick();
+  tempSensor->setReadInterval(tempRate.getInterval());
+  tempSensor->requestNow();
+}
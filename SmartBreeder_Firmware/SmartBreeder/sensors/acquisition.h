@@ -0,0 +1,56 @@
+#ifndef SENSOR_ACQUISITION_H
+#define SENSOR_ACQUISITION_H
+
+#include <Arduino.h>
+#include "config/config.h"
+#include "sensors/adaptiveRate.h"
+
+// Forward declarations
+class PHSensor;
+class TempSensor;
+
+// Immutable view of the latest sensor values, published once per acquisition pass.
+// Every consumer (control, LCD, API) reads this instead of touching the sensors.
+struct SensorSnapshot {
+  int32_t phMilli;              // Fixed-point pH (7000 = 7.00); convert only for display
+
+  float temperature;            // Mean of all valid probes
+  float tempMin;                // Coldest valid probe
+  float tempMax;                // Hottest valid probe
+  float probeTemp[TEMP_MAX_PROBES];
+  bool probeValid[TEMP_MAX_PROBES];
+  uint8_t probeCount;
+  unsigned long phTimestamp;    // millis() when ph was sampled (0 = never)
+  unsigned long tempTimestamp;  // millis() when temperature was collected (0 = never)
+  bool phValid;
+  bool tempValid;               // false until the first conversion, or when stale
+  uint32_t sequence;            // Incremented on every publish
+  
+  float ph() const { return phMilli * 0.001f; } // JSON/LCD boundary only
+  bool phSafe() const { return phValid && phMilli >= PH_MIN_SAFE && phMilli <= PH_MAX_SAFE; }
+  bool tempSafe() const { return !tempValid || tempMax <= TEMP_MAX_SAFE; }
+};
+
+class SensorAcquisition {
+private:
+  PHSensor* phSensor;
+  TempSensor* tempSensor;
+  SensorSnapshot current;
+  portMUX_TYPE snapshotMux;     // current is written by the control task, copied by loop()
+  unsigned long lastPHSample;
+  AdaptiveRate phRate;
+  AdaptiveRate tempRate;
+  
+public:
+  SensorAcquisition(PHSensor* ph, TempSensor* temp);
+  void update(); // Sample due channels and publish a new snapshot (control task only)
+  SensorSnapshot snapshot(); // Consistent copy, safe from any task
+  
+  // Controllers call these when they expect a transient (dose, heater/fan toggle)
+  void expectPHChange() { phRate.kick(); }
+  void expectTempChange();
+  unsigned long getPHInterval() { return phRate.getInterval(); }
+  unsigned long getTempInterval() { return tempRate.getInterval(); }
+};
+
+#endif
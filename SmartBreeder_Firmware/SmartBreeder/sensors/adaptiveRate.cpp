@@ -0,0 +1,43 @@
+
+#include "adaptiveRate.h"
+
+AdaptiveRate::AdaptiveRate(unsigned long fastest, unsigned long slowest, int32_t stableStep, int32_t stableRate) :
+  fastest(fastest), slowest(slowest), stableStep(stableStep), stableRate(stableRate),
+  interval(fastest), scheduled(fastest), lastValue(0), lastTime(0), seeded(false) {}
+
+void AdaptiveRate::observe(int32_t value, unsigned long now) {
+  if (!seeded) {
+    lastValue = value;
+    lastTime = now;
+    seeded = true;
+    scheduled = interval;
+    return;
+  }
+  
+  unsigned long dt = now - lastTime;
+  if (dt == 0) return;
+  
+  int64_t change = (int64_t)value - lastValue;
+  if (change < 0) change = -change;
+  int64_t ratePerSecond = change * 1000 / (int64_t)dt;
+  
+  if (change > stableStep && ratePerSecond > stableRate) {
+    interval = fastest; // Transient: jump straight to the floor
+  } else {
+    interval += interval >> 1; // Stable: back off by 1.5x per sample
+    if (interval > slowest) interval = slowest;
+  }
+  
+  lastValue = value;
+  lastTime = now;
+  scheduled = interval;
+}
+
+void AdaptiveRate::kick() {
+  interval = fastest;
+}
+
+bool AdaptiveRate::isStale(unsigned long sampleTime, unsigned long now, unsigned long margin) const {
+  unsigned long expected = scheduled > interval ? scheduled : interval;
+  return now - sampleTime >= 2 * expected + margin;
+}
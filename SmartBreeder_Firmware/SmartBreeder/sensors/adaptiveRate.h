@@ -0,0 +1,32 @@
+#ifndef ADAPTIVE_RATE_H
+#define ADAPTIVE_RATE_H
+
+#include <Arduino.h>
+
+// Sampling interval for one sensor channel that follows the signal:
+// drops to the floor interval while the value is moving (or after kick()),
+// and backs off geometrically towards the ceiling while it is stable.
+class AdaptiveRate {
+private:
+  unsigned long fastest;    // Floor interval (ms)
+  unsigned long slowest;    // Ceiling interval (ms)
+  int32_t stableStep;       // Changes up to this are quantisation/noise, never a transient
+  int32_t stableRate;       // Change per second below which the channel counts as stable
+  unsigned long interval;   // Current effective interval
+  unsigned long scheduled;  // Interval set by the last observe(): the next sample is due within it
+  int32_t lastValue;
+  unsigned long lastTime;
+  bool seeded;
+  
+public:
+  // Values, stableStep and stableRate are in the channel's fixed-point unit (milli-pH, m°C)
+  AdaptiveRate(unsigned long fastest, unsigned long slowest, int32_t stableStep, int32_t stableRate);
+  void observe(int32_t value, unsigned long now); // Feed each new sample, before any smoothing
+  void kick();                                  // Expect a transient: sample fast now
+  unsigned long getInterval() { return interval; }
+  // No new sample for two intervals plus margin. Judged by the longer of the current
+  // and the scheduled interval: a kick() doesn't make the sample in hand any older.
+  bool isStale(unsigned long sampleTime, unsigned long now, unsigned long margin) const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+
+#include "adcLinearizer.h"
+#include "config/config.h"
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_cali_scheme.h>
+
+uint16_t ADCLinearizer::table[ADC_RAW_COUNTS];
+bool ADCLinearizer::ready = false;
+
+void ADCLinearizer::begin() {
+  if (ready) return;
+  
+  // Same calibration driver generation as the continuous ADC (IDF 5)
+  adc_cali_line_fitting_config_t config = {};
+  config.unit_id = ADC_UNIT_1;
+  config.atten = ADC_ATTEN_DB_12;
+  config.bitwidth = ADC_BITWIDTH_12;
+  config.default_vref = ADC_DEFAULT_VREF_MV;
+  
+  adc_cali_handle_t cali = nullptr;
+  if (adc_cali_create_scheme_line_fitting(&config, &cali) != ESP_OK) {
+    // Uncalibrated: nominal full scale, still a single table load per sample
+    for (int raw = 0; raw < ADC_RAW_COUNTS; raw++) {
+      table[raw] = (uint16_t)((uint32_t)raw * 3300 / (ADC_RAW_COUNTS - 1));
+    }
+    ready = true;
+    Serial.println("WARNING: ADC calibration unavailable - linear 3.3 V table");
+    return;
+  }
+  
+  for (int raw = 0; raw < ADC_RAW_COUNTS; raw++) {
+    int millivolts = 0;
+    adc_cali_raw_to_voltage(cali, raw, &millivolts);
+    table[raw] = (uint16_t)millivolts;
+  }
+  adc_cali_delete_scheme_line_fitting(cali);
+  ready = true;
+  
+  adc_cali_line_fitting_efuse_val_t source = ADC_CALI_LINE_FITTING_EFUSE_VAL_DEFAULT_VREF;
+  adc_cali_scheme_line_fitting_check_efuse(&source);
+  const char* sourceName = (source == ADC_CALI_LINE_FITTING_EFUSE_VAL_EFUSE_TP)   ? "eFuse two-point" :
+                           (source == ADC_CALI_LINE_FITTING_EFUSE_VAL_EFUSE_VREF) ? "eFuse Vref" : "default Vref";
+  Serial.printf("ADC linearisation table built (%s): 0=%umV, 2048=%umV, 4095=%umV\n",
+                sourceName, table[0], table[2048], table[ADC_RAW_COUNTS - 1]);
+}
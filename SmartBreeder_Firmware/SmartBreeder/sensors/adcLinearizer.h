@@ -0,0 +1,39 @@
+#ifndef ADC_LINEARIZER_H
+#define ADC_LINEARIZER_H
+
+#include <Arduino.h>
+#include "config/config.h"
+
+const int ADC_RAW_COUNTS = 4096; // 12-bit ADC
+
+// Raw 12-bit ADC count -> millivolts, using the chip's eFuse calibration.
+// The IDF line-fitting scheme (eFuse two-point or Vref) is evaluated once for
+// every code at begin(); afterwards a conversion is a single table load with
+// no floating point on the sampling path.
+class ADCLinearizer {
+private:
+  static uint16_t table[ADC_RAW_COUNTS]; // 8 KB, shared by all channels (same atten/width)
+  static bool ready;
+  
+public:
+  // Build the table for ADC1 at 12 dB / 12-bit (same as analogRead() defaults)
+  static void begin();
+  static bool isReady() { return ready; }
+  
+  static inline uint16_t toMillivolts(uint16_t raw) {
+    return table[raw & (ADC_RAW_COUNTS - 1)];
+  }
+  
+  // Oversampled value carrying fracBits extra bits (e.g. 14-bit = raw << 2),
+  // interpolated between neighbouring table entries. Result in microvolts.
+  static inline uint32_t toMicrovolts(uint32_t scaled, uint8_t fracBits) {
+    uint32_t raw = scaled >> fracBits;
+    uint32_t frac = scaled & ((1u << fracBits) - 1);
+    if (raw >= ADC_RAW_COUNTS - 1) return table[ADC_RAW_COUNTS - 1] * 1000u;
+    uint32_t lo = table[raw] * 1000u;
+    uint32_t span = (table[raw + 1] - table[raw]) * 1000u; // Table is monotonic
+    return lo + ((span * frac) >> fracBits);
+  }
+};
+
+#endif
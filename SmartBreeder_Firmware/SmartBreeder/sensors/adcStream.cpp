@@ -0,0 +1,81 @@
+
+#include "adcStream.h"
+#include "config/config.h"
+
+ADCStream* ADCStream::active = nullptr;
+
+ADCStream::ADCStream(uint8_t pin) : pin(pin), running(false), drainTask(nullptr), overruns(0), readAhead(0) {}
+
+bool ADCStream::begin(uint32_t sampleFreqHz, uint32_t conversionsPerSample) {
+  if (active != nullptr && active != this) {
+    Serial.println("ADC stream: continuous driver already in use");
+    return false;
+  }
+  
+  // Same resolution/attenuation as analogRead() so calibration values stay valid
+  analogContinuousSetWidth(12);
+  analogContinuousSetAtten(ADC_11db);
+  
+  uint8_t pins[] = { pin };
+  if (!analogContinuous(pins, 1, conversionsPerSample, sampleFreqHz, &ADCStream::onFrameDone)) {
+    Serial.println("ADC stream: continuous mode init failed");
+    return false;
+  }
+  
+  active = this;
+  if (xTaskCreatePinnedToCore(drainTaskMain, "adc_drain", 2048, this,
+                              configMAX_PRIORITIES - 2, &drainTask, CONTROL_TASK_CORE) != pdPASS) {
+    Serial.println("ADC stream: drain task creation failed");
+    analogContinuousDeinit();
+    active = nullptr;
+    return false;
+  }
+  
+  if (!analogContinuousStart()) {
+    Serial.println("ADC stream: continuous mode start failed");
+    vTaskDelete(drainTask);
+    drainTask = nullptr;
+    analogContinuousDeinit();
+    active = nullptr;
+    return false;
+  }
+  
+  running = true;
+  Serial.printf("ADC stream started on GPIO%d: %lu Hz, %lu conversions/sample\n",
+                pin, sampleFreqHz, conversionsPerSample);
+  return true;
+}
+
+void IRAM_ATTR ADCStream::onFrameDone() {
+  // ISR context: only wake the drain task
+  if (active == nullptr || active->drainTask == nullptr) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(active->drainTask, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void ADCStream::drainTaskMain(void* arg) {
+  ADCStream* self = static_cast<ADCStream*>(arg);
+  for (;;) {
+    self->drain(ulTaskNotifyTake(pdTRUE, portMAX_DELAY));
+  }
+}
+
+void ADCStream::drain(uint32_t signalled) {
+  // Empty the driver's pool in one wake: notifications collapse while the task
+  // waits, so one wake can stand for several frames
+  uint32_t read = 0;
+  adc_continuous_data_t* result = nullptr;
+  while (analogContinuousRead(&result, 0) && result != nullptr) {
+    // One pin configured, so result[0] is our averaged frame
+    ring.push((uint16_t)result[0].avg_read_raw);
+    read++;
+  }
+  
+  // Frames that finish during the loop are read now and notified next wake
+  readAhead += (int32_t)read - (int32_t)signalled;
+  if (readAhead < 0) {
+    overruns += (uint32_t)-readAhead;
+    readAhead = 0;
+  }
+}
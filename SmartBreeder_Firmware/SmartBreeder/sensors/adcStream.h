@@ -0,0 +1,36 @@
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <Arduino.h>
+#include "config/config.h"
+#include "sensors/sampleRing.h"
+
+typedef SampleRing<uint16_t, PH_ADC_RING_SIZE> ADCRing;
+
+// Continuous-mode (DMA) ADC acquisition for a single ADC1 pin.
+// The driver converts in the background; its frame-done ISR wakes a small
+// task that moves each averaged frame into the ring. Consumers never wait.
+class ADCStream {
+private:
+  uint8_t pin;
+  bool running;
+  ADCRing ring;
+  TaskHandle_t drainTask;
+  uint32_t overruns; // Frames the driver signalled but we failed to read
+  int32_t readAhead; // Frames read before their frame-done notification arrived
+  
+  static ADCStream* active; // Continuous driver is a singleton; its ISR has no argument
+  static void IRAM_ATTR onFrameDone();
+  static void drainTaskMain(void* arg);
+  void drain(uint32_t signalled);
+  
+public:
+  ADCStream(uint8_t pin);
+  bool begin(uint32_t sampleFreqHz = PH_ADC_SAMPLE_FREQ,
+             uint32_t conversionsPerSample = PH_ADC_CONVERSIONS_PER_SAMPLE);
+  bool isRunning() { return running; }
+  const ADCRing& samples() { return ring; }
+  uint32_t getOverruns() { return overruns; }
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef SENSOR_FILTERS_H
+#define SENSOR_FILTERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include "sensors/slidingMedian.h"
+
+// Header-only filter stages composed at compile time.
+// Every stage has `T apply(T x)` and `void reset()`; FilterChain nests them
+// by value, so a chain is one flat object with no heap and no virtual calls
+// and the compiler can inline the whole pipeline into the caller.
+//
+// Thresholds are template arguments in milli-units of the channel
+// (e.g. 500 = 0.5 pH or 0.5 °C) so they can be integers.
+
+template <typename T>
+constexpr T fromMilli(long milli) { return (T)milli / (T)1000; }
+template <>
+constexpr int32_t fromMilli<int32_t>(long milli) { return (int32_t)milli; } // Already milli-units
+
+template <typename T>
+inline T absDiff(T a, T b) { return a > b ? a - b : b - a; }
+
+// Running sums/accumulators: 64-bit for integer channels so they neither
+// overflow nor need the sample type's range, the sample type otherwise
+template <typename T>
+using FilterAcc = typename std::conditional<std::is_integral<T>::value, int64_t, T>::type;
+
+// n / d rounded to nearest (half away from zero) for integers, plain division otherwise
+template <typename A>
+inline A divRound(A n, A d) {
+  if (!std::is_integral<A>::value) return n / d;
+  return n >= 0 ? (n + d / 2) / d : -((-n + d / 2) / d);
+}
+
+// Clamp into [MinMilli, MaxMilli]
+template <typename T, long MinMilli, long MaxMilli>
+class ClampFilter {
+public:
+  inline T apply(T x) {
+    const T lo = fromMilli<T>(MinMilli), hi = fromMilli<T>(MaxMilli);
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+  }
+  void reset() {}
+};
+
+// Running median of the last N samples (median of what we have until full)
+template <typename T, size_t N>
+class MedianFilter {
+private:
+  SlidingMedian<T, N> window;
+public:
+  inline T apply(T x) {
+    window.push(x);
+    return window.median();
+  }
+  void reset() { window.reset(); }
+};
+
+// Exponential moving average, alpha = AlphaNum / AlphaDen (first sample seeds it).
+// Integer channels keep the average scaled by AlphaDen and round each step, so
+// the output reaches a constant input exactly instead of stalling short of it.
+template <typename T, long AlphaNum, long AlphaDen>
+class EmaFilter {
+  static_assert(AlphaNum > 0 && AlphaNum <= AlphaDen, "EMA alpha must be in (0, 1]");
+private:
+  typedef FilterAcc<T> Acc;
+  Acc scaled; // Average * AlphaDen
+  bool seeded;
+public:
+  EmaFilter() : scaled(0), seeded(false) {}
+  inline T apply(T x) {
+    const Acc in = (Acc)x * (Acc)AlphaDen;
+    if (!seeded) {
+      scaled = in;
+      seeded = true;
+    } else {
+      scaled += divRound<Acc>((in - scaled) * (Acc)AlphaNum, (Acc)AlphaDen);
+    }
+    return (T)divRound<Acc>(scaled, (Acc)AlphaDen);
+  }
+  void reset() { seeded = false; }
+};
+
+// Arithmetic mean of the last N samples (running sum, O(1) per sample)
+template <typename T, size_t N>
+class MovingAverage {
+  static_assert(N > 0, "MovingAverage window must not be empty");
+private:
+  T ring[N];
+  FilterAcc<T> sum;
+  size_t head;
+  size_t count;
+public:
+  MovingAverage() : sum(0), head(0), count(0) {}
+  inline T apply(T x) {
+    if (count == N) {
+      sum -= ring[head];
+    } else {
+      count++;
+    }
+    ring[head] = x;
+    sum += x;
+    head = (head + 1 == N) ? 0 : head + 1;
+    return (T)divRound<FilterAcc<T>>(sum, (FilterAcc<T>)count);
+  }
+  void reset() { sum = 0; head = 0; count = 0; }
+};
+
+// Hold the last accepted value when a sample jumps more than MaxDevMilli.
+// After MaxRejects consecutive rejections the jump is accepted as a real step.
+template <typename T, long MaxDevMilli, int MaxRejects>
+class OutlierReject {
+private:
+  T last;
+  bool seeded;
+  int rejected;
+public:
+  OutlierReject() : last(0), seeded(false), rejected(0) {}
+  inline T apply(T x) {
+    if (seeded && absDiff(x, last) > fromMilli<T>(MaxDevMilli) && rejected < MaxRejects) {
+      rejected++;
+      return last;
+    }
+    rejected = 0;
+    seeded = true;
+    last = x;
+    return x;
+  }
+  void reset() { seeded = false; rejected = 0; }
+};
+
+// Limit the output change per sample to MaxStepMilli
+template <typename T, long MaxStepMilli>
+class RateLimiter {
+private:
+  T value;
+  bool seeded;
+public:
+  RateLimiter() : value(0), seeded(false) {}
+  inline T apply(T x) {
+    const T step = fromMilli<T>(MaxStepMilli);
+    if (!seeded) {
+      value = x;
+      seeded = true;
+    } else if (absDiff(x, value) <= step) {
+      value = x;
+    } else {
+      value = x > value ? value + step : value - step; // No wrap for unsigned T
+    }
+    return value;
+  }
+  void reset() { seeded = false; }
+};
+
+// Stages run left to right: FilterChain<T, A, B, C>::apply(x) == C(B(A(x)))
+template <typename T, typename... Stages>
+class FilterChain;
+
+template <typename T>
+class FilterChain<T> {
+public:
+  static constexpr size_t stageCount = 0;
+  inline T apply(T x) { return x; }
+  void reset() {}
+};
+
+template <typename T, typename First, typename... Rest>
+class FilterChain<T, First, Rest...> {
+private:
+  First first;
+  FilterChain<T, Rest...> rest;
+public:
+  static constexpr size_t stageCount = 1 + sizeof...(Rest);
+  inline T apply(T x) { return rest.apply(first.apply(x)); }
+  void reset() {
+    first.reset();
+    rest.reset();
+  }
+};
+
+#endif
@@ -0,0 +1,208 @@
+
+#include "history.h"
+#include "config/config.h"
+
+static int16_t clampSample(int32_t value) {
+  if (value <= HISTORY_NO_DATA) return HISTORY_NO_DATA + 1;
+  if (value > INT16_MAX) return INT16_MAX;
+  return (int16_t)value;
+}
+
+void HistoryAccumulator::reset(uint32_t newSlot) {
+  slot = newSlot;
+  open = true;
+  phSum = tempSum = 0;
+  phCount = tempCount = samples = heaterOn = fanOn = 0;
+  phMin = tempMin = INT16_MAX;
+  phMax = tempMax = INT16_MIN;
+}
+
+void HistoryAccumulator::add(const HistorySample& sample) {
+  samples++;
+  if (sample.relays & relayBit(REL_WATER_HEATER)) heaterOn++;
+  if (sample.relays & relayBit(REL_COOLER_FAN)) fanOn++;
+  if (sample.phMilli != HISTORY_NO_DATA) {
+    phSum += sample.phMilli;
+    phCount++;
+    if (sample.phMilli < phMin) phMin = sample.phMilli;
+    if (sample.phMilli > phMax) phMax = sample.phMilli;
+  }
+  if (sample.tempCenti != HISTORY_NO_DATA) {
+    tempSum += sample.tempCenti;
+    tempCount++;
+    if (sample.tempCenti < tempMin) tempMin = sample.tempCenti;
+    if (sample.tempCenti > tempMax) tempMax = sample.tempCenti;
+  }
+}
+
+HistoryBucket HistoryAccumulator::close() const {
+  HistoryBucket bucket = {
+    HISTORY_NO_DATA, HISTORY_NO_DATA, HISTORY_NO_DATA,
+    HISTORY_NO_DATA, HISTORY_NO_DATA, HISTORY_NO_DATA, 0, 0
+  };
+  if (phCount > 0) {
+    bucket.phMin = phMin;
+    bucket.phMax = phMax;
+    bucket.phMean = (int16_t)(phSum / phCount);
+  }
+  if (tempCount > 0) {
+    bucket.tempMin = tempMin;
+    bucket.tempMax = tempMax;
+    bucket.tempMean = (int16_t)(tempSum / tempCount);
+  }
+  if (samples > 0) {
+    bucket.heaterDuty = (uint8_t)((uint32_t)heaterOn * 100 / samples);
+    bucket.fanDuty = (uint8_t)((uint32_t)fanOn * 100 / samples);
+  }
+  return bucket;
+}
+
+History::History() :
+  raw(rawBlocks, HISTORY_RAW_BLOCKS, HRAW_CHANNELS),
+  minute(minuteBlocks, HISTORY_MINUTE_BLOCKS, HBKT_CHANNELS),
+  quarter(quarterBlocks, HISTORY_QUARTER_BLOCKS, HBKT_CHANNELS),
+  lastSecond(0), started(false), recorded(0), restarts(0) {
+  minuteAcc.open = false;
+  quarterAcc.open = false;
+}
+
+uint32_t History::periodOf(HistoryTier tier) {
+  switch (tier) {
+    case HISTORY_MINUTE: return HISTORY_MINUTE_S;
+    case HISTORY_QUARTER: return HISTORY_QUARTER_S;
+    default: return 1;
+  }
+}
+
+uint32_t History::spanOf(HistoryTier tier) {
+  switch (tier) {
+    case HISTORY_MINUTE: return HISTORY_MINUTE_SPAN;
+    case HISTORY_QUARTER: return HISTORY_QUARTER_SPAN;
+    default: return HISTORY_RAW_SPAN;
+  }
+}
+
+uint32_t History::coverageS(HistoryTier tier) const {
+  const HistoryStream& stream = getStream(tier);
+  if (stream.size() == 0) return 0;
+  return (stream.newestSlot() - stream.oldestSlot() + 1) * periodOf(tier);
+}
+
+// First slot still inside the span that ends at slot
+static uint32_t spanStart(uint32_t slot, uint32_t span) {
+  return slot >= span ? slot - span + 1 : 0;
+}
+
+const HistoryStream& History::getStream(HistoryTier tier) const {
+  switch (tier) {
+    case HISTORY_MINUTE: return minute;
+    case HISTORY_QUARTER: return quarter;
+    default: return raw;
+  }
+}
+
+size_t History::encodedBytes() const {
+  return raw.encodedBytes() + minute.encodedBytes() + quarter.encodedBytes();
+}
+
+HistorySample History::toSample(const HistoryRecord& record) {
+  HistorySample sample;
+  sample.phMilli = record.values[HRAW_PH];
+  sample.tempCenti = record.values[HRAW_TEMP];
+  sample.relays = (uint8_t)record.values[HRAW_RELAYS];
+  return sample;
+}
+
+// Buckets are stored in coarser steps than samples. Means round to the nearest
+// step; spreads round outward, so the decoded min/max still bound every sample.
+static int16_t quantise(int16_t value, int16_t step) {
+  int32_t half = value >= 0 ? step / 2 : -(step / 2);
+  return (int16_t)((value + half) / step);
+}
+
+static int16_t quantiseSpread(int32_t spread, int16_t step) {
+  return (int16_t)((spread + step - 1) / step);
+}
+
+static int16_t expand(int16_t mean, int16_t offset, int16_t step) {
+  return mean == HISTORY_NO_DATA ? HISTORY_NO_DATA : clampSample((int32_t)(mean + offset) * step);
+}
+
+HistoryBucket History::toBucket(const HistoryRecord& record) {
+  const int16_t* v = record.values;
+  HistoryBucket bucket;
+  bucket.phMean = expand(v[HBKT_PH_MEAN], 0, HISTORY_BUCKET_PH_STEP);
+  bucket.phMin = expand(v[HBKT_PH_MEAN], -v[HBKT_PH_LOW], HISTORY_BUCKET_PH_STEP);
+  bucket.phMax = expand(v[HBKT_PH_MEAN], v[HBKT_PH_HIGH], HISTORY_BUCKET_PH_STEP);
+  bucket.tempMean = expand(v[HBKT_TEMP_MEAN], 0, HISTORY_BUCKET_TEMP_STEP);
+  bucket.tempMin = expand(v[HBKT_TEMP_MEAN], -v[HBKT_TEMP_LOW], HISTORY_BUCKET_TEMP_STEP);
+  bucket.tempMax = expand(v[HBKT_TEMP_MEAN], v[HBKT_TEMP_HIGH], HISTORY_BUCKET_TEMP_STEP);
+  bucket.heaterDuty = (uint8_t)(v[HBKT_HEATER] * HISTORY_BUCKET_DUTY_STEP);
+  bucket.fanDuty = (uint8_t)(v[HBKT_FAN] * HISTORY_BUCKET_DUTY_STEP);
+  return bucket;
+}
+
+void History::roll(HistoryAccumulator& acc, HistoryStream& stream, uint32_t slot, uint32_t span) {
+  if (acc.open && slot == acc.slot) return;
+  if (acc.open && acc.samples > 0) {
+    HistoryBucket bucket = acc.close();
+    HistoryRecord record;
+    record.slot = acc.slot;
+    int16_t* v = record.values;
+    v[HBKT_PH_MEAN] = v[HBKT_PH_LOW] = v[HBKT_PH_HIGH] = HISTORY_NO_DATA;
+    v[HBKT_TEMP_MEAN] = v[HBKT_TEMP_LOW] = v[HBKT_TEMP_HIGH] = HISTORY_NO_DATA;
+    if (bucket.phMean != HISTORY_NO_DATA) {
+      int16_t mean = quantise(bucket.phMean, HISTORY_BUCKET_PH_STEP);
+      v[HBKT_PH_MEAN] = mean;
+      v[HBKT_PH_LOW] = quantiseSpread(mean * HISTORY_BUCKET_PH_STEP - bucket.phMin, HISTORY_BUCKET_PH_STEP);
+      v[HBKT_PH_HIGH] = quantiseSpread(bucket.phMax - mean * HISTORY_BUCKET_PH_STEP, HISTORY_BUCKET_PH_STEP);
+    }
+    if (bucket.tempMean != HISTORY_NO_DATA) {
+      int16_t mean = quantise(bucket.tempMean, HISTORY_BUCKET_TEMP_STEP);
+      v[HBKT_TEMP_MEAN] = mean;
+      v[HBKT_TEMP_LOW] = quantiseSpread(mean * HISTORY_BUCKET_TEMP_STEP - bucket.tempMin, HISTORY_BUCKET_TEMP_STEP);
+      v[HBKT_TEMP_HIGH] = quantiseSpread(bucket.tempMax - mean * HISTORY_BUCKET_TEMP_STEP, HISTORY_BUCKET_TEMP_STEP);
+    }
+    v[HBKT_HEATER] = quantise(bucket.heaterDuty, HISTORY_BUCKET_DUTY_STEP);
+    v[HBKT_FAN] = quantise(bucket.fanDuty, HISTORY_BUCKET_DUTY_STEP);
+    stream.append(record);
+  }
+  stream.dropBefore(spanStart(slot, span));
+  acc.reset(slot);
+}
+
+void History::restart() {
+  raw.clear();
+  minute.clear();
+  quarter.clear();
+  minuteAcc.open = false;
+  quarterAcc.open = false;
+  started = false;
+  restarts++;
+}
+
+void History::record(uint32_t second, bool phValid, int32_t phMilli, bool tempValid, int32_t tempMilli, uint8_t relays) {
+  if (started && second == lastSecond) return;
+  if (started && second < lastSecond) restart(); // Kept history would never age out
+
+  HistorySample sample;
+  sample.phMilli = phValid ? clampSample(phMilli) : HISTORY_NO_DATA;
+  sample.tempCenti = tempValid ? clampSample(tempMilli / 10) : HISTORY_NO_DATA;
+  sample.relays = relays;
+
+  HistoryRecord record;
+  record.slot = second;
+  record.values[HRAW_PH] = sample.phMilli;
+  record.values[HRAW_TEMP] = sample.tempCenti;
+  record.values[HRAW_RELAYS] = sample.relays;
+  raw.append(record);
+  raw.dropBefore(spanStart(second, HISTORY_RAW_SPAN));
+  lastSecond = second;
+  started = true;
+  recorded++;
+
+  roll(minuteAcc, minute, second / HISTORY_MINUTE_S, HISTORY_MINUTE_SPAN);
+  minuteAcc.add(sample);
+  roll(quarterAcc, quarter, second / HISTORY_QUARTER_S, HISTORY_QUARTER_SPAN);
+  quarterAcc.add(sample);
+}
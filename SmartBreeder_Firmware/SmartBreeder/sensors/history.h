@@ -0,0 +1,119 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config/config.h"
+#include "sensors/historyCodec.h"
+
+const int16_t HISTORY_NO_DATA = INT16_MIN; // No valid reading in the slot
+
+enum HistoryTier : uint8_t {
+  HISTORY_RAW,      // 1 s samples
+  HISTORY_MINUTE,   // HISTORY_MINUTE_S buckets
+  HISTORY_QUARTER,  // HISTORY_QUARTER_S buckets
+  HISTORY_TIER_COUNT
+};
+
+// One 1 s reading
+struct HistorySample {
+  int16_t phMilli;
+  int16_t tempCenti;   // 0.01 °C; mean of the valid probes
+  uint8_t relays;      // RelayBank mask when sampled
+};
+
+// One aggregated interval
+struct HistoryBucket {
+  int16_t phMin;
+  int16_t phMax;
+  int16_t phMean;
+  int16_t tempMin;
+  int16_t tempMax;
+  int16_t tempMean;
+  uint8_t heaterDuty;  // % of the sampled seconds ON
+  uint8_t fanDuty;
+};
+
+// Running min/max/mean and relay duty of the open bucket of one tier
+struct HistoryAccumulator {
+  uint32_t slot;
+  bool open;
+  int32_t phSum;
+  int32_t tempSum;
+  uint16_t phCount;
+  uint16_t tempCount;
+  uint16_t samples;
+  uint16_t heaterOn;
+  uint16_t fanOn;
+  int16_t phMin;
+  int16_t phMax;
+  int16_t tempMin;
+  int16_t tempMax;
+
+  void reset(uint32_t newSlot);
+  void add(const HistorySample& sample);
+  HistoryBucket close() const;
+};
+
+// Channels of the encoded records
+enum HistoryRawChannel : uint8_t { HRAW_PH, HRAW_TEMP, HRAW_RELAYS, HRAW_CHANNELS };
+enum HistoryBucketChannel : uint8_t {
+  HBKT_PH_MEAN, HBKT_PH_LOW, HBKT_PH_HIGH,        // Min/max as spreads below/above the mean:
+  HBKT_TEMP_MEAN, HBKT_TEMP_LOW, HBKT_TEMP_HIGH,  // they change less between buckets than min/max do
+  HBKT_HEATER, HBKT_FAN, HBKT_CHANNELS
+};
+
+// Raw records per block when nothing compresses: the first is stored raw, the
+// rest take a 35-bit slot escape and a 20-bit escape per value
+constexpr uint32_t HISTORY_RAW_WORST_PER_BLOCK =
+  1 + (HISTORY_BLOCK_BYTES * 8 - (32 + HRAW_CHANNELS * 16)) / (35 + HRAW_CHANNELS * 20);
+// A full ring has just started a new block, so the span must fit in the others
+static_assert((HISTORY_RAW_BLOCKS - 1) * HISTORY_RAW_WORST_PER_BLOCK >= HISTORY_RAW_SPAN,
+              "Raw history must hold its span even when nothing compresses");
+
+// pH, temperature and relay history at three resolutions, fed once a second.
+// Each tier is a HistoryStream of compressed blocks (see historyCodec.h) in
+// fixed arrays inside this object, so sizeof(History) is the whole footprint.
+// A tier keeps at most its span (plus the rest of its oldest block); how much
+// of the span fits depends on how well the signal compresses: see coverageS().
+// Seconds are uptime seconds and must only increase (slots are delta-coded and
+// dropped by age); slots with no sample at all are simply absent.
+class History {
+private:
+  HistoryBlock rawBlocks[HISTORY_RAW_BLOCKS];
+  HistoryBlock minuteBlocks[HISTORY_MINUTE_BLOCKS];
+  HistoryBlock quarterBlocks[HISTORY_QUARTER_BLOCKS];
+  HistoryStream raw;
+  HistoryStream minute;
+  HistoryStream quarter;
+  HistoryAccumulator minuteAcc;
+  HistoryAccumulator quarterAcc;
+  uint32_t lastSecond;
+  bool started;
+  uint32_t recorded;
+  uint32_t restarts;
+
+  static void roll(HistoryAccumulator& acc, HistoryStream& stream, uint32_t slot, uint32_t span);
+  void restart();
+
+public:
+  History();
+
+  // Call once per second; a repeated second is ignored, an earlier one
+  // (clock went backwards) drops every tier and starts over from it
+  void record(uint32_t second, bool phValid, int32_t phMilli, bool tempValid, int32_t tempMilli, uint8_t relays);
+
+  const HistoryStream& getStream(HistoryTier tier) const;
+  uint32_t getRecorded() const { return recorded; }
+  uint32_t getRestarts() const { return restarts; }
+  size_t encodedBytes() const;
+  uint32_t coverageS(HistoryTier tier) const; // Seconds from the oldest to the newest slot held
+  static uint32_t periodOf(HistoryTier tier);
+  static uint32_t spanOf(HistoryTier tier);   // Slots the tier keeps at most
+
+  // Decoded record -> values, for readers walking a HistoryCursor
+  static HistorySample toSample(const HistoryRecord& record);
+  static HistoryBucket toBucket(const HistoryRecord& record);
+};
+
+#endif
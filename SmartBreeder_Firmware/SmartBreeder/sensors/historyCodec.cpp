@@ -0,0 +1,244 @@
+
+#include "historyCodec.h"
+#include <string.h>
+
+static const uint32_t BLOCK_BITS = (uint32_t)HISTORY_BLOCK_BYTES * 8;
+
+static inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t unzigzag(uint32_t z) { return (int32_t)(z >> 1) ^ -(int32_t)(z & 1); }
+
+// MSB-first into bytes that are still zero; false (nothing past the end touched) if it does not fit.
+// A record that fails part-way leaves stray bits after block->bits; the block is full from then on.
+static bool putBits(uint8_t* data, uint32_t& pos, uint32_t value, uint8_t n) {
+  if (pos + n > BLOCK_BITS) return false;
+  while (n > 0) {
+    uint8_t room = 8 - (pos & 7);
+    uint8_t take = n < room ? n : room;
+    uint8_t chunk = (uint8_t)((value >> (n - take)) & ((1U << take) - 1));
+    data[pos >> 3] |= (uint8_t)(chunk << (room - take));
+    pos += take;
+    n -= take;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------- encoder
+
+void HistoryEncoder::start(HistoryBlock* target, uint8_t channelCount) {
+  block = target;
+  channels = channelCount <= HISTORY_MAX_CHANNELS ? channelCount : HISTORY_MAX_CHANNELS;
+  memset(block, 0, sizeof(HistoryBlock));
+  prevSlot = 0;
+  prevDelta = 1;
+}
+
+bool HistoryEncoder::append(const HistoryRecord& record) {
+  uint32_t pos = block->bits;
+  bool ok = true;
+
+  if (block->count == 0) {
+    // First record raw: the block decodes without any earlier state
+    ok = putBits(block->data, pos, record.slot, 32);
+    for (uint8_t c = 0; ok && c < channels; c++) {
+      ok = putBits(block->data, pos, (uint16_t)record.values[c], 16);
+    }
+  } else {
+    int32_t delta = (int32_t)(record.slot - prevSlot);
+    uint32_t z = zigzag(delta - prevDelta);
+    if (z == 0) {
+      ok = putBits(block->data, pos, 0, 1);
+    } else if (z < (1U << 7)) {
+      ok = putBits(block->data, pos, 0x2, 2) && putBits(block->data, pos, z, 7);
+    } else if (z < (1U << 12)) {
+      ok = putBits(block->data, pos, 0x6, 3) && putBits(block->data, pos, z, 12);
+    } else {
+      ok = putBits(block->data, pos, 0x7, 3) && putBits(block->data, pos, record.slot, 32);
+    }
+
+    for (uint8_t c = 0; ok && c < channels; c++) {
+      int16_t v = record.values[c];
+      z = zigzag((int32_t)v - prev[c]);
+      if (z == 0) {
+        ok = putBits(block->data, pos, 0, 1);
+      } else if (z < (1U << 3)) {
+        ok = putBits(block->data, pos, 0x2, 2) && putBits(block->data, pos, z, 3);
+      } else if (z < (1U << 6)) {
+        ok = putBits(block->data, pos, 0x6, 3) && putBits(block->data, pos, z, 6);
+      } else if (z < (1U << 9)) {
+        ok = putBits(block->data, pos, 0xE, 4) && putBits(block->data, pos, z, 9);
+      } else {
+        ok = putBits(block->data, pos, 0xF, 4) && putBits(block->data, pos, (uint16_t)v, 16);
+      }
+    }
+  }
+  if (!ok) return false;
+
+  if (block->count == 0) {
+    block->firstSlot = record.slot;
+  } else {
+    prevDelta = (int32_t)(record.slot - prevSlot);
+  }
+  prevSlot = record.slot;
+  memcpy(prev, record.values, sizeof(int16_t) * channels);
+  block->lastSlot = record.slot;
+  block->bits = (uint16_t)pos;
+  block->count++;
+  return true;
+}
+
+// ---------------------------------------------------------------- decoder
+
+void HistoryDecoder::begin(const HistoryBlock* source, uint8_t channelCount) {
+  block = source;
+  channels = channelCount <= HISTORY_MAX_CHANNELS ? channelCount : HISTORY_MAX_CHANNELS;
+  index = 0;
+  pos = 0;
+  prevSlot = 0;
+  prevDelta = 1;
+}
+
+uint32_t HistoryDecoder::read(uint8_t n) {
+  uint32_t value = 0;
+  while (n > 0) {
+    uint8_t room = 8 - (pos & 7);
+    uint8_t take = n < room ? n : room;
+    uint8_t chunk = (uint8_t)(block->data[pos >> 3] >> (room - take)) & (uint8_t)((1U << take) - 1);
+    value = (value << take) | chunk;
+    pos += take;
+    n -= take;
+  }
+  return value;
+}
+
+uint8_t HistoryDecoder::prefix(uint8_t max) {
+  uint8_t ones = 0;
+  while (ones < max && read(1)) ones++;
+  return ones;
+}
+
+bool HistoryDecoder::next(HistoryRecord& record) {
+  if (done()) return false;
+
+  if (index == 0) {
+    record.slot = read(32);
+    for (uint8_t c = 0; c < channels; c++) {
+      record.values[c] = (int16_t)read(16);
+    }
+  } else {
+    switch (prefix(3)) {
+      case 0: record.slot = prevSlot + prevDelta; break;
+      case 1: record.slot = prevSlot + prevDelta + unzigzag(read(7)); break;
+      case 2: record.slot = prevSlot + prevDelta + unzigzag(read(12)); break;
+      default: record.slot = read(32); break;
+    }
+    for (uint8_t c = 0; c < channels; c++) {
+      switch (prefix(4)) {
+        case 0: record.values[c] = prev[c]; break;
+        case 1: record.values[c] = (int16_t)(prev[c] + unzigzag(read(3))); break;
+        case 2: record.values[c] = (int16_t)(prev[c] + unzigzag(read(6))); break;
+        case 3: record.values[c] = (int16_t)(prev[c] + unzigzag(read(9))); break;
+        default: record.values[c] = (int16_t)read(16); break;
+      }
+    }
+    prevDelta = (int32_t)(record.slot - prevSlot);
+  }
+  for (uint8_t c = channels; c < HISTORY_MAX_CHANNELS; c++) {
+    record.values[c] = 0;
+  }
+  prevSlot = record.slot;
+  memcpy(prev, record.values, sizeof(int16_t) * channels);
+  index++;
+  return true;
+}
+
+// ---------------------------------------------------------------- stream
+
+HistoryStream::HistoryStream(HistoryBlock* storage, uint16_t blockCount, uint8_t channelCount) :
+  blocks(storage), capacity(blockCount), channels(channelCount), newest(0), used(0), records(0) {}
+
+void HistoryStream::append(const HistoryRecord& record) {
+  if (capacity == 0) return;
+  if (used == 0) {
+    newest = 0;
+    used = 1;
+    encoder.start(&blocks[newest], channels);
+  }
+  if (!encoder.append(record)) {
+    newest = (newest + 1) % capacity;
+    if (used < capacity) {
+      used++;
+    } else {
+      records -= blocks[newest].count; // Oldest block dropped
+    }
+    encoder.start(&blocks[newest], channels);
+    encoder.append(record); // Always fits an empty block
+  }
+  records++;
+}
+
+void HistoryStream::dropBefore(uint32_t slot) {
+  while (used > 1 && getBlock(0).lastSlot < slot) {
+    records -= getBlock(0).count;
+    used--;
+  }
+}
+
+void HistoryStream::clear() {
+  used = 0;
+  records = 0;
+}
+
+const HistoryBlock& HistoryStream::getBlock(uint16_t i) const {
+  uint16_t oldest = (uint16_t)((newest + 1 + capacity - used) % capacity);
+  return blocks[(oldest + i) % capacity];
+}
+
+size_t HistoryStream::encodedBytes() const {
+  size_t bytes = 0;
+  for (uint16_t i = 0; i < used; i++) {
+    bytes += (getBlock(i).bits + 7) / 8 + (sizeof(HistoryBlock) - HISTORY_BLOCK_BYTES);
+  }
+  return bytes;
+}
+
+// ---------------------------------------------------------------- cursor
+
+HistoryCursor::HistoryCursor(const HistoryStream& stream) : stream(stream), blockIndex(0) {
+  if (stream.getBlockCount() > 0) {
+    decoder.begin(&stream.getBlock(0), stream.getChannels());
+  }
+}
+
+void HistoryCursor::seek(uint32_t slot) {
+  uint16_t target = blockIndex;
+  while (target + 1 < stream.getBlockCount() && stream.getBlock(target).lastSlot < slot) {
+    target++;
+  }
+  if (target != blockIndex) {
+    blockIndex = target;
+    decoder.begin(&stream.getBlock(blockIndex), stream.getChannels());
+  }
+}
+
+void HistoryCursor::skip(uint32_t count) {
+  // Whole blocks by their record count, only the last partial block is decoded
+  while (count > 0 && blockIndex + 1 < stream.getBlockCount() && decoder.index == 0 &&
+         stream.getBlock(blockIndex).count <= count) {
+    count -= stream.getBlock(blockIndex).count;
+    blockIndex++;
+    decoder.begin(&stream.getBlock(blockIndex), stream.getChannels());
+  }
+  HistoryRecord discard;
+  while (count > 0 && next(discard)) {
+    count--;
+  }
+}
+
+bool HistoryCursor::next(HistoryRecord& record) {
+  while (decoder.done()) {
+    if (blockIndex + 1 >= stream.getBlockCount()) return false;
+    blockIndex++;
+    decoder.begin(&stream.getBlock(blockIndex), stream.getChannels());
+  }
+  return decoder.next(record);
+}
@@ -0,0 +1,115 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Gorilla-style streaming compression for History. Plain C++ (no Arduino/ESP-IDF),
+// so a recorded trace can be round-tripped and timed on the host.
+//
+// A record is a slot number plus up to HISTORY_MAX_CHANNELS quantised int16
+// values. Records go into fixed-size blocks as a bit stream:
+//   - the first record of a block is stored raw, so every block decodes alone
+//   - slots as delta-of-delta: a steady 1-per-slot stream costs one bit
+//   - values as zigzag deltas from the previous record, in 1/5/9/13 bits,
+//     or a 20-bit raw escape (large jumps, HISTORY_NO_DATA)
+// Blocks are appended to and read only in order; decoding is lazy, one record
+// at a time, so queries never need a decoded copy of the history.
+
+constexpr uint16_t HISTORY_BLOCK_BYTES = 256;
+constexpr uint8_t HISTORY_MAX_CHANNELS = 8;
+
+struct HistoryBlock {
+  uint32_t firstSlot;
+  uint32_t lastSlot;
+  uint16_t count;      // Records in the block
+  uint16_t bits;       // Bits of data in use
+  uint8_t data[HISTORY_BLOCK_BYTES];
+};
+
+struct HistoryRecord {
+  uint32_t slot;
+  int16_t values[HISTORY_MAX_CHANNELS];
+};
+
+// Appends records to one block
+class HistoryEncoder {
+private:
+  HistoryBlock* block;
+  uint8_t channels;
+  uint32_t prevSlot;
+  int32_t prevDelta;
+  int16_t prev[HISTORY_MAX_CHANNELS];
+
+public:
+  HistoryEncoder() : block(nullptr), channels(0), prevSlot(0), prevDelta(0) {}
+  void start(HistoryBlock* target, uint8_t channelCount); // Empties the block
+  bool append(const HistoryRecord& record); // false (block unchanged) once it is full
+};
+
+// Reads one block back, oldest record first
+class HistoryDecoder {
+private:
+  const HistoryBlock* block;
+  uint8_t channels;
+  uint16_t index;
+  uint32_t pos;        // Bit position
+  uint32_t prevSlot;
+  int32_t prevDelta;
+  int16_t prev[HISTORY_MAX_CHANNELS];
+
+  uint32_t read(uint8_t n);
+  uint8_t prefix(uint8_t max); // Leading 1 bits, stops after max
+  bool done() const { return block == nullptr || index >= block->count; }
+  friend class HistoryCursor;
+
+public:
+  HistoryDecoder() : block(nullptr), channels(0), index(0), pos(0), prevSlot(0), prevDelta(0) {}
+  void begin(const HistoryBlock* source, uint8_t channelCount);
+  bool next(HistoryRecord& record);
+};
+
+// Ring of blocks over caller-provided storage: the newest block is being
+// filled; when all are in use, or by dropBefore(), the oldest is dropped whole.
+class HistoryStream {
+private:
+  HistoryBlock* blocks;
+  uint16_t capacity;
+  uint8_t channels;
+  uint16_t newest;     // Block being filled
+  uint16_t used;
+  uint32_t records;    // Records in the stored blocks
+  HistoryEncoder encoder;
+
+public:
+  HistoryStream(HistoryBlock* storage, uint16_t blockCount, uint8_t channelCount);
+
+  void append(const HistoryRecord& record);
+  void dropBefore(uint32_t slot); // Drop oldest blocks ending before slot (never the newest)
+  void clear();                   // Drop every block
+
+  uint8_t getChannels() const { return channels; }
+  uint16_t getBlockCount() const { return used; }
+  const HistoryBlock& getBlock(uint16_t i) const; // 0 = oldest
+  uint32_t size() const { return records; }
+  uint32_t oldestSlot() const { return used ? getBlock(0).firstSlot : 0; }
+  uint32_t newestSlot() const { return used ? blocks[newest].lastSlot : 0; }
+  size_t encodedBytes() const; // Data bytes in use, headers included
+  size_t storageBytes() const { return (size_t)capacity * sizeof(HistoryBlock); }
+};
+
+// Walks a stream oldest first, decoding one block at a time
+class HistoryCursor {
+private:
+  const HistoryStream& stream;
+  uint16_t blockIndex;
+  HistoryDecoder decoder;
+
+public:
+  explicit HistoryCursor(const HistoryStream& stream);
+  void seek(uint32_t slot);   // Skip blocks that end before slot; earlier records in its block still follow
+  void skip(uint32_t count);  // Skip count records, whole blocks without decoding them
+  bool next(HistoryRecord& record);
+};
+
+#endif
@@ -1,90 +1,74 @@
 #include "ph.h"
 #include "config/config.h"
-#include <string.h> // For memcpy
-
-// Pre-calculated constants for performance
-#define ADC_TO_VOLTAGE (3.3f / 4095.0f)  // ESP32 12-bit ADC conversion factor
-#define PH_RANGE (7.0f - 4.0f)           // pH range between calibration points (3.0)
-#define PH_NEUTRAL 7.0f                  // Neutral pH value
-#define PH_MAX 14.0f                     // Maximum pH value
-#define PH_MIN 0.0f                      // Minimum pH value
-
-PHSensor::PHSensor(int pin) : pin(pin), ph7Voltage(2.50f), ph4Voltage(3.00f), 
-                               sampleIndex(0), bufferFilled(false) {
-  // Default offset will be loaded from preferences in loadCalibration()
-  // If not found, default to -0.5f (maximum allowed)
-  offset = -0.5f;
+#include "config/configCache.h"
+
+// Fixed-point constants (milli-pH / microvolts)
+#define PH_RANGE_MILLI (7000 - 4000)     // pH range between calibration points (3.000)
+#define PH_NEUTRAL_MILLI 7000            // Neutral pH value
+#define PH_OFFSET_MIN_MILLI -500         // Offset must be >= -0.5 pH
+#define PH_MIN_CAL_SPAN_UV 10000         // Calibration points closer than 10mV are unusable
+#define PH_DEFAULT_SLOPE_Q (int32_t)((6LL << PH_SLOPE_FRAC_BITS) / 1000) // 6.0 pH/V = 0.006 mpH/uV
+
+PHSensor::PHSensor(int pin) : pin(pin), adc(pin), ph7Microvolts(2500000), ph4Microvolts(3000000), 
+                               lastADC(0), lastUnfilteredMilli(PH_NEUTRAL_MILLI), adcCursor(0),
+                               mode(PH_MODE_MEDIAN) {
+  // Default offset will be loaded from the config cache in loadCalibration()
+  // If not found, default to -0.5 (maximum allowed)
+  offsetMilli = PH_OFFSET_MIN_MILLI;
   calculateSlope(); // Calculate initial slope
-  
-  // Initialize sample buffer
-  for (int i = 0; i < PH_MEDIAN_SAMPLES; i++) {
-    samples[i] = 7.0f;
-  }
 }
 
 void PHSensor::begin() {
   pinMode(pin, INPUT);
+  ADCLinearizer::begin(); // Calibrated raw->mV table, built once
   loadCalibration();
+  if (!adc.begin()) {
+    Serial.println("pH Sensor: continuous ADC unavailable, using analogRead()");
+  }
   Serial.println("pH Sensor initialized");
 }
 
 void PHSensor::loadCalibration() {
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  ph7Voltage = prefs.getFloat(PREF_PH7_KEY, 2.50f);
-  ph4Voltage = prefs.getFloat(PREF_PH4_KEY, 3.00f); // pH 4 typically ~3.0V
-  offset = prefs.getFloat("ph_offset", -0.5f); // Load saved offset, default -0.5 (max allowed)
+  // Loaded (and migrated from the legacy float keys) by configCache.begin()
+  const ConfigValues& cfg = configCache.get();
+  ph7Microvolts = cfg.ph7Microvolts;
+  ph4Microvolts = cfg.ph4Microvolts;
+  offsetMilli = cfg.phOffsetMilli;
+  mode = (PHAcquisitionMode)cfg.phMode;
+  if (mode != PH_MODE_OVERSAMPLE) mode = PH_MODE_MEDIAN;
   
   // Validate offset: must be >= -0.5
-  if (offset < -0.5f) {
-    offset = -0.5f;
+  if (offsetMilli < PH_OFFSET_MIN_MILLI) {
+    offsetMilli = PH_OFFSET_MIN_MILLI;
     Serial.println("Warning: Offset was below -0.5, reset to -0.5");
   }
   
-  prefs.end();
-  
   calculateSlope(); // Recalculate slope after loading calibration
   
-  Serial.printf("pH calibration loaded: 7.00=%.3fV, 4.00=%.3fV, slope=%.3f pH/V, offset=%.2f\n", 
-                ph7Voltage, ph4Voltage, slope, offset);
+  Serial.printf("pH calibration loaded: 7.00=%ldmV, 4.00=%ldmV, offset=%ldmpH\n", 
+                (long)(ph7Microvolts / 1000), (long)(ph4Microvolts / 1000), (long)offsetMilli);
+}
+
+void PHSensor::saveCalibration() {
+  configCache.setPHCalibration(ph7Microvolts, ph4Microvolts);
+}
+
+void PHSensor::saveOffset() {
+  configCache.setPHOffset(offsetMilli);
 }
 
 void PHSensor::calculateSlope() {
   // Calculate slope from calibration points
-  // slope = (pH7 - pH4) / (ph4Voltage - ph7Voltage)
-  // Example: (7.0 - 4.0) / (3.0 - 2.5) = 3.0 / 0.5 = 6.0 pH per volt
-  float voltageDiff = ph4Voltage - ph7Voltage;
-  if (voltageDiff > 0.01f || voltageDiff < -0.01f) { // Avoid division by zero
-    slope = PH_RANGE / voltageDiff;
+  // slope = (pH7 - pH4) / (ph4Voltage - ph7Voltage), here in milli-pH per microvolt (fixed-point)
+  // Example: 3000 / (3000000 - 2500000) = 0.006 mpH/uV (= 6.0 pH per volt)
+  int32_t span = ph4Microvolts - ph7Microvolts;
+  if (span > PH_MIN_CAL_SPAN_UV || span < -PH_MIN_CAL_SPAN_UV) { // Avoid division by zero
+    slopeQ = (int32_t)(((int64_t)PH_RANGE_MILLI << PH_SLOPE_FRAC_BITS) / span);
   } else {
-    slope = 6.0f; // Default fallback: 3 pH units per 0.5V = 6.0 pH/V
+    slopeQ = PH_DEFAULT_SLOPE_Q; // Default fallback: 3 pH units per 0.5V
   }
 }
 
-// Partition function for floats (must be declared before quickSelect)
-static int partition(float arr[], int left, int right, int pivotIndex) {
-  float pivotValue = arr[pivotIndex];
-  // Swap pivot to end
-  float temp = arr[pivotIndex];
-  arr[pivotIndex] = arr[right];
-  arr[right] = temp;
-  
-  int storeIndex = left;
-  for (int i = left; i < right; i++) {
-    if (arr[i] < pivotValue) {
-      temp = arr[storeIndex];
-      arr[storeIndex] = arr[i];
-      arr[i] = temp;
-      storeIndex++;
-    }
-  }
-  // Move pivot to final position
-  temp = arr[right];
-  arr[right] = arr[storeIndex];
-  arr[storeIndex] = temp;
-  return storeIndex;
-}
-
 // Partition function for integers (must be declared before quickSelectInt)
 static int partitionInt(int arr[], int left, int right, int pivotIndex) {
   int pivotValue = arr[pivotIndex];
@@ -107,58 +91,26 @@ static int partitionInt(int arr[], int left, int right, int pivotIndex) {
   return storeIndex;
 }
 
-// Quickselect algorithm to find median (O(n) average, much faster than full sort)
-static float quickSelect(float arr[], int left, int right, int k) {
-  if (left == right) return arr[left];
-  
-  int pivotIndex = left + ((right - left) >> 1); // Use middle as pivot
-  pivotIndex = partition(arr, left, right, pivotIndex);
-  
-  if (k == pivotIndex) {
-    return arr[k];
-  } else if (k < pivotIndex) {
-    return quickSelect(arr, left, pivotIndex - 1, k);
-  } else {
-    return quickSelect(arr, pivotIndex + 1, right, k);
-  }
-}
-
-float PHSensor::calculateMedian() {
-  // Optimized: Use quickselect (O(n) average) instead of full sort
-  static float temp[PH_MEDIAN_SAMPLES];
-  memcpy(temp, samples, sizeof(samples));
-  
-  int medianIndex = PH_MEDIAN_SAMPLES >> 1; // Divide by 2 using bit shift
-  return quickSelect(temp, 0, PH_MEDIAN_SAMPLES - 1, medianIndex);
+int32_t PHSensor::microvoltsToMilliPH(int32_t microvolts) {
+  // Main pH formula: pH = 7.0 + (ph7Voltage - voltage) * slope + offset
+  int64_t delta = (int64_t)(ph7Microvolts - microvolts) * slopeQ;
+  return PH_NEUTRAL_MILLI + (int32_t)(delta >> PH_SLOPE_FRAC_BITS) + offsetMilli;
 }
 
-float PHSensor::read() {
-  // Optimized: Single ADC reading with fast median filter
-  int adcValue = getFastMedianADC();
-  
-  // Optimized: Pre-calculated constant for voltage conversion
-  float voltage = adcValue * ADC_TO_VOLTAGE;
-  
-  // ===== pH Calculation =====
-  // Main pH formula: pH = 7.0 + (ph7Voltage - voltage) * slope + offset
-  // Optimized: Combine calculations
-  float phValue = PH_NEUTRAL + (ph7Voltage - voltage) * slope + offset;
-  
-  // Optimized: Fast clamp using conditional assignment
-  phValue = (phValue < PH_MIN) ? PH_MIN : ((phValue > PH_MAX) ? PH_MAX : phValue);
+int32_t PHSensor::readMilli() {
+  uint32_t microvolts;
   
-  // Add to median filter buffer for pH values
-  samples[sampleIndex] = phValue;
-  
-  // Optimized: Use bitwise AND for modulo when size is power of 2, otherwise use modulo
-  sampleIndex++;
-  if (sampleIndex >= PH_MEDIAN_SAMPLES) {
-    sampleIndex = 0;
-    if (!bufferFilled) bufferFilled = true;
+  if (mode != PH_MODE_OVERSAMPLE || !getOversampledMicrovolts(microvolts)) {
+    // Filtered ADC value from samples already acquired in the background
+    int adcValue = getFilteredADC();
+    
+    // Calibrated conversion: one table load (corrects ESP32 ADC nonlinearity)
+    microvolts = ADCLinearizer::toMillivolts(adcValue) * 1000u;
   }
   
-  // Return median if buffer is filled, otherwise return current value
-  return bufferFilled ? calculateMedian() : phValue;
+  // Clamp + median etc. as configured in config/filterConfig.h
+  lastUnfilteredMilli = microvoltsToMilliPH((int32_t)microvolts);
+  return valueFilter.apply(lastUnfilteredMilli);
 }
 
 // Quickselect for integers (optimized version)
@@ -177,32 +129,66 @@ static int quickSelectInt(int arr[], int left, int right, int k) {
   }
 }
 
-int PHSensor::getFastMedianADC() {
-  // Optimized: Reduced samples (9 instead of 11) for even faster response
-  // Still provides excellent noise filtering
-  const int samples = 9;
-  static int buf[samples];
+// Copy the newest n (<= PH_ADC_RING_SIZE) samples from the background ring into buf (no waiting)
+static int copyLatestADC(ADCStream& adc, int buf[], int n) {
+  uint16_t raw[PH_ADC_RING_SIZE];
+  int got = (int)adc.samples().latest(raw, n);
+  for (int i = 0; i < got; i++) {
+    buf[i] = raw[i];
+  }
+  return got;
+}
+
+int PHSensor::getFilteredADC() {
+  const ADCRing& ring = adc.samples();
   
-  // Take multiple readings with minimal delay (ADC needs time to settle)
-  for (int i = 0; i < samples; i++) {
-    buf[i] = analogRead(pin);
+  if (adc.isRunning() && ring.totalWritten() > 0) {
+    // Normal path: feed every sample the DMA stream acquired since the last read
+    uint16_t fresh[PH_ADC_RING_SIZE];
+    size_t got = ring.readSince(adcCursor, fresh, PH_ADC_RING_SIZE);
+    for (size_t i = 0; i < got; i++) {
+      lastADC = adcFilter.apply(fresh[i]);
+    }
+    return lastADC;
+  }
+  
+  // Fallback: take multiple readings with minimal delay (ADC needs time to settle)
+  for (int i = 0; i < PH_ADC_MEDIAN_SAMPLES; i++) {
+    lastADC = adcFilter.apply(analogRead(pin));
     delayMicroseconds(50); // 50µs delay (faster, ADC settles quickly)
   }
+  return lastADC;
+}
+
+bool PHSensor::getOversampledMicrovolts(uint32_t& microvolts) {
+  // Needs the background stream; the analogRead() fallback is far too slow for 4^n samples
+  if (!adc.isRunning() || adc.samples().available() < PH_OVERSAMPLE_COUNT) {
+    return false;
+  }
   
-  // Optimized: Use quickselect (O(n) average) instead of full sort
-  int medianIndex = samples >> 1; // Divide by 2 using bit shift
-  return quickSelectInt(buf, 0, samples - 1, medianIndex);
+  // Accumulate 4^n samples and keep n extra bits (ADC noise acts as dither)
+  uint32_t decimated = adc.samples().sumLatest(PH_OVERSAMPLE_COUNT) >> PH_OVERSAMPLE_EXTRA_BITS;
+  
+  microvolts = ADCLinearizer::toMicrovolts(decimated, PH_OVERSAMPLE_EXTRA_BITS);
+  return true;
 }
 
-int PHSensor::getMedianADC() {
-  // Calibration method (uses more samples for accuracy)
-  const int samples = 15;
-  static int buf[samples];
+int PHSensor::sampleCalibrationADC() {
+  // Calibration method (uses more samples for accuracy). Stack buffer: this runs
+  // on the web server task without the control lock
+  int buf[PH_ADC_RING_SIZE];
+  int samples;
   
-  // Take multiple readings with small delay
-  for (int i = 0; i < samples; i++) {
-    buf[i] = analogRead(pin);
-    delay(5); // 5ms delay for calibration accuracy
+  if (adc.isRunning() && adc.samples().available() == PH_ADC_RING_SIZE) {
+    // The whole ring spans ~PH_ADC_RING_SIZE ms of averaged conversions
+    samples = copyLatestADC(adc, buf, PH_ADC_RING_SIZE);
+  } else {
+    // Fallback: take multiple readings with small delay
+    samples = 15;
+    for (int i = 0; i < samples; i++) {
+      buf[i] = analogRead(pin);
+      delay(5); // 5ms delay for calibration accuracy
+    }
   }
   
   // Optimized: Use quickselect for calibration too (faster than insertion sort)
@@ -210,114 +196,55 @@ int PHSensor::getMedianADC() {
   return quickSelectInt(buf, 0, samples - 1, medianIndex);
 }
 
-void PHSensor::calibrate7() {
-  // Use median filter for calibration reading (more samples for accuracy)
-  int adcValue = getMedianADC();
-  ph7Voltage = adcValue * ADC_TO_VOLTAGE;
-  
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat(PREF_PH7_KEY, ph7Voltage);
-  prefs.end();
+void PHSensor::calibrate7(int adcValue) {
+  ph7Microvolts = ADCLinearizer::toMillivolts(adcValue) * 1000;
   
   calculateSlope(); // Recalculate slope
+  saveCalibration();
   
-  Serial.printf("pH 7.00 calibrated: %.3fV, slope=%.3f pH/V\n", ph7Voltage, slope);
+  Serial.printf("pH 7.00 calibrated: %ldmV\n", (long)(ph7Microvolts / 1000));
 }
 
-void PHSensor::calibrate4() {
-  // Use median filter for calibration reading (more samples for accuracy)
-  int adcValue = getMedianADC();
-  ph4Voltage = adcValue * ADC_TO_VOLTAGE;
-  
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat(PREF_PH4_KEY, ph4Voltage);
-  prefs.end();
+void PHSensor::calibrate4(int adcValue) {
+  ph4Microvolts = ADCLinearizer::toMillivolts(adcValue) * 1000;
   
   calculateSlope(); // Recalculate slope
+  saveCalibration();
   
-  Serial.printf("pH 4.00 calibrated: %.3fV, slope=%.3f pH/V\n", ph4Voltage, slope);
+  Serial.printf("pH 4.00 calibrated: %ldmV\n", (long)(ph4Microvolts / 1000));
 }
 
 void PHSensor::setCalibration(float ph7, float ph4) {
-  ph7Voltage = ph7;
-  ph4Voltage = ph4;
-  
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat(PREF_PH7_KEY, ph7Voltage);
-  prefs.putFloat(PREF_PH4_KEY, ph4Voltage);
-  prefs.end();
+  ph7Microvolts = (int32_t)lroundf(ph7 * 1000000.0f);
+  ph4Microvolts = (int32_t)lroundf(ph4 * 1000000.0f);
   
   calculateSlope(); // Recalculate slope
+  saveCalibration();
 }
 
 void PHSensor::setOffset(float off) {
+  int32_t milli = (int32_t)lroundf(off * 1000.0f);
+  
   // Validate offset: must be >= -0.5
-  if (off < -0.5f) {
-    offset = -0.5f;
+  if (milli < PH_OFFSET_MIN_MILLI) {
+    offsetMilli = PH_OFFSET_MIN_MILLI;
     Serial.printf("Warning: Offset %.2f is below -0.5, clamped to -0.5\n", off);
   } else {
-    offset = off;
+    offsetMilli = milli;
   }
   
   // Save offset to preferences
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat("ph_offset", offset);
-  prefs.end();
+  saveOffset();
   
-  Serial.printf("pH offset set to: %.2f\n", offset);
+  Serial.printf("pH offset set to: %ldmpH\n", (long)offsetMilli);
 }
 
-void PHSensor::adjustOffsetForNormalWater(float targetPH) {
-  // Take multiple readings and average for more accuracy
-  float sum = 0.0f;
-  const int readings = 5;
-  
-  for (int i = 0; i < readings; i++) {
-    sum += read();
-    delay(100); // Small delay between readings
-  }
-  
-  float currentPH = sum / readings;
-  
-  // Calculate the difference needed
-  float difference = targetPH - currentPH;
+void PHSensor::setMode(PHAcquisitionMode newMode) {
+  mode = newMode;
+  valueFilter.reset(); // Don't mix readings of different resolution in the value window
   
-  // Adjust offset to bring reading to target, but clamp to -0.5 minimum
-  float newOffset = offset + difference;
+  configCache.setPHMode(mode);
   
-  if (newOffset < -0.5f) {
-    offset = -0.5f;
-    Serial.printf("Warning: Calculated offset %.2f is below -0.5, clamped to -0.5\n", newOffset);
-    Serial.printf("Note: pH reading may still be high. Consider recalibrating pH 7.00 instead.\n");
-  } else {
-    offset = newOffset;
-  }
-  
-  // Save offset to preferences
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat("ph_offset", offset);
-  prefs.end();
-  
-  Serial.printf("pH offset adjusted: Current=%.2f, Target=%.2f, Adjustment=%.2f, New Offset=%.2f\n", 
-                currentPH, targetPH, difference, offset);
-  
-  // Verify the adjustment
-  delay(200);
-  float verifyPH = read();
-  Serial.printf("Verification reading: %.2f (should be close to %.2f)\n", verifyPH, targetPH);
-  
-  if (verifyPH > 7.5f && offset == -0.5f) {
-    Serial.println("Recommendation: Recalibrate pH 7.00 buffer solution for better accuracy");
-  }
-}
-
-bool PHSensor::isSafe() {
-  float currentPH = read();
-  return (currentPH >= PH_MIN_SAFE && currentPH <= PH_MAX_SAFE);
+  Serial.printf("pH acquisition mode: %s (%d-bit steps)\n",
+                mode == PH_MODE_OVERSAMPLE ? "oversample" : "median", getEffectiveBits());
 }
-
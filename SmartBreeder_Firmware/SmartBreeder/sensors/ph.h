@@ -2,40 +2,68 @@
 #define PH_SENSOR_H
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include "config/config.h"
+#include "sensors/adcStream.h"
+#include "sensors/adcLinearizer.h"
+#include "config/filterConfig.h"
+
+// How raw ADC samples become one reading
+enum PHAcquisitionMode {
+  PH_MODE_MEDIAN = 0,   // Median of recent samples (12-bit, best spike rejection)
+  // Sum 4^n samples and decimate: 12+n bit steps. Ring samples are already
+  // driver means of PH_ADC_CONVERSIONS_PER_SAMPLE conversions, so less noise is
+  // left to dither and the measured gain is about one bit (host/oversampleTest).
+  // No ADC median in front: a spike only gets the driver average and the
+  // 1/4^n share of the sum; the per-read valueFilter median still applies.
+  PH_MODE_OVERSAMPLE
+};
 
 class PHSensor {
 private:
   int pin;
-  float ph7Voltage;
-  float ph4Voltage;
-  float slope;
-  float offset;
+  ADCStream adc; // Background DMA sampling; analogRead() is only a fallback
+  
+  // Fixed-point calibration: no float from raw ADC to the published value
+  int32_t ph7Microvolts;
+  int32_t ph4Microvolts;
+  int32_t slopeQ;       // milli-pH per microvolt, PH_SLOPE_FRAC_BITS fractional bits
+  int32_t offsetMilli;  // milli-pH
   
-  float samples[PH_MEDIAN_SAMPLES];
-  int sampleIndex;
-  bool bufferFilled;
+  PHAdcFilter adcFilter;     // Per-sample chain over raw ADC samples
+  PHValueFilter valueFilter; // Per-read chain over milli-pH values
+  uint16_t lastADC;          // Latest adcFilter output
+  int32_t lastUnfilteredMilli; // Latest reading before valueFilter
+  uint32_t adcCursor;        // Ring position already consumed into adcFilter
+  PHAcquisitionMode mode;
   
-  float calculateMedian();
   void loadCalibration();
+  void saveCalibration();
+  void saveOffset();
   void calculateSlope(); // Calculate slope from calibration points
-  int getMedianADC(); // Median filter for ADC readings (calibration - more samples)
-  int getFastMedianADC(); // Fast median filter for regular readings (optimized)
+  int getFilteredADC(); // Run newly acquired samples through adcFilter
+  bool getOversampledMicrovolts(uint32_t& microvolts); // Oversample + decimate from the ring
+  int32_t microvoltsToMilliPH(int32_t microvolts);
   
 public:
   PHSensor(int pin);
   void begin();
-  float read();
-  void calibrate7();
-  void calibrate4();
-  float getCalibration7() { return ph7Voltage; }
-  float getCalibration4() { return ph4Voltage; }
-  float getOffset() { return offset; }
+  int32_t readMilli(); // Filtered pH in milli-pH (7000 = pH 7.00)
+  int32_t getUnfilteredMilli() { return lastUnfilteredMilli; } // Last readMilli() before valueFilter
+  // Calibration is split so callers can sample without holding the control lock:
+  // sampleCalibrationADC() may wait ~75 ms (analogRead() fallback) but touches no
+  // shared state; calibrate7/4() only commit the sampled value.
+  int sampleCalibrationADC(); // Median of the whole ADC ring (more samples than a read)
+  void calibrate7(int adcValue);
+  void calibrate4(int adcValue);
+  // Float accessors are for display/API only
+  float getCalibration7() { return ph7Microvolts * 0.000001f; }
+  float getCalibration4() { return ph4Microvolts * 0.000001f; }
+  float getOffset() { return offsetMilli * 0.001f; }
   void setCalibration(float ph7, float ph4);
   void setOffset(float off); // Set pH offset for fine-tuning (saves to preferences)
-  void adjustOffsetForNormalWater(float targetPH = 7.0f); // Auto-adjust offset for normal water
-  bool isSafe();
+  void setMode(PHAcquisitionMode newMode); // Switch acquisition mode (saves to preferences)
+  PHAcquisitionMode getMode() { return mode; }
+  int getEffectiveBits() { return mode == PH_MODE_OVERSAMPLE ? 12 + PH_OVERSAMPLE_EXTRA_BITS : 12; } // Output step, not accuracy
 };
 
 #endif
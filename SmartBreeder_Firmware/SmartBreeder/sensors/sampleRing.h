@@ -0,0 +1,78 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Single-producer / single-consumer ring of raw samples.
+// The producer (ADC task) only ever pushes; consumers copy out the newest
+// samples or everything written since their own cursor. No locks, no heap,
+// and no hardware dependencies so it can be fed from any sample source.
+template <typename T, size_t N>
+class SampleRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SampleRing size must be a power of two");
+  
+private:
+  T buf[N];
+  std::atomic<uint32_t> written; // Total samples ever pushed (wraps)
+  
+public:
+  SampleRing() : written(0) {}
+  
+  static constexpr size_t capacity() { return N; }
+  
+  void push(T sample) {
+    uint32_t w = written.load(std::memory_order_relaxed);
+    buf[w & (N - 1)] = sample;
+    written.store(w + 1, std::memory_order_release);
+  }
+  
+  uint32_t totalWritten() const { return written.load(std::memory_order_acquire); }
+  
+  size_t available() const {
+    uint32_t w = totalWritten();
+    return w < N ? w : N;
+  }
+  
+  // Copy the newest n samples (oldest first). Returns the number copied.
+  size_t latest(T* dst, size_t n) const {
+    uint32_t w = totalWritten();
+    size_t have = w < N ? w : N;
+    if (n > have) n = have;
+    uint32_t start = w - n;
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = buf[(start + i) & (N - 1)];
+    }
+    return n;
+  }
+  
+  // Sum of the newest n samples (n <= available()), read in place
+  uint32_t sumLatest(size_t n) const {
+    uint32_t start = totalWritten() - n;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += buf[(start + i) & (N - 1)];
+    }
+    return sum;
+  }
+  
+  // Copy samples written since cursor (up to max) and advance cursor.
+  // If the producer lapped the consumer, the oldest unread samples are skipped.
+  size_t readSince(uint32_t& cursor, T* dst, size_t max) const {
+    uint32_t w = totalWritten();
+    uint32_t pending = w - cursor;
+    if (pending > N) {
+      cursor = w - N;
+      pending = N;
+    }
+    size_t n = pending < max ? pending : max;
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = buf[(cursor + i) & (N - 1)];
+    }
+    cursor += n;
+    return n;
+  }
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SLIDING_MEDIAN_H
+#define SLIDING_MEDIAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h> // For memmove
+
+// Running median over the last N samples.
+// Keeps the window twice: in arrival order (to know what expires) and sorted
+// (to answer the median). A push is two binary searches plus one memmove of
+// at most N-1 elements - no copy of the window and no selection pass, so the
+// median is O(1) to read regardless of N. T must be trivially copyable.
+template <typename T, size_t N>
+class SlidingMedian {
+  static_assert(N > 0, "SlidingMedian window must not be empty");
+  
+private:
+  T arrival[N];  // Ring in insertion order
+  T sorted[N];   // Same values, ascending
+  size_t head;   // Next slot to overwrite in arrival[]
+  size_t count;
+  
+  // First index in sorted[0..count) whose value is >= v
+  size_t lowerBound(T v) const {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+      size_t mid = (lo + hi) >> 1;
+      if (sorted[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+  }
+  
+public:
+  SlidingMedian() : head(0), count(0) {}
+  
+  static constexpr size_t capacity() { return N; }
+  size_t size() const { return count; }
+  bool full() const { return count == N; }
+  void reset() { head = 0; count = 0; }
+  
+  void push(T v) {
+    if (count == N) {
+      // Drop the expiring sample from the sorted view
+      size_t pos = lowerBound(arrival[head]);
+      memmove(&sorted[pos], &sorted[pos + 1], (count - pos - 1) * sizeof(T));
+      count--;
+    }
+    
+    size_t pos = lowerBound(v);
+    memmove(&sorted[pos + 1], &sorted[pos], (count - pos) * sizeof(T));
+    sorted[pos] = v;
+    count++;
+    
+    arrival[head] = v;
+    head = (head + 1 == N) ? 0 : head + 1;
+  }
+  
+  // Middle element (upper median for even sizes). Undefined when empty.
+  T median() const { return sorted[count >> 1]; }
+  T minimum() const { return sorted[0]; }
+  T maximum() const { return sorted[count - 1]; }
+};
+
+#endif
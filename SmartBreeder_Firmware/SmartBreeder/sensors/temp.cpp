@@ -1,51 +1,142 @@
 #include "temp.h"
 #include "config/config.h"
+#include "config/configCache.h"
 
-TempSensor::TempSensor(int pin) : offset(0.0), lastReading(25.0) {
+TempSensor::TempSensor(int pin) : offset(0.0), probeCount(0),
+                                   minTemp(25.0), maxTemp(25.0), meanTemp(25.0), unfilteredMean(25.0),
+                                   conversionPending(false), conversionStart(0),
+                                   conversionTime(750), readInterval(TEMP_READ_INTERVAL_MIN),
+                                   lastUpdate(0), lastScan(0) {
   oneWire = new OneWire(pin);
   sensors = new DallasTemperature(oneWire);
+  for (int i = 0; i < TEMP_MAX_PROBES; i++) {
+    probeTemp[i] = 25.0;
+    probeValid[i] = false;
+  }
 }
 
 void TempSensor::begin() {
-  sensors->begin();
+  scanBus();
   loadCalibration();
-  Serial.println("Temperature sensor initialized");
+  startConversion();
+  Serial.printf("Temperature sensor initialized (%d probes, async, %lums conversion)\n",
+                probeCount, conversionTime);
+}
+
+void TempSensor::scanBus() {
+  lastScan = millis();
+  sensors->begin();
+  enumerateProbes();
+  
+  // Probes keep whatever resolution they were last set to; a hot-plugged one
+  // gets the same as those found at boot, and the window follows it
+  if (probeCount > 0) {
+    sensors->setResolution(TEMP_RESOLUTION_BITS);
+  }
+  conversionTime = sensors->millisToWaitForConversion(TEMP_RESOLUTION_BITS);
+  
+  // Don't let requestTemperatures() block for the conversion time;
+  // update() collects the result once the conversion window has elapsed
+  sensors->setWaitForConversion(false);
+}
+
+void TempSensor::enumerateProbes() {
+  // One bus search here instead of one per read
+  uint8_t found = sensors->getDeviceCount();
+  probeCount = 0;
+  for (uint8_t i = 0; i < found && probeCount < TEMP_MAX_PROBES; i++) {
+    if (sensors->getAddress(probeAddress[probeCount], i)) {
+      const uint8_t* a = probeAddress[probeCount];
+      Serial.printf("  Probe %d: %02X%02X%02X%02X%02X%02X%02X%02X\n", probeCount,
+                    a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+      probeValid[probeCount] = false;
+      probeFilter[probeCount].reset();
+      probeCount++;
+    }
+  }
+  if (found > TEMP_MAX_PROBES) {
+    Serial.printf("Warning: %d probes on bus, only the first %d are used\n", found, TEMP_MAX_PROBES);
+  }
 }
 
 void TempSensor::loadCalibration() {
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  offset = prefs.getFloat(PREF_TEMP_OFFSET_KEY, 0.0);
-  prefs.end();
+  offset = configCache.get().tempOffset;
   Serial.printf("Temperature offset loaded: %.2f°C\n", offset);
 }
 
-float TempSensor::read() {
-  sensors->requestTemperatures();
-  float temp = sensors->getTempCByIndex(0);
+void TempSensor::startConversion() {
+  if (probeCount == 0 && millis() - lastScan >= TEMP_RESCAN_INTERVAL) {
+    // Nothing found at boot - look again in case a probe was plugged in. A search
+    // blocks the bus for milliseconds, so not on every (1 s floor) read interval.
+    scanBus();
+  }
+  sensors->requestTemperatures(); // Skip-ROM broadcast: all probes convert at once, returns immediately
+  conversionStart = millis();
+  conversionPending = true;
+}
+
+void TempSensor::collectConversion() {
+  conversionPending = false;
+  
+  float sum = 0.0;
+  float unfilteredSum = 0.0;
+  float lo = 0.0, hi = 0.0;
+  uint8_t valid = 0;
+  
+  for (uint8_t i = 0; i < probeCount; i++) {
+    float temp = sensors->getTempC(probeAddress[i]); // Addressed read, no bus search
+    if (isTempSentinel(temp)) {
+      probeValid[i] = false;
+      continue;
+    }
+    probeTemp[i] = probeFilter[i].apply(temp);
+    probeValid[i] = true;
+    unfilteredSum += temp;
+    
+    if (valid == 0 || probeTemp[i] < lo) lo = probeTemp[i];
+    if (valid == 0 || probeTemp[i] > hi) hi = probeTemp[i];
+    sum += probeTemp[i];
+    valid++;
+  }
   
-  if (temp == DEVICE_DISCONNECTED_C) {
-    Serial.println("Temperature sensor error - using last reading");
-    return lastReading;
+  if (valid == 0) {
+    Serial.println("Temperature sensor error - keeping last reading");
+    return;
   }
   
-  lastReading = temp + offset;
-  return lastReading;
+  minTemp = lo;
+  maxTemp = hi;
+  meanTemp = sum / valid;
+  unfilteredMean = unfilteredSum / valid;
+  lastUpdate = millis();
 }
 
-void TempSensor::setOffset(float newOffset) {
-  offset = newOffset;
+void TempSensor::update() {
+  unsigned long now = millis();
   
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, false);
-  prefs.putFloat(PREF_TEMP_OFFSET_KEY, offset);
-  prefs.end();
+  if (conversionPending) {
+    if (now - conversionStart >= conversionTime) {
+      collectConversion();
+    }
+    return;
+  }
   
-  Serial.printf("Temperature offset set: %.2f°C\n", offset);
+  // Next conversion starts readInterval after the previous one was requested
+  if (now - conversionStart >= readInterval) {
+    startConversion();
+  }
 }
 
-bool TempSensor::isSafe() {
-  float currentTemp = read();
-  return (currentTemp <= TEMP_MAX_SAFE);
+void TempSensor::requestNow() {
+  if (!conversionPending) {
+    conversionStart = millis() - readInterval; // Makes the next conversion due immediately
+  }
 }
 
+void TempSensor::setOffset(float newOffset) {
+  offset = newOffset; // Applied on read, so cached values reflect it immediately
+  
+  configCache.setTempOffset(offset);
+  
+  Serial.printf("Temperature offset set: %.2f°C\n", offset);
+}
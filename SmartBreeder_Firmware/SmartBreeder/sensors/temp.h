@@ -4,26 +4,59 @@
 #include <Arduino.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
-#include <Preferences.h>
 #include "config/config.h"
+#include "config/filterConfig.h"
 
 class TempSensor {
 private:
   OneWire* oneWire;
   DallasTemperature* sensors;
   float offset;
-  float lastReading;
+  
+  // Probes enumerated at begin(); read by ROM address, never by index
+  DeviceAddress probeAddress[TEMP_MAX_PROBES];
+  TempValueFilter probeFilter[TEMP_MAX_PROBES]; // Configured in config/filterConfig.h
+  float probeTemp[TEMP_MAX_PROBES];             // Filtered, without offset
+  bool probeValid[TEMP_MAX_PROBES];             // Last conversion read back OK
+  uint8_t probeCount;
+  
+  // Aggregate over valid probes (without offset)
+  float minTemp;
+  float maxTemp;
+  float meanTemp;
+  float unfilteredMean;  // Same probes before probeFilter
+  
+  // Asynchronous conversion state (DS18B20 takes up to 750ms at 12-bit)
+  bool conversionPending;
+  unsigned long conversionStart;   // When the current conversion was requested
+  unsigned long conversionTime;    // Conversion window for the configured resolution
+  unsigned long readInterval;      // Time between conversion starts (set by acquisition)
+  unsigned long lastUpdate;        // When the aggregate was last collected (0 = never)
+  unsigned long lastScan;          // When the bus was last searched for probes
   
   void loadCalibration();
+  void scanBus();         // Search, configure resolution, size the conversion window
+  void enumerateProbes();
+  void startConversion();
+  void collectConversion();
   
 public:
   TempSensor(int pin);
   void begin();
-  float read();
+  void update(); // Drive the conversion state machine (call every loop, never blocks)
+  float read() { return meanTemp + offset; } // Cached mean of all valid probes
+  float readUnfiltered() { return unfilteredMean + offset; } // Same mean before the per-probe filters
+  float getMin() { return minTemp + offset; }
+  float getMax() { return maxTemp + offset; }
+  uint8_t getProbeCount() { return probeCount; }
+  float getProbeTemp(uint8_t i) { return i < probeCount ? probeTemp[i] + offset : TEMP_DISCONNECTED_C; }
+  bool isProbeValid(uint8_t i) { return i < probeCount && probeValid[i]; }
+  void setReadInterval(unsigned long ms) { readInterval = ms; }
+  void requestNow(); // Start the next conversion on the following update()
+  unsigned long getLastUpdate() { return lastUpdate; }
+  bool hasReading() { return lastUpdate != 0; }
   void setOffset(float offset);
   float getOffset() { return offset; }
-  bool isSafe();
 };
 
 #endif
-
@@ -2,7 +2,7 @@
 #include "config/config.h"
 
 LCDUI::LCDUI() : currentPage(PAGE_READINGS), lastPageChange(0), 
-                 lastUpdate(0), startupComplete(false), startupStart(0),
+                 startupComplete(false), startupStart(0),
                  lastProjectInfoShow(0), showingProjectInfo(false),
                  wifiConnected(false), wifiStatusShown(false), wifiConnectedTime(0) {
   lcd = new LiquidCrystal_I2C(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
@@ -139,10 +139,7 @@ void LCDUI::update(float ph, float temp, String phState, String tempState,
   // Handle WiFi connection status display sequence
   if (!wifiConnected && !wifiStatusShown) {
     // Show "WiFi Connecting" while not connected
-    if (now - lastUpdate >= LCD_UPDATE_INTERVAL) {
-      showWiFiConnecting();
-      lastUpdate = now;
-    }
+    showWiFiConnecting();
     return;
   }
   
@@ -160,17 +157,11 @@ void LCDUI::update(float ph, float temp, String phState, String tempState,
     unsigned long elapsed = now - wifiConnectedTime;
     if (elapsed < 2000) {
       // Show "WiFi Connected" for 2 seconds
-      if (now - lastUpdate >= LCD_UPDATE_INTERVAL) {
-        showWiFiConnected();
-        lastUpdate = now;
-      }
+      showWiFiConnected();
       return;
     } else if (elapsed < 5000) {
       // Show IP address for 3 seconds
-      if (now - lastUpdate >= LCD_UPDATE_INTERVAL) {
-        showWiFiIP(wifiIP);
-        lastUpdate = now;
-      }
+      showWiFiIP(wifiIP);
       return;
     } else {
       // Done showing WiFi status, now show project info immediately
@@ -236,37 +227,34 @@ void LCDUI::update(float ph, float temp, String phState, String tempState,
     }
   }
   
-  // Update display based on current page
-  if (now - lastUpdate >= LCD_UPDATE_INTERVAL) {
-    switch (currentPage) {
-      case PAGE_READINGS:
-        // Always show pH and Temperature in normal operation
-        showReadings(ph, temp, phState, tempState);
-        break;
-      case PAGE_PROJECT_NAME:
-        showProjectName();
-        break;
-      case PAGE_APP_NAME:
-        showAppName();
-        break;
-      case PAGE_TEAM_NAME:
-        showTeamName();
-        break;
-      case PAGE_TEAM_LEADER:
-        showTeamLeader();
-        break;
-      case PAGE_SOFTWARE_DEV:
-        showSoftwareDev();
-        break;
-      case PAGE_HARDWARE_DEV:
-        showHardwareDev();
-        break;
-      default:
-        // Fallback to readings if unknown page
-        showReadings(ph, temp, phState, tempState);
-        break;
-    }
-    lastUpdate = now;
+  // Update display based on current page (called every LCD_UPDATE_INTERVAL by the scheduler)
+  switch (currentPage) {
+    case PAGE_READINGS:
+      // Always show pH and Temperature in normal operation
+      showReadings(ph, temp, phState, tempState);
+      break;
+    case PAGE_PROJECT_NAME:
+      showProjectName();
+      break;
+    case PAGE_APP_NAME:
+      showAppName();
+      break;
+    case PAGE_TEAM_NAME:
+      showTeamName();
+      break;
+    case PAGE_TEAM_LEADER:
+      showTeamLeader();
+      break;
+    case PAGE_SOFTWARE_DEV:
+      showSoftwareDev();
+      break;
+    case PAGE_HARDWARE_DEV:
+      showHardwareDev();
+      break;
+    default:
+      // Fallback to readings if unknown page
+      showReadings(ph, temp, phState, tempState);
+      break;
   }
 }
 
@@ -26,7 +26,6 @@ private:
   LiquidCrystal_I2C* lcd;
   LCDPage currentPage;
   unsigned long lastPageChange;
-  unsigned long lastUpdate;
   bool startupComplete;
   unsigned long startupStart;
   unsigned long lastProjectInfoShow;
@@ -1,15 +1,37 @@
 #include "server.h"
 #include "sensors/ph.h"
 #include "sensors/temp.h"
+#include "sensors/acquisition.h"
 #include "control/fan.h"
 #include "control/phControl.h"
+#include "control/controlTask.h"
+#include "control/relayBank.h"
+#include "control/dosingEngine.h"
+#include "control/tempControl.h"
+#include "control/relayRules.h"
+#include "control/scheduler.h"
+#include "sensors/history.h"
 #include "config/config.h"
+#include "config/configCache.h"
 
-SmartBreederServer::SmartBreederServer(PHSensor* ph, TempSensor* temp, FanControl* fan, PHControl* phCtrl) {
+SmartBreederServer::SmartBreederServer(PHSensor* ph, TempSensor* temp, SensorAcquisition* sensors,
+                                       FanControl* fan, PHControl* phCtrl, ControlTask* ctrlTask,
+                                       RelayBank* relays, DosingEngine* dosing, TempControl* tempCtrl,
+                                       RelayRules* rules, Scheduler* loopJobs, Scheduler* controlJobs,
+                                       History* history) {
   phSensor = ph;
   tempSensor = temp;
+  this->sensors = sensors;
   fanControl = fan;
   phControl = phCtrl;
+  controlTask = ctrlTask;
+  this->relays = relays;
+  this->dosing = dosing;
+  tempControl = tempCtrl;
+  this->rules = rules;
+  this->loopJobs = loopJobs;
+  this->controlJobs = controlJobs;
+  this->history = history;
   server = new WebServer(80);
 }
 
@@ -60,12 +82,15 @@ void SmartBreederServer::begin() {
     // Setup routes
     server->on("/", HTTP_GET, [this]() { handleRoot(); });
     server->on("/api/status", HTTP_GET, [this]() { handleAPIStatus(); });
+    // Handlers that change actuators or sensors apply them under the control task lock,
+    // then reply once it is released
     server->on("/api/control", HTTP_POST, [this]() { handleAPIControl(); });
     server->on("/api/species", HTTP_POST, [this]() { handleAPISpecies(); });
     server->on("/api/species/list", HTTP_GET, [this]() { handleAPISpeciesList(); }); // Get all species
-    server->on("/api/calibrate", HTTP_POST, [this]() { handleAPICalibrate(); });
+    server->on("/api/calibrate", HTTP_POST, [this]() { handleAPICalibrate(); }); // Locks after sampling
     server->on("/api/wifi", HTTP_POST, [this]() { handleAPIWiFi(); });
     server->on("/api/ping", HTTP_GET, [this]() { handleAPIPing(); });
+    server->on("/api/history", HTTP_GET, [this]() { handleAPIHistory(); });
     server->onNotFound([this]() {
       if (server->method() == HTTP_OPTIONS) {
         handleOptions();
@@ -109,32 +134,86 @@ void SmartBreederServer::handleOptions() {
   server->send(200, "text/plain", "");
 }
 
+String SmartBreederServer::getJobsJSON(Scheduler* jobs) {
+  String json = "[";
+  for (uint8_t i = 0; i < jobs->getJobCount(); i++) {
+    JobStats stats = jobs->getStats(i);
+    if (i > 0) json += ",";
+    json += "{\"name\":\"" + String(jobs->getName(i)) + "\"";
+    json += ",\"periodMs\":" + String(jobs->getPeriod(i));
+    json += ",\"runs\":" + String(stats.runs);
+    json += ",\"overruns\":" + String(stats.overruns);
+    json += ",\"budgetMisses\":" + String(stats.budgetMisses);
+    json += ",\"maxLatenessMs\":" + String(stats.maxLatenessMs);
+    json += ",\"lastExecUs\":" + String(stats.lastExecUs);
+    json += ",\"maxExecUs\":" + String(stats.maxExecUs);
+    json += "}";
+  }
+  json += "]";
+  return json;
+}
+
+String SmartBreederServer::getConfigWritesJSON() {
+  String json = "[";
+  for (uint8_t i = 0; i < CFG_ENTRY_COUNT; i++) {
+    const ConfigWriteStats& stats = configCache.getWriteStats(i);
+    if (i > 0) json += ",";
+    json += "{\"key\":\"" + String(ConfigCache::getEntryName(i)) + "\"";
+    json += ",\"writes\":" + String(stats.writes);
+    json += ",\"bytes\":" + String(stats.bytes);
+    json += ",\"coalesced\":" + String(stats.coalesced);
+    json += "}";
+  }
+  json += "]";
+  return json;
+}
+
 String SmartBreederServer::getStatusJSON() {
-  // Read sensors once for consistent data
-  float ph = phSensor->read();
-  float temp = tempSensor->read();
+  // Use the published snapshot so the API matches the LCD and control decisions
+  const SensorSnapshot snap = sensors->snapshot();
   
   String json = "{";
   // Core fields that dashboard REQUIRES (exact match)
-  json += "\"ph\":" + String(ph, 2) + ",";
-  json += "\"temperature\":" + String(temp, 2) + ",";
+  json += "\"ph\":" + String(snap.ph(), 2) + ",";
+  json += "\"temperature\":" + String(snap.temperature, 2) + ",";
   // Send proper JSON booleans (true/false without quotes)
-  json += "\"fan\":" + String(fanControl->getState() ? "true" : "false") + ",";
-  json += "\"acidPump\":" + String(phControl->getAcidState() ? "true" : "false") + ",";
-  json += "\"basePump\":" + String(phControl->getBaseState() ? "true" : "false") + ",";
-  // Additional relay states - For active-low relays: LOW = ON, HIGH = OFF
-  // Check if pin level matches the ON state (LOW for active-low)
-  bool waterHeaterOn = (digitalRead(REL_WATER_HEATER) == getRelayLevel(true));
-  bool airPumpOn = (digitalRead(REL_AIR_PUMP) == getRelayLevel(true));
-  bool waterFlowOn = (digitalRead(REL_WATER_FLOW) == getRelayLevel(true));
-  bool rainPumpOn = (digitalRead(REL_RAIN_PUMP) == getRelayLevel(true));
-  bool lightControlOn = (digitalRead(REL_LIGHT_CTRL) == getRelayLevel(true));
+  // Relay states come from the RelayBank mask (what was written), not from the pins
+  uint8_t relayMask = relays->getMask();
+  bool fanOn = relayMask & relayBit(REL_COOLER_FAN);
+  bool acidPumpOn = relayMask & relayBit(REL_ACID_PUMP);
+  bool basePumpOn = relayMask & relayBit(REL_ALKALI_PUMP);
+  bool waterHeaterOn = relayMask & relayBit(REL_WATER_HEATER);
+  bool airPumpOn = relayMask & relayBit(REL_AIR_PUMP);
+  bool waterFlowOn = relayMask & relayBit(REL_WATER_FLOW);
+  bool rainPumpOn = relayMask & relayBit(REL_RAIN_PUMP);
+  bool lightControlOn = relayMask & relayBit(REL_LIGHT_CTRL);
   
+  json += "\"fan\":" + String(fanOn ? "true" : "false") + ",";
+  json += "\"acidPump\":" + String(acidPumpOn ? "true" : "false") + ",";
+  json += "\"basePump\":" + String(basePumpOn ? "true" : "false");
   json += ",\"waterHeater\":" + String(waterHeaterOn ? "true" : "false");
   json += ",\"airPump\":" + String(airPumpOn ? "true" : "false");
   json += ",\"waterFlow\":" + String(waterFlowOn ? "true" : "false");
   json += ",\"rainPump\":" + String(rainPumpOn ? "true" : "false");
   json += ",\"lightControl\":" + String(lightControlOn ? "true" : "false");
+  json += ",\"relayMask\":" + String(relayMask);
+  json += ",\"relayWrites\":" + String(relays->getRegisterWrites());
+  json += ",\"relayTransitions\":" + String(relays->getTransitions());
+  json += ",\"relayVerifyFaults\":" + String(relays->getVerifyFaults());
+  json += ",\"ruleConditions\":" + String(rules->getConditions());
+  json += ",\"ruleTarget\":" + String(rules->getTarget());
+  json += ",\"ruleEvaluations\":" + String(rules->getEvaluations());
+  json += ",\"ruleSkipped\":" + String(rules->getSkipped());
+  // Settings are served from RAM and written behind; per-entry flash wear since boot
+  json += ",\"configGeneration\":" + String(configCache.getGeneration());
+  json += ",\"configNvsWrites\":" + String(configCache.getNvsWrites());
+  json += ",\"configNvsBytes\":" + String(configCache.getNvsBytes());
+  json += ",\"configDirty\":" + String(configCache.getDirty());
+  json += ",\"configWrites\":" + getConfigWritesJSON();
+  json += ",\"historyBytes\":" + String((unsigned long)history->encodedBytes()); // Compressed, all tiers
+  // Seconds each tier actually holds (raw, minute, quarter): a noisy signal compresses less
+  json += ",\"historyCoverageS\":[" + String(history->coverageS(HISTORY_RAW)) + "," +
+          String(history->coverageS(HISTORY_MINUTE)) + "," + String(history->coverageS(HISTORY_QUARTER)) + "]";
   
   // Debug: Print relay states to Serial
   Serial.printf("Relay States - WaterHeater: %s, AirPump: %s, WaterFlow: %s, RainPump: %s, LightControl: %s\n",
@@ -148,25 +227,86 @@ String SmartBreederServer::getStatusJSON() {
   json += ",\"fishType\":" + String(activeFishType);
   
   // Add custom fish profile info if available
-  Preferences prefs;
-  prefs.begin(PREF_NAMESPACE, true);
-  bool useCustom = prefs.getBool("use_custom_profile", false);
-  if (useCustom) {
-    FishProfile custom = getActiveFishProfile();
+  if (configCache.get().useCustomProfile) {
+    const FishProfile& custom = getActiveFishProfile();
     json += ",\"customProfile\":true";
     json += ",\"fishName\":\"" + custom.name + "\"";
     json += ",\"phRange\":{\"min\":" + String(custom.phMin, 1) + ",\"max\":" + String(custom.phMax, 1) + "}";
     json += ",\"tempRange\":{\"min\":" + String(custom.tempMin, 1) + ",\"max\":" + String(custom.tempMax, 1) + "}";
   } else {
     json += ",\"customProfile\":false";
-    FishProfile profile = FISH_PROFILES[activeFishType];
+    const FishProfile& profile = FISH_PROFILES[activeFishType];
     json += ",\"phRange\":{\"min\":" + String(profile.phMin, 1) + ",\"max\":" + String(profile.phMax, 1) + "}";
     json += ",\"tempRange\":{\"min\":" + String(profile.tempMin, 1) + ",\"max\":" + String(profile.tempMax, 1) + "}";
   }
-  prefs.end();
   json += ",\"cooldownRemaining\":" + String(phControl->getCooldownRemaining());
-  json += ",\"phSafe\":" + String(phSensor->isSafe() ? "true" : "false");
-  json += ",\"tempSafe\":" + String(tempSensor->isSafe() ? "true" : "false");
+  // Cooldown ends when the pH stops moving; these show how long that has been taking
+  json += ",\"lastSettleMs\":" + String(phControl->getLastSettleMs());
+  json += ",\"learnedSettleMs\":" + String(phControl->getLearnedSettleMs());
+  json += ",\"settleTimeouts\":" + String(phControl->getSettleTimeouts());
+  // Measured on-time of the last dose, to verify the PUMP_MAX_DURATION deadline
+  DosePump lastPump = phControl->getLastDosePump();
+  json += ",\"lastDosePump\":\"" + String(lastPump == DOSE_ACID ? "acid" : lastPump == DOSE_BASE ? "base" : "none") + "\"";
+  json += ",\"lastDoseUs\":" + String(phControl->getLastDoseUs());
+  json += ",\"doseCount\":" + String(phControl->getDoseCount());
+  json += ",\"doseLimitMs\":" + String(PUMP_MAX_DURATION);
+  json += ",\"dosePlannedMs\":" + String(dosing->getLastPlannedMs());
+  json += ",\"doseGainAcid\":" + String(dosing->getGain(DOSE_ACID));
+  json += ",\"doseGainBase\":" + String(dosing->getGain(DOSE_BASE));
+  json += ",\"doseLearnCount\":" + String(dosing->getLearnCount());
+  json += ",\"tankLitres\":" + String(dosing->getTankLitres());
+  // Temperature controller: setpoint/deadband in °C, heater duty in percent (PID mode)
+  json += ",\"tempMode\":\"" + String(tempControl->getMode() == TEMP_MODE_PID ? "pid" : "hysteresis") + "\"";
+  json += ",\"tempDeadband\":" + String(tempControl->getDeadband() / 1000.0f, 2);
+  json += ",\"tempSetpoint\":" + String(tempControl->getSetpoint() / 1000.0f, 2);
+  json += ",\"heaterDuty\":" + String(tempControl->getDuty() / 10.0f, 1);
+  json += ",\"heaterCycles\":" + String(tempControl->getHeaterCycles());
+  json += ",\"fanCycles\":" + String(tempControl->getFanCycles());
+  // Learned thermal model: slopes in °C/h, coast (overshoot after switch-off) in °C
+  const ThermalParams& thermal = tempControl->getModel().getParams();
+  json += ",\"thermalHeatRate\":" + String(thermal.heatRate * 0.0036f, 2);
+  json += ",\"thermalFanRate\":" + String(thermal.fanRate * 0.0036f, 2);
+  json += ",\"thermalDriftRate\":" + String(thermal.driftRate * 0.0036f, 2);
+  json += ",\"thermalHeatCoast\":" + String(thermal.heatCoast / 1000.0f, 3);
+  json += ",\"thermalFanCoast\":" + String(thermal.fanCoast / 1000.0f, 3);
+  json += ",\"thermalSamples\":" + String(thermal.samples);
+  json += ",\"phSafe\":" + String(snap.phSafe() ? "true" : "false");
+  json += ",\"tempSafe\":" + String(snap.tempSafe() ? "true" : "false");
+  json += ",\"phValid\":" + String(snap.phValid ? "true" : "false");
+  json += ",\"tempValid\":" + String(snap.tempValid ? "true" : "false");
+  json += ",\"sampleSeq\":" + String(snap.sequence);
+  json += ",\"tempMin\":" + String(snap.tempMin, 2);
+  json += ",\"tempMax\":" + String(snap.tempMax, 2);
+  json += ",\"tempProbes\":[";
+  for (uint8_t i = 0; i < snap.probeCount; i++) {
+    if (i > 0) json += ",";
+    if (snap.probeValid[i]) {
+      json += String(snap.probeTemp[i], 2);
+    } else {
+      json += "null";
+    }
+  }
+  json += "]";
+  json += ",\"phIntervalMs\":" + String(sensors->getPHInterval());
+  json += ",\"tempIntervalMs\":" + String(sensors->getTempInterval());
+  json += ",\"phMode\":\"" + String(phSensor->getMode() == PH_MODE_OVERSAMPLE ? "oversample" : "median") + "\"";
+  json += ",\"phAdcBits\":" + String(phSensor->getEffectiveBits());
+  
+  // Control task timing health
+  ControlTaskStats ctrl = controlTask->getStats();
+  json += ",\"controlRunning\":" + String(controlTask->isRunning() ? "true" : "false");
+  json += ",\"controlPeriodMs\":" + String(CONTROL_TASK_PERIOD_MS);
+  json += ",\"controlCycles\":" + String(ctrl.cycles);
+  json += ",\"controlOverruns\":" + String(ctrl.overruns);
+  json += ",\"controlLatenessUs\":" + String(ctrl.lastLatenessUs);
+  json += ",\"controlMaxLatenessUs\":" + String(ctrl.maxLatenessUs);
+  json += ",\"controlMaxJitterUs\":" + String(ctrl.maxJitterUs);
+  json += ",\"controlExecUs\":" + String(ctrl.lastExecUs);
+  json += ",\"controlMaxExecUs\":" + String(ctrl.maxExecUs);
+  
+  // Scheduler jobs: which subsystem is late or over its run-time budget
+  json += ",\"loopJobs\":" + getJobsJSON(loopJobs);
+  json += ",\"controlJobs\":" + getJobsJSON(controlJobs);
   
   json += "}";
   
@@ -187,383 +327,359 @@ void SmartBreederServer::handleAPIStatus() {
 void SmartBreederServer::handleAPIControl() {
   setCORSHeaders();
   
-  if (server->hasArg("plain")) {
-    String body = server->arg("plain");
-    Serial.println("Control command: " + body);
-    
-    bool fanSet = false, acidSet = false, baseSet = false;
-    bool waterHeaterSet = false, airPumpSet = false, waterFlowSet = false;
-    bool rainPumpSet = false, lightControlSet = false;
-    bool fanVal = false, acidVal = false, baseVal = false;
-    bool waterHeaterVal = false, airPumpVal = false, waterFlowVal = false;
-    bool rainPumpVal = false, lightControlVal = false;
-    bool hasError = false;
-    
-    // Parse JSON - handle both true and false values properly
-    // Format: {"fan":true,"acidPump":false,"basePump":false,"waterHeater":true,...}
-    
-    // Helper macro to parse boolean value
-    #define PARSE_BOOL(field, setVar, valVar) \
-      do { \
-        int pos = body.indexOf("\"" #field "\""); \
-        if (pos >= 0) { \
-          setVar = true; \
-          int truePos = body.indexOf("true", pos); \
-          int falsePos = body.indexOf("false", pos); \
-          if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) { \
-            valVar = true; \
-          } else if (falsePos >= 0) { \
-            valVar = false; \
-          } else { \
-            hasError = true; \
-            Serial.println("Error: Invalid " #field " value"); \
-          } \
-        } \
-      } while(0)
-    
-    // Parse all relay controls
-    PARSE_BOOL(fan, fanSet, fanVal);
-    PARSE_BOOL(acidPump, acidSet, acidVal);
-    PARSE_BOOL(basePump, baseSet, baseVal);
-    PARSE_BOOL(waterHeater, waterHeaterSet, waterHeaterVal);
-    PARSE_BOOL(airPump, airPumpSet, airPumpVal);
-    PARSE_BOOL(waterFlow, waterFlowSet, waterFlowVal);
-    PARSE_BOOL(rainPump, rainPumpSet, rainPumpVal);
-    PARSE_BOOL(lightControl, lightControlSet, lightControlVal);
-    
-    #undef PARSE_BOOL
-    
-    if (hasError) {
-      server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON format\"}");
-      return;
-    }
-    
-    // Apply commands
-    if (fanSet) {
-      fanControl->set(fanVal, true);
-      Serial.printf("Fan %s (manual)\n", fanVal ? "ON" : "OFF");
-    }
-    if (acidSet) {
-      phControl->setAcid(acidVal);
-      Serial.printf("Acid pump %s\n", acidVal ? "ON" : "OFF");
-    }
-    if (baseSet) {
-      phControl->setBase(baseVal);
-      Serial.printf("Base pump %s\n", baseVal ? "ON" : "OFF");
-    }
-    if (waterHeaterSet) {
-      digitalWrite(REL_WATER_HEATER, getRelayLevel(waterHeaterVal));
-      // Store manual override flag
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putBool("manual_water_heater", true);
-      prefs.end();
-      Serial.printf("Water heater MANUALLY set to %s (GPIO%d = %s)\n", 
-                    waterHeaterVal ? "ON" : "OFF", 
-                    REL_WATER_HEATER,
-                    digitalRead(REL_WATER_HEATER) == LOW ? "LOW" : "HIGH");
-    }
-    if (airPumpSet) {
-      digitalWrite(REL_AIR_PUMP, getRelayLevel(airPumpVal));
-      // Store manual override flag
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putBool("manual_air_pump", true);
-      prefs.end();
-      Serial.printf("Air pump MANUALLY set to %s (GPIO%d = %s)\n", 
-                    airPumpVal ? "ON" : "OFF", 
-                    REL_AIR_PUMP,
-                    digitalRead(REL_AIR_PUMP) == LOW ? "LOW" : "HIGH");
-    }
-    if (waterFlowSet) {
-      digitalWrite(REL_WATER_FLOW, getRelayLevel(waterFlowVal));
-      // Store manual override flag
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putBool("manual_water_flow", true);
-      prefs.end();
-      Serial.printf("Water flow MANUALLY set to %s (GPIO%d = %s)\n", 
-                    waterFlowVal ? "ON" : "OFF", 
-                    REL_WATER_FLOW,
-                    digitalRead(REL_WATER_FLOW) == LOW ? "LOW" : "HIGH");
-    }
-    if (rainPumpSet) {
-      digitalWrite(REL_RAIN_PUMP, getRelayLevel(rainPumpVal));
-      // Store manual override flag
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putBool("manual_rain_pump", true);
-      prefs.end();
-      Serial.printf("Rain pump MANUALLY set to %s (GPIO%d = %s)\n", 
-                    rainPumpVal ? "ON" : "OFF", 
-                    REL_RAIN_PUMP,
-                    digitalRead(REL_RAIN_PUMP) == LOW ? "LOW" : "HIGH");
-    }
-    if (lightControlSet) {
-      digitalWrite(REL_LIGHT_CTRL, getRelayLevel(lightControlVal));
-      // Store manual override flag
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putBool("manual_light_control", true);
-      prefs.end();
-      Serial.printf("Light control MANUALLY set to %s (GPIO%d = %s)\n", 
-                    lightControlVal ? "ON" : "OFF", 
-                    REL_LIGHT_CTRL,
-                    digitalRead(REL_LIGHT_CTRL) == LOW ? "LOW" : "HIGH");
-    }
-    
-    // Return success response (dashboard expects this format)
-    String response = "{\"success\":true}";
-    server->send(200, "application/json", response);
-  } else {
+  if (!server->hasArg("plain")) {
     server->send(400, "application/json", "{\"success\":false,\"error\":\"Missing request body\"}");
+    return;
+  }
+  String body = server->arg("plain");
+  String reply;
+  int code;
+  {
+    ControlLock lock(controlTask);
+    code = applyControl(body, reply);
+  }
+  server->send(code, "application/json", reply); // Unlocked: a slow client must not stall the control tick
+}
+
+int SmartBreederServer::applyControl(const String& body, String& reply) {
+  Serial.println("Control command: " + body);
+  
+  bool fanSet = false, acidSet = false, baseSet = false;
+  bool waterHeaterSet = false, airPumpSet = false, waterFlowSet = false;
+  bool rainPumpSet = false, lightControlSet = false;
+  bool fanVal = false, acidVal = false, baseVal = false;
+  bool waterHeaterVal = false, airPumpVal = false, waterFlowVal = false;
+  bool rainPumpVal = false, lightControlVal = false;
+  bool hasError = false;
+  
+  // Parse JSON - handle both true and false values properly
+  // Format: {"fan":true,"acidPump":false,"basePump":false,"waterHeater":true,...}
+  
+  // Helper macro to parse boolean value
+  #define PARSE_BOOL(field, setVar, valVar) \
+    do { \
+      int pos = body.indexOf("\"" #field "\""); \
+      if (pos >= 0) { \
+        setVar = true; \
+        int truePos = body.indexOf("true", pos); \
+        int falsePos = body.indexOf("false", pos); \
+        if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) { \
+          valVar = true; \
+        } else if (falsePos >= 0) { \
+          valVar = false; \
+        } else { \
+          hasError = true; \
+          Serial.println("Error: Invalid " #field " value"); \
+        } \
+      } \
+    } while(0)
+  
+  // Parse all relay controls
+  PARSE_BOOL(fan, fanSet, fanVal);
+  PARSE_BOOL(acidPump, acidSet, acidVal);
+  PARSE_BOOL(basePump, baseSet, baseVal);
+  PARSE_BOOL(waterHeater, waterHeaterSet, waterHeaterVal);
+  PARSE_BOOL(airPump, airPumpSet, airPumpVal);
+  PARSE_BOOL(waterFlow, waterFlowSet, waterFlowVal);
+  PARSE_BOOL(rainPump, rainPumpSet, rainPumpVal);
+  PARSE_BOOL(lightControl, lightControlSet, lightControlVal);
+  
+  #undef PARSE_BOOL
+  
+  if (hasError) {
+    reply = "{\"success\":false,\"error\":\"Invalid JSON format\"}";
+    return 400;
+  }
+  
+  // Apply commands
+  if (fanSet) {
+    fanControl->set(fanVal, true);
+    Serial.printf("Fan %s (manual)\n", fanVal ? "ON" : "OFF");
   }
+  if (acidSet) {
+    phControl->setAcid(acidVal);
+    Serial.printf("Acid pump %s\n", acidVal ? "ON" : "OFF");
+  }
+  if (baseSet) {
+    phControl->setBase(baseVal);
+    Serial.printf("Base pump %s\n", baseVal ? "ON" : "OFF");
+  }
+  if (waterHeaterSet) {
+    relays->set(REL_WATER_HEATER, waterHeaterVal);
+    // Store manual override flag
+    configCache.setManual(REL_WATER_HEATER, true);
+    Serial.printf("Water heater MANUALLY set to %s (GPIO%d)\n", waterHeaterVal ? "ON" : "OFF", relayPin(REL_WATER_HEATER));
+  }
+  if (airPumpSet) {
+    relays->set(REL_AIR_PUMP, airPumpVal);
+    // Store manual override flag
+    configCache.setManual(REL_AIR_PUMP, true);
+    Serial.printf("Air pump MANUALLY set to %s (GPIO%d)\n", airPumpVal ? "ON" : "OFF", relayPin(REL_AIR_PUMP));
+  }
+  if (waterFlowSet) {
+    relays->set(REL_WATER_FLOW, waterFlowVal);
+    // Store manual override flag
+    configCache.setManual(REL_WATER_FLOW, true);
+    Serial.printf("Water flow MANUALLY set to %s (GPIO%d)\n", waterFlowVal ? "ON" : "OFF", relayPin(REL_WATER_FLOW));
+  }
+  if (rainPumpSet) {
+    relays->set(REL_RAIN_PUMP, rainPumpVal);
+    // Store manual override flag
+    configCache.setManual(REL_RAIN_PUMP, true);
+    Serial.printf("Rain pump MANUALLY set to %s (GPIO%d)\n", rainPumpVal ? "ON" : "OFF", relayPin(REL_RAIN_PUMP));
+  }
+  if (lightControlSet) {
+    relays->set(REL_LIGHT_CTRL, lightControlVal);
+    // Store manual override flag
+    configCache.setManual(REL_LIGHT_CTRL, true);
+    Serial.printf("Light control MANUALLY set to %s (GPIO%d)\n", lightControlVal ? "ON" : "OFF", relayPin(REL_LIGHT_CTRL));
+  }
+  
+  // Success response (dashboard expects this format)
+  reply = "{\"success\":true}";
+  return 200;
 }
 
 void SmartBreederServer::handleAPISpecies() {
   setCORSHeaders();
   
+  String reply = "{\"success\":false,\"error\":\"Invalid species data\"}";
+  int code = 400;
   if (server->hasArg("plain")) {
     String body = server->arg("plain");
-    Serial.println("Species config: " + body);
-    
-    // Parse custom fish profile from dashboard (Fish Species Database)
-    // Format: {"name":"Goldfish","idealPh":{"min":7.0,"max":9.0},"idealTemp":{"min":24,"max":28},"waterFlow":true,"rain":false}
-    bool hasCustomProfile = false;
-    float customPhMin = 0, customPhMax = 0;
-    float customTempMin = 0, customTempMax = 0;
-    bool customWaterFlow = false;
-    bool customRain = false;
-    String fishName = "";
+    ControlLock lock(controlTask);
+    code = applySpecies(body, reply);
+  }
+  server->send(code, "application/json", reply); // Unlocked: a slow client must not stall the control tick
+}
+
+// reply already holds the 400 answer for data that doesn't parse
+int SmartBreederServer::applySpecies(const String& body, String& reply) {
+  Serial.println("Species config: " + body);
+  
+  // Parse custom fish profile from dashboard (Fish Species Database)
+  // Format: {"name":"Goldfish","idealPh":{"min":7.0,"max":9.0},"idealTemp":{"min":24,"max":28},"waterFlow":true,"rain":false}
+  bool hasCustomProfile = false;
+  float customPhMin = 0, customPhMax = 0;
+  float customTempMin = 0, customTempMax = 0;
+  bool customWaterFlow = false;
+  bool customRain = false;
+  String fishName = "";
+  
+  // Extract custom pH range
+  if (body.indexOf("\"idealPh\"") >= 0) {
+    int phMinPos = body.indexOf("\"min\":");
+    int phMaxPos = body.indexOf("\"max\":");
     
-    // Extract custom pH range
-    if (body.indexOf("\"idealPh\"") >= 0) {
-      int phMinPos = body.indexOf("\"min\":");
-      int phMaxPos = body.indexOf("\"max\":");
+    if (phMinPos >= 0 && phMaxPos >= 0) {
+      // Find the min value (could be in idealPh or idealTemp)
+      int idealPhPos = body.indexOf("\"idealPh\"");
+      int idealTempPos = body.indexOf("\"idealTemp\"");
       
-      if (phMinPos >= 0 && phMaxPos >= 0) {
-        // Find the min value (could be in idealPh or idealTemp)
-        int idealPhPos = body.indexOf("\"idealPh\"");
-        int idealTempPos = body.indexOf("\"idealTemp\"");
-        
-        // Extract pH min
-        if (idealPhPos >= 0 && phMinPos > idealPhPos) {
-          int start = body.indexOf("\"min\":", idealPhPos) + 6;
-          int end = body.indexOf(",", start);
-          if (end < 0) end = body.indexOf("}", start);
-          if (end > start) {
-            customPhMin = body.substring(start, end).toFloat();
-            hasCustomProfile = true;
-          }
+      // Extract pH min
+      if (idealPhPos >= 0 && phMinPos > idealPhPos) {
+        int start = body.indexOf("\"min\":", idealPhPos) + 6;
+        int end = body.indexOf(",", start);
+        if (end < 0) end = body.indexOf("}", start);
+        if (end > start) {
+          customPhMin = body.substring(start, end).toFloat();
+          hasCustomProfile = true;
         }
-        
-        // Extract pH max
-        if (idealPhPos >= 0 && phMaxPos > idealPhPos) {
-          int start = body.indexOf("\"max\":", idealPhPos) + 6;
-          int end = body.indexOf("}", start);
-          if (end < 0) end = body.indexOf(",", start);
-          if (end > start) {
-            customPhMax = body.substring(start, end).toFloat();
-          }
+      }
+      
+      // Extract pH max
+      if (idealPhPos >= 0 && phMaxPos > idealPhPos) {
+        int start = body.indexOf("\"max\":", idealPhPos) + 6;
+        int end = body.indexOf("}", start);
+        if (end < 0) end = body.indexOf(",", start);
+        if (end > start) {
+          customPhMax = body.substring(start, end).toFloat();
         }
-        
-        // Extract temp min
-        if (idealTempPos >= 0) {
-          int start = body.indexOf("\"min\":", idealTempPos) + 6;
-          int end = body.indexOf(",", start);
-          if (end < 0) end = body.indexOf("}", start);
-          if (end > start) {
-            customTempMin = body.substring(start, end).toFloat();
-          }
+      }
+      
+      // Extract temp min
+      if (idealTempPos >= 0) {
+        int start = body.indexOf("\"min\":", idealTempPos) + 6;
+        int end = body.indexOf(",", start);
+        if (end < 0) end = body.indexOf("}", start);
+        if (end > start) {
+          customTempMin = body.substring(start, end).toFloat();
         }
-        
-        // Extract temp max
-        if (idealTempPos >= 0) {
-          int start = body.indexOf("\"max\":", idealTempPos) + 6;
-          int end = body.indexOf("}", start);
-          if (end < 0) end = body.indexOf(",", start);
-          if (end > start) {
-            customTempMax = body.substring(start, end).toFloat();
-          }
+      }
+      
+      // Extract temp max
+      if (idealTempPos >= 0) {
+        int start = body.indexOf("\"max\":", idealTempPos) + 6;
+        int end = body.indexOf("}", start);
+        if (end < 0) end = body.indexOf(",", start);
+        if (end > start) {
+          customTempMax = body.substring(start, end).toFloat();
         }
       }
     }
-    
-    // Extract fish name
-    if (body.indexOf("\"name\"") >= 0) {
-      int nameStart = body.indexOf("\"name\":\"") + 8;
-      int nameEnd = body.indexOf("\"", nameStart);
-      if (nameEnd > nameStart) {
-        fishName = body.substring(nameStart, nameEnd);
-      }
+  }
+  
+  // Extract fish name
+  if (body.indexOf("\"name\"") >= 0) {
+    int nameStart = body.indexOf("\"name\":\"") + 8;
+    int nameEnd = body.indexOf("\"", nameStart);
+    if (nameEnd > nameStart) {
+      fishName = body.substring(nameStart, nameEnd);
     }
-    
-    // Extract waterFlow
-    if (body.indexOf("\"waterFlow\"") >= 0) {
-      int waterFlowPos = body.indexOf("\"waterFlow\":");
-      if (waterFlowPos >= 0) {
-        int truePos = body.indexOf("true", waterFlowPos);
-        int falsePos = body.indexOf("false", waterFlowPos);
-        if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) {
-          customWaterFlow = true;
-        } else if (falsePos >= 0) {
-          customWaterFlow = false;
-        }
+  }
+  
+  // Extract waterFlow
+  if (body.indexOf("\"waterFlow\"") >= 0) {
+    int waterFlowPos = body.indexOf("\"waterFlow\":");
+    if (waterFlowPos >= 0) {
+      int truePos = body.indexOf("true", waterFlowPos);
+      int falsePos = body.indexOf("false", waterFlowPos);
+      if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) {
+        customWaterFlow = true;
+      } else if (falsePos >= 0) {
+        customWaterFlow = false;
       }
     }
-    
-    // Extract rain
-    if (body.indexOf("\"rain\"") >= 0) {
-      int rainPos = body.indexOf("\"rain\":");
-      if (rainPos >= 0) {
-        int truePos = body.indexOf("true", rainPos);
-        int falsePos = body.indexOf("false", rainPos);
-        if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) {
-          customRain = true;
-        } else if (falsePos >= 0) {
-          customRain = false;
-        }
+  }
+  
+  // Extract rain
+  if (body.indexOf("\"rain\"") >= 0) {
+    int rainPos = body.indexOf("\"rain\":");
+    if (rainPos >= 0) {
+      int truePos = body.indexOf("true", rainPos);
+      int falsePos = body.indexOf("false", rainPos);
+      if (truePos >= 0 && (falsePos < 0 || truePos < falsePos)) {
+        customRain = true;
+      } else if (falsePos >= 0) {
+        customRain = false;
       }
     }
+  }
+  
+  // If custom profile provided, save it and update active fish type
+  if (hasCustomProfile && customPhMin > 0 && customPhMax > 0) {
+    // Save custom profile (enables it)
+    configCache.setCustomProfile(fishName, customPhMin, customPhMax, customTempMin, customTempMax,
+                                 customWaterFlow, customRain);
     
-    // If custom profile provided, save it and update active fish type
-    if (hasCustomProfile && customPhMin > 0 && customPhMax > 0) {
-      // Save custom profile to preferences
-      Preferences prefs;
-      prefs.begin(PREF_NAMESPACE, false);
-      prefs.putFloat("custom_ph_min", customPhMin);
-      prefs.putFloat("custom_ph_max", customPhMax);
-      prefs.putFloat("custom_temp_min", customTempMin);
-      prefs.putFloat("custom_temp_max", customTempMax);
-      prefs.putString("custom_fish_name", fishName);
-      prefs.putBool("custom_water_flow", customWaterFlow);
-      prefs.putBool("custom_rain", customRain);
-      prefs.putBool("use_custom_profile", true);
-      prefs.end();
-      
-      Serial.printf("\n=== FISH SPECIES SELECTED FROM DASHBOARD ===\n");
-      Serial.printf("Species Name: %s\n", fishName.c_str());
-      Serial.printf("pH Range: %.1f - %.1f\n", customPhMin, customPhMax);
-      Serial.printf("Temperature Range: %.1f - %.1f°C\n", customTempMin, customTempMax);
-      Serial.printf("Water Flow: %s\n", customWaterFlow ? "ON" : "OFF");
-      Serial.printf("Rain: %s\n", customRain ? "ON" : "OFF");
-      Serial.printf("Custom Profile: ENABLED\n");
-      Serial.printf("pH control will use these ranges for automatic correction\n");
-      Serial.printf("pH check interval: 1 minute\n");
-      Serial.printf("Cooldown period: 1 minute between corrections\n");
-      Serial.printf("==========================================\n\n");
-      
-      // Try to match fish name to existing type for compatibility
-      if (fishName.indexOf("Gold") >= 0 || fishName.indexOf("gold") >= 0) {
-        activeFishType = FISH_GOLD;
-      } else if (fishName.indexOf("Betta") >= 0 || fishName.indexOf("betta") >= 0) {
-        activeFishType = FISH_BETTA;
-      } else if (fishName.indexOf("Guppy") >= 0 || fishName.indexOf("guppy") >= 0) {
-        activeFishType = FISH_GUPPY;
-      } else if (fishName.indexOf("Neon") >= 0 || fishName.indexOf("neon") >= 0 || 
-                 fishName.indexOf("Tetra") >= 0 || fishName.indexOf("tetra") >= 0) {
-        activeFishType = FISH_NEON_TETRA;
-      } else if (fishName.indexOf("Angelfish") >= 0 || fishName.indexOf("angelfish") >= 0 ||
-                 fishName.indexOf("Angel") >= 0 || fishName.indexOf("angel") >= 0) {
-        activeFishType = FISH_ANGELFISH;
-      } else if (fishName.indexOf("Comet") >= 0 || fishName.indexOf("comet") >= 0) {
-        activeFishType = FISH_COMET;
-      } else if (fishName.indexOf("Rohu") >= 0 || fishName.indexOf("rohu") >= 0) {
-        activeFishType = FISH_ROHU;
-      } else {
-        activeFishType = FISH_GOLD; // Default fallback
-      }
-      saveFishType();
-      
-      // DO NOT reset cooldown - always enforce 1-minute wait between corrections
-      // This prevents rapid repeated corrections
-      Serial.println("New species selected - pH control will activate after 1-minute cooldown");
-      Serial.println("pH check interval: 1 minute | Cooldown: 1 minute (enforced)");
-      
-      server->send(200, "application/json", "{\"success\":true,\"message\":\"Custom profile saved and activated\"}");
-      return;
-    }
+    Serial.printf("\n=== FISH SPECIES SELECTED FROM DASHBOARD ===\n");
+    Serial.printf("Species Name: %s\n", fishName.c_str());
+    Serial.printf("pH Range: %.1f - %.1f\n", customPhMin, customPhMax);
+    Serial.printf("Temperature Range: %.1f - %.1f°C\n", customTempMin, customTempMax);
+    Serial.printf("Water Flow: %s\n", customWaterFlow ? "ON" : "OFF");
+    Serial.printf("Rain: %s\n", customRain ? "ON" : "OFF");
+    Serial.printf("Custom Profile: ENABLED\n");
+    Serial.printf("pH control will use these ranges for automatic correction\n");
+    Serial.printf("pH check interval: 1 minute\n");
+    Serial.printf("Cooldown: until pH settles (%lu-%lu s)\n", DOSE_COOLDOWN_MIN / 1000, DOSE_COOLDOWN_MAX / 1000);
+    Serial.printf("==========================================\n\n");
     
-    // Try to parse by type number first (simple format: {"type":1})
-    if (body.indexOf("\"type\"") >= 0) {
-      int typePos = body.indexOf("\"type\":");
-      if (typePos >= 0) {
-        int typeValue = body.substring(typePos + 7).toInt();
-        if (typeValue >= 0 && typeValue <= 7) { // Updated: 8 fish types (0-7)
-          activeFishType = (FishType)typeValue;
-          saveFishType();
-          
-          // Clear custom profile when using predefined type
-          Preferences prefs;
-          prefs.begin(PREF_NAMESPACE, false);
-          prefs.putBool("use_custom_profile", false);
-          prefs.end();
-          
-          Serial.printf("Fish type set to: %s (by type number)\n", FISH_PROFILES[activeFishType].name.c_str());
-          server->send(200, "application/json", "{\"success\":true}");
-          return;
-        }
-      }
+    // Try to match fish name to existing type for compatibility
+    if (fishName.indexOf("Gold") >= 0 || fishName.indexOf("gold") >= 0) {
+      activeFishType = FISH_GOLD;
+    } else if (fishName.indexOf("Betta") >= 0 || fishName.indexOf("betta") >= 0) {
+      activeFishType = FISH_BETTA;
+    } else if (fishName.indexOf("Guppy") >= 0 || fishName.indexOf("guppy") >= 0) {
+      activeFishType = FISH_GUPPY;
+    } else if (fishName.indexOf("Neon") >= 0 || fishName.indexOf("neon") >= 0 || 
+               fishName.indexOf("Tetra") >= 0 || fishName.indexOf("tetra") >= 0) {
+      activeFishType = FISH_NEON_TETRA;
+    } else if (fishName.indexOf("Angelfish") >= 0 || fishName.indexOf("angelfish") >= 0 ||
+               fishName.indexOf("Angel") >= 0 || fishName.indexOf("angel") >= 0) {
+      activeFishType = FISH_ANGELFISH;
+    } else if (fishName.indexOf("Comet") >= 0 || fishName.indexOf("comet") >= 0) {
+      activeFishType = FISH_COMET;
+    } else if (fishName.indexOf("Rohu") >= 0 || fishName.indexOf("rohu") >= 0) {
+      activeFishType = FISH_ROHU;
+    } else {
+      activeFishType = FISH_GOLD; // Default fallback
     }
+    saveFishType();
     
-    // Parse by name (fallback - without custom ranges)
-    if (body.indexOf("\"name\"") >= 0) {
-      if (body.indexOf("\"name\":\"Goldfish\"") >= 0 || body.indexOf("\"name\":\"goldfish\"") >= 0 ||
-          body.indexOf("\"name\":\"Gold Fish\"") >= 0 || body.indexOf("\"name\":\"gold fish\"") >= 0) {
-        activeFishType = FISH_GOLD;
-        saveFishType();
-        Serial.println("Fish type set to: Goldfish (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Betta\"") >= 0 || body.indexOf("\"name\":\"betta\"") >= 0) {
-        activeFishType = FISH_BETTA;
-        saveFishType();
-        Serial.println("Fish type set to: Betta Fish (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Guppy\"") >= 0 || body.indexOf("\"name\":\"guppy\"") >= 0) {
-        activeFishType = FISH_GUPPY;
-        saveFishType();
-        Serial.println("Fish type set to: Guppy (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Neon Tetra\"") >= 0 || body.indexOf("\"name\":\"neon tetra\"") >= 0) {
-        activeFishType = FISH_NEON_TETRA;
-        saveFishType();
-        Serial.println("Fish type set to: Neon Tetra (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Angelfish\"") >= 0 || body.indexOf("\"name\":\"angelfish\"") >= 0) {
-        activeFishType = FISH_ANGELFISH;
-        saveFishType();
-        Serial.println("Fish type set to: Angelfish (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Comet\"") >= 0 || body.indexOf("\"name\":\"comet\"") >= 0) {
-        activeFishType = FISH_COMET;
-        saveFishType();
-        Serial.println("Fish type set to: Comet (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"Rohu\"") >= 0 || body.indexOf("\"name\":\"rohu\"") >= 0) {
-        activeFishType = FISH_ROHU;
-        saveFishType();
-        Serial.println("Fish type set to: Rohu (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
-      } else if (body.indexOf("\"name\":\"None\"") >= 0 || body.indexOf("\"name\":\"none\"") >= 0) {
-        activeFishType = FISH_NONE;
+    // DO NOT reset cooldown - a running lockout still waits for the pH to settle
+    // This prevents rapid repeated corrections
+    Serial.println("New species selected - pH control will activate once any cooldown has settled");
+    Serial.println("pH check interval: 1 minute | Cooldown: until pH settles (enforced)");
+    
+    reply = "{\"success\":true,\"message\":\"Custom profile saved and activated\"}";
+    return 200;
+  }
+  
+  // Try to parse by type number first (simple format: {"type":1})
+  if (body.indexOf("\"type\"") >= 0) {
+    int typePos = body.indexOf("\"type\":");
+    if (typePos >= 0) {
+      int typeValue = body.substring(typePos + 7).toInt();
+      if (typeValue >= 0 && typeValue <= 7) { // Updated: 8 fish types (0-7)
+        activeFishType = (FishType)typeValue;
         saveFishType();
-        Serial.println("Fish type set to: None (by name)");
-        server->send(200, "application/json", "{\"success\":true}");
-        return;
+        
+        // Clear custom profile when using predefined type
+        configCache.setUseCustomProfile(false);
+        
+        Serial.printf("Fish type set to: %s (by type number)\n", FISH_PROFILES[activeFishType].name.c_str());
+        reply = "{\"success\":true}";
+        return 200;
       }
     }
-    
-    Serial.println("Warning: Could not parse species data");
   }
   
-  server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid species data\"}");
+  // Parse by name (fallback - without custom ranges)
+  if (body.indexOf("\"name\"") >= 0) {
+    if (body.indexOf("\"name\":\"Goldfish\"") >= 0 || body.indexOf("\"name\":\"goldfish\"") >= 0 ||
+        body.indexOf("\"name\":\"Gold Fish\"") >= 0 || body.indexOf("\"name\":\"gold fish\"") >= 0) {
+      activeFishType = FISH_GOLD;
+      saveFishType();
+      Serial.println("Fish type set to: Goldfish (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Betta\"") >= 0 || body.indexOf("\"name\":\"betta\"") >= 0) {
+      activeFishType = FISH_BETTA;
+      saveFishType();
+      Serial.println("Fish type set to: Betta Fish (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Guppy\"") >= 0 || body.indexOf("\"name\":\"guppy\"") >= 0) {
+      activeFishType = FISH_GUPPY;
+      saveFishType();
+      Serial.println("Fish type set to: Guppy (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Neon Tetra\"") >= 0 || body.indexOf("\"name\":\"neon tetra\"") >= 0) {
+      activeFishType = FISH_NEON_TETRA;
+      saveFishType();
+      Serial.println("Fish type set to: Neon Tetra (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Angelfish\"") >= 0 || body.indexOf("\"name\":\"angelfish\"") >= 0) {
+      activeFishType = FISH_ANGELFISH;
+      saveFishType();
+      Serial.println("Fish type set to: Angelfish (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Comet\"") >= 0 || body.indexOf("\"name\":\"comet\"") >= 0) {
+      activeFishType = FISH_COMET;
+      saveFishType();
+      Serial.println("Fish type set to: Comet (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"Rohu\"") >= 0 || body.indexOf("\"name\":\"rohu\"") >= 0) {
+      activeFishType = FISH_ROHU;
+      saveFishType();
+      Serial.println("Fish type set to: Rohu (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    } else if (body.indexOf("\"name\":\"None\"") >= 0 || body.indexOf("\"name\":\"none\"") >= 0) {
+      activeFishType = FISH_NONE;
+      saveFishType();
+      Serial.println("Fish type set to: None (by name)");
+      reply = "{\"success\":true}";
+      return 200;
+    }
+  }
+  
+  Serial.println("Warning: Could not parse species data");
+  return 400;
 }
 
 void SmartBreederServer::handleAPISpeciesList() {
@@ -643,31 +759,95 @@ void SmartBreederServer::handleAPICalibrate() {
   
   if (server->hasArg("plain")) {
     String body = server->arg("plain");
+    bool ph7 = body.indexOf("\"action\":\"ph7\"") >= 0;
+    bool ph4 = !ph7 && body.indexOf("\"action\":\"ph4\"") >= 0;
     
-    if (body.indexOf("\"action\":\"ph7\"") >= 0) {
-      phSensor->calibrate7();
-      server->send(200, "application/json", "{\"success\":true,\"message\":\"pH 7.00 calibrated\"}");
-    } else if (body.indexOf("\"action\":\"ph4\"") >= 0) {
-      phSensor->calibrate4();
-      server->send(200, "application/json", "{\"success\":true,\"message\":\"pH 4.00 calibrated\"}");
-    } else if (body.indexOf("\"action\":\"temp\"") >= 0) {
-      // Extract offset value
-      int offsetPos = body.indexOf("\"offset\":");
-      if (offsetPos >= 0) {
-        float offset = body.substring(offsetPos + 9).toFloat();
-        tempSensor->setOffset(offset);
-        server->send(200, "application/json", "{\"success\":true,\"message\":\"Temperature offset set\"}");
-      } else {
-        server->send(400, "application/json", "{\"success\":false,\"error\":\"Missing offset value\"}");
-      }
-    } else {
-      server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid action\"}");
+    // Buffer sampling can wait on analogRead(): take it before the control lock,
+    // so checkEmergency() and the dose deadlines keep running meanwhile
+    int calibrationADC = (ph7 || ph4) ? phSensor->sampleCalibrationADC() : 0;
+    String reply;
+    int code;
+    {
+      ControlLock lock(controlTask);
+      code = applyCalibration(body, calibrationADC, reply);
     }
+    server->send(code, "application/json", reply); // Unlocked: a slow client must not stall the control tick
   } else {
     server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid request\"}");
   }
 }
 
+int SmartBreederServer::applyCalibration(const String& body, int calibrationADC, String& reply) {
+  bool ph7 = body.indexOf("\"action\":\"ph7\"") >= 0;
+  bool ph4 = !ph7 && body.indexOf("\"action\":\"ph4\"") >= 0;
+  
+  if (ph7) {
+    phSensor->calibrate7(calibrationADC);
+    reply = "{\"success\":true,\"message\":\"pH 7.00 calibrated\"}";
+    return 200;
+  } else if (ph4) {
+    phSensor->calibrate4(calibrationADC);
+    reply = "{\"success\":true,\"message\":\"pH 4.00 calibrated\"}";
+    return 200;
+  } else if (body.indexOf("\"action\":\"ph_mode\"") >= 0) {
+    // {"action":"ph_mode","mode":"oversample"} or "median"
+    if (body.indexOf("\"mode\":\"oversample\"") >= 0) {
+      phSensor->setMode(PH_MODE_OVERSAMPLE);
+    } else if (body.indexOf("\"mode\":\"median\"") >= 0) {
+      phSensor->setMode(PH_MODE_MEDIAN);
+    } else {
+      reply = "{\"success\":false,\"error\":\"Invalid mode\"}";
+      return 400;
+    }
+    reply = "{\"success\":true,\"message\":\"pH mode set\"}";
+    return 200;
+  } else if (body.indexOf("\"action\":\"tank\"") >= 0) {
+    // {"action":"tank","litres":120} - sizes every proportional dose
+    int litresPos = body.indexOf("\"litres\":");
+    if (litresPos >= 0 && dosing->setTankLitres((uint32_t)body.substring(litresPos + 9).toInt())) {
+      reply = "{\"success\":true,\"message\":\"Tank volume set\"}";
+      return 200;
+    } else {
+      reply = "{\"success\":false,\"error\":\"Invalid tank volume\"}";
+      return 400;
+    }
+  } else if (body.indexOf("\"action\":\"temp_ctrl\"") >= 0) {
+    // {"action":"temp_ctrl","mode":"pid"|"hysteresis","deadband":0.3} - either field optional
+    bool ok = true;
+    if (body.indexOf("\"mode\":\"pid\"") >= 0) {
+      ok = tempControl->setMode(TEMP_MODE_PID);
+    } else if (body.indexOf("\"mode\":\"hysteresis\"") >= 0) {
+      ok = tempControl->setMode(TEMP_MODE_HYSTERESIS);
+    }
+    int deadbandPos = body.indexOf("\"deadband\":");
+    if (ok && deadbandPos >= 0) {
+      ok = tempControl->setDeadband(toMilli(body.substring(deadbandPos + 11).toFloat()));
+    }
+    if (ok) {
+      reply = "{\"success\":true,\"message\":\"Temperature control updated\"}";
+      return 200;
+    } else {
+      reply = "{\"success\":false,\"error\":\"Invalid temperature control settings\"}";
+      return 400;
+    }
+  } else if (body.indexOf("\"action\":\"temp\"") >= 0) {
+    // Extract offset value
+    int offsetPos = body.indexOf("\"offset\":");
+    if (offsetPos >= 0) {
+      float offset = body.substring(offsetPos + 9).toFloat();
+      tempSensor->setOffset(offset);
+      reply = "{\"success\":true,\"message\":\"Temperature offset set\"}";
+      return 200;
+    } else {
+      reply = "{\"success\":false,\"error\":\"Missing offset value\"}";
+      return 400;
+    }
+  } else {
+    reply = "{\"success\":false,\"error\":\"Invalid action\"}";
+    return 400;
+  }
+}
+
 void SmartBreederServer::handleAPIWiFi() {
   setCORSHeaders();
   
@@ -717,6 +897,107 @@ void SmartBreederServer::handleAPIPing() {
   server->send(200, "application/json", "{\"status\":\"ok\",\"message\":\"pong\"}");
 }
 
+void SmartBreederServer::appendHistoryValue(String& json, int16_t value) {
+  if (value == HISTORY_NO_DATA) {
+    json += "null";
+  } else {
+    json += String(value);
+  }
+}
+
+void SmartBreederServer::appendHistorySample(String& json, const HistorySample& sample, uint32_t t) {
+  json += "[" + String(t) + ",";
+  appendHistoryValue(json, sample.phMilli);
+  json += ",";
+  appendHistoryValue(json, sample.tempCenti);
+  json += "," + String(sample.relays) + "]";
+}
+
+void SmartBreederServer::appendHistoryBucket(String& json, const HistoryBucket& bucket, uint32_t t) {
+  json += "[" + String(t);
+  const int16_t values[] = { bucket.phMin, bucket.phMax, bucket.phMean,
+                             bucket.tempMin, bucket.tempMax, bucket.tempMean };
+  for (int16_t value : values) {
+    json += ",";
+    appendHistoryValue(json, value);
+  }
+  json += "," + String(bucket.heaterDuty) + "," + String(bucket.fanDuty) + "]";
+}
+
+// GET /api/history?tier=raw|minute|quarter[&since=<uptime s>][&limit=<points>]
+// Points are [t, ...fields] with t in uptime seconds at the start of the slot;
+// pH is in milli-pH, temperature in 0.01 °C, null where nothing was measured.
+void SmartBreederServer::handleAPIHistory() {
+  setCORSHeaders();
+  
+  String tierName = server->hasArg("tier") ? server->arg("tier") : String("minute");
+  HistoryTier tier;
+  if (tierName == "raw") {
+    tier = HISTORY_RAW;
+  } else if (tierName == "minute") {
+    tier = HISTORY_MINUTE;
+  } else if (tierName == "quarter") {
+    tier = HISTORY_QUARTER;
+  } else {
+    server->send(400, "application/json", "{\"success\":false,\"error\":\"tier must be raw, minute or quarter\"}");
+    return;
+  }
+  uint32_t period = History::periodOf(tier);
+  const HistoryStream& stream = history->getStream(tier);
+  
+  // Newest `limit` points that start at or after `since`: whole blocks are
+  // skipped by their headers, only the block holding the first point is decoded
+  HistoryCursor cursor(stream);
+  if (server->hasArg("limit")) {
+    long limit = server->arg("limit").toInt();
+    if (limit > 0 && stream.size() > (uint32_t)limit) {
+      cursor.skip(stream.size() - (uint32_t)limit);
+    }
+  }
+  uint32_t sinceSlot = 0;
+  if (server->hasArg("since")) {
+    sinceSlot = (uint32_t)server->arg("since").toInt() / period;
+    cursor.seek(sinceSlot);
+  }
+  
+  // Up to a day of buckets: stream in chunks rather than build one large String
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(200, "application/json", "");
+  String json = "{\"tier\":\"" + tierName + "\"";
+  json += ",\"periodS\":" + String(period);
+  json += ",\"uptimeS\":" + String((uint32_t)(esp_timer_get_time() / 1000000)); // History's clock, not millis()
+  json += ",\"spanS\":" + String(History::spanOf(tier) * period);
+  json += ",\"coverageS\":" + String(history->coverageS(tier)); // Less than spanS if the blocks filled first
+  json += ",\"storedPoints\":" + String(stream.size());
+  json += ",\"encodedBytes\":" + String((unsigned long)stream.encodedBytes());
+  json += ",\"phScale\":1000,\"tempScale\":100";
+  if (tier == HISTORY_RAW) {
+    json += ",\"fields\":[\"t\",\"ph\",\"temp\",\"relays\"]";
+  } else {
+    json += ",\"fields\":[\"t\",\"phMin\",\"phMax\",\"phMean\",\"tempMin\",\"tempMax\",\"tempMean\",\"heaterDuty\",\"fanDuty\"]";
+  }
+  json += ",\"points\":[";
+  HistoryRecord record;
+  uint32_t sent = 0;
+  while (cursor.next(record)) {
+    if (record.slot < sinceSlot) continue;
+    if (sent > 0) json += ",";
+    uint32_t t = record.slot * period;
+    if (tier == HISTORY_RAW) {
+      appendHistorySample(json, History::toSample(record), t);
+    } else {
+      appendHistoryBucket(json, History::toBucket(record), t);
+    }
+    if (++sent % HISTORY_CHUNK_POINTS == 0) {
+      server->sendContent(json);
+      json = "";
+    }
+  }
+  json += "]}";
+  server->sendContent(json);
+  server->sendContent(""); // End of chunked response
+}
+
 String SmartBreederServer::getDashboardHTML() {
   String html = R"HTML(
 <!DOCTYPE html>
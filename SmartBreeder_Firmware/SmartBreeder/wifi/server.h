@@ -10,33 +10,66 @@
 // Forward declarations
 class PHSensor;
 class TempSensor;
+class SensorAcquisition;
 class FanControl;
 class PHControl;
+class ControlTask;
+class RelayBank;
+class DosingEngine;
+class TempControl;
+class RelayRules;
+class Scheduler;
+class History;
+struct HistorySample;
+struct HistoryBucket;
 
 class SmartBreederServer {
 private:
   WebServer* server;
   PHSensor* phSensor;
   TempSensor* tempSensor;
+  SensorAcquisition* sensors;
   FanControl* fanControl;
   PHControl* phControl;
+  ControlTask* controlTask;
+  RelayBank* relays;
+  DosingEngine* dosing;
+  TempControl* tempControl;
+  RelayRules* rules;
+  Scheduler* loopJobs;
+  Scheduler* controlJobs;
+  History* history;
   
   void handleRoot();
   void handleAPIStatus();
   void handleAPIControl();
   void handleAPISpecies();
+  // Run under the control lock; return the HTTP code and fill reply, which the
+  // handler sends after unlocking
+  int applyControl(const String& body, String& reply);
+  int applySpecies(const String& body, String& reply);
+  int applyCalibration(const String& body, int calibrationADC, String& reply);
   void handleAPISpeciesList(); // Get list of all available fish species
   void handleAPICalibrate();
   void handleAPIWiFi();
   void handleAPIPing();
+  void handleAPIHistory();   // Stored pH / temperature / relay history, one tier per request
   void handleOptions();
   void setCORSHeaders();
   
   String getDashboardHTML();
   String getStatusJSON();
+  static String getJobsJSON(Scheduler* jobs);
+  static String getConfigWritesJSON();
+  static void appendHistoryValue(String& json, int16_t value);
+  static void appendHistorySample(String& json, const HistorySample& sample, uint32_t t);
+  static void appendHistoryBucket(String& json, const HistoryBucket& bucket, uint32_t t);
   
 public:
-  SmartBreederServer(PHSensor* ph, TempSensor* temp, FanControl* fan, PHControl* phCtrl);
+  SmartBreederServer(PHSensor* ph, TempSensor* temp, SensorAcquisition* sensors,
+                     FanControl* fan, PHControl* phCtrl, ControlTask* ctrlTask,
+                     RelayBank* relays, DosingEngine* dosing, TempControl* tempCtrl,
+                     RelayRules* rules, Scheduler* loopJobs, Scheduler* controlJobs, History* history);
   void begin();
   void update();
   bool isConnected();
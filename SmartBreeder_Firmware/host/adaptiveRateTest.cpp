@@ -0,0 +1,44 @@
+// Temperature sampling rate through AdaptiveRate as SensorAcquisition drives it:
+// a tank on a DS18B20 quantisation boundary must back off to the ceiling, and
+// a kick() (heater/fan switch) during a long interval must not make the
+// reading in hand stale - that would fire the COND_TEMP_VALID fail-safe rule.
+
+#include "config/config.h"
+#include "sensors/adaptiveRate.h"
+#include "sensors/adaptiveRate.cpp"
+#include "hostTest.h"
+
+// Feed samples at the interval the rate asks for; returns the last sample time
+static unsigned long settle(AdaptiveRate& rate, unsigned long now, int samples) {
+  for (int i = 0; i < samples; i++) {
+    int32_t temp = 26000 + (i & 1) * 63; // One 12-bit LSB of flicker
+    rate.observe(temp, now);
+    if (i + 1 < samples) now += rate.getInterval();
+  }
+  return now;
+}
+
+int main() {
+  AdaptiveRate rate(TEMP_READ_INTERVAL_MIN, TEMP_READ_INTERVAL_MAX, TEMP_STABLE_STEP, TEMP_STABLE_RATE);
+  unsigned long last = settle(rate, 1000, 20);
+  printf("  flicker:  interval %lu ms after 20 samples\n", rate.getInterval());
+  CHECK(rate.getInterval() == TEMP_READ_INTERVAL_MAX);
+
+  // Heater switched 20 s into a 30 s interval: the reading is 20 s old, not stale
+  unsigned long kickAt = last + 20000;
+  rate.kick();
+  CHECK(rate.getInterval() == TEMP_READ_INTERVAL_MIN);
+  CHECK(!rate.isStale(last, kickAt, SENSOR_STALE_MARGIN));
+  CHECK(!rate.isStale(last, last + 2 * TEMP_READ_INTERVAL_MAX + SENSOR_STALE_MARGIN - 1, SENSOR_STALE_MARGIN));
+  printf("  kicked:   interval %lu ms, reading %lu ms old still valid\n", rate.getInterval(), kickAt - last);
+
+  // Conversions really stopped (probe unplugged): stale after the scheduled bound
+  CHECK(rate.isStale(last, last + 2 * TEMP_READ_INTERVAL_MAX + SENSOR_STALE_MARGIN, SENSOR_STALE_MARGIN));
+
+  // The fast sample after the kick lands: from then on its own interval is the bound
+  unsigned long fresh = kickAt + 800;
+  rate.observe(26000, fresh);
+  CHECK(rate.getInterval() < TEMP_READ_INTERVAL_MAX);
+  CHECK(rate.isStale(fresh, fresh + 2 * rate.getInterval() + SENSOR_STALE_MARGIN, SENSOR_STALE_MARGIN));
+  return hostTestResult("adaptiveRateTest");
+}
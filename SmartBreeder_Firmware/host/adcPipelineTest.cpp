@@ -0,0 +1,104 @@
+// Feeds FakeADCSource samples through the ring and the pH filter chains the
+// way PHSensor::readMilli() does in median mode, then times it.
+// The eFuse table is device-only, so counts are converted with an ideal
+// 3.3 V / 4095 line and the default 2.5 V / 3.0 V pH calibration.
+
+#include "config/filterConfig.h"
+#include "sensors/sampleRing.h"
+#include "fakeAdcSource.h"
+#include "hostTest.h"
+
+typedef SampleRing<uint16_t, PH_ADC_RING_SIZE> HostADCRing;
+
+static int32_t countsToMilliPH(uint32_t counts) {
+  const int32_t ph7Microvolts = 2500000, ph4Microvolts = 3000000;
+  const int32_t slopeQ = (int32_t)(((int64_t)3000 << PH_SLOPE_FRAC_BITS) / (ph4Microvolts - ph7Microvolts));
+  int32_t microvolts = (int32_t)((uint64_t)counts * 3300000u / 4095u);
+  return 7000 + (int32_t)(((int64_t)(ph7Microvolts - microvolts) * slopeQ) >> PH_SLOPE_FRAC_BITS);
+}
+
+static uint32_t milliPHToCounts(int32_t milliPH) {
+  int32_t microvolts = 2500000 - (milliPH - 7000) * 1000 / 6;
+  return (uint32_t)((uint64_t)microvolts * 4095u / 3300000u);
+}
+
+// PHSensor::getFilteredADC() + readMilli(), median mode
+struct HostPHPipeline {
+  PHAdcFilter adcFilter;
+  PHValueFilter valueFilter;
+  uint32_t cursor = 0;
+  uint16_t lastADC = 0;
+
+  int32_t readMilli(const HostADCRing& ring) {
+    uint16_t fresh[PH_ADC_RING_SIZE];
+    size_t got = ring.readSince(cursor, fresh, PH_ADC_RING_SIZE);
+    for (size_t i = 0; i < got; i++) {
+      lastADC = adcFilter.apply(fresh[i]);
+    }
+    return valueFilter.apply(countsToMilliPH(lastADC));
+  }
+};
+
+static int32_t absValue(int32_t v) { return v < 0 ? -v : v; }
+
+// Spikes of +800 counts (about -3.9 pH) every 40 samples never reach the output
+static void testSpikeRejection() {
+  HostADCRing ring;
+  HostPHPipeline pipeline;
+  FakeADCSource source(milliPHToCounts(7200), 2.0);
+  source.setSpikes(40, 800);
+
+  int32_t worst = 0;
+  for (int read = 0; read < 500; read++) {
+    source.fill(ring, 50); // 50 ms control tick at 1 kHz
+    int32_t ph = pipeline.readMilli(ring);
+    if (read >= 20) worst = absValue(ph - 7200) > worst ? absValue(ph - 7200) : worst;
+  }
+  printf("  spikes: worst error %ld mpH\n", (long)worst);
+  CHECK(worst < 30);
+}
+
+// A consumer that falls more than a ring behind skips to the newest samples
+static void testLapping() {
+  HostADCRing ring;
+  HostPHPipeline pipeline;
+  FakeADCSource source(milliPHToCounts(7200), 1.0);
+
+  source.fill(ring, 50);
+  pipeline.readMilli(ring);
+  source.setLevel(milliPHToCounts(6500));
+  source.fill(ring, 5000); // Reader stalled for 5 s
+  uint32_t before = pipeline.cursor;
+  int32_t ph = 0;
+  for (int read = 0; read < PH_MEDIAN_SAMPLES; read++) {
+    source.fill(ring, 50);
+    ph = pipeline.readMilli(ring);
+  }
+  CHECK(pipeline.cursor == ring.totalWritten());
+  CHECK(pipeline.cursor - before > 5000); // Skipped, not replayed
+  printf("  lapping: settled at %ld mpH after a 5 s stall\n", (long)ph);
+  CHECK(absValue(ph - 6500) < 20);
+}
+
+static void benchPipeline() {
+  HostADCRing ring;
+  HostPHPipeline pipeline;
+  FakeADCSource source(milliPHToCounts(7000), 2.0);
+
+  const int perRead = 50;
+  uint16_t batch[perRead];
+  for (int i = 0; i < perRead; i++) batch[i] = source.sample();
+  double ns = nsPerCall(200000, [&](unsigned long) {
+    for (int i = 0; i < perRead; i++) ring.push(batch[i]);
+    int32_t ph = pipeline.readMilli(ring);
+    keep(ph);
+  });
+  printf("  bench: %.0f ns per read of %d samples (%.1f ns/sample incl. push)\n", ns, perRead, ns / perRead);
+}
+
+int main() {
+  testSpikeRejection();
+  testLapping();
+  benchPipeline();
+  return hostTestResult("adcPipelineTest");
+}
@@ -0,0 +1,51 @@
+// Pump gain learning as DosingEngine runs it, against a simulated tank. A gain
+// learned far too high plans doses whose response stays under the noise floor;
+// those must pull the gain down rather than be dropped, or it never recovers.
+
+#include "config/config.h"
+#include "control/doseGain.h"
+#include "hostTest.h"
+
+// Correct errorMilli once: plan at the learned gain, respond at the true one,
+// learn from the (noise-free) settled reading. Returns the new gain.
+static int32_t correct(int32_t gain, int32_t trueGain, uint32_t litres, int32_t errorMilli) {
+  uint32_t onTimeUs = doseOnTimeMs(errorMilli, litres, gain) * 1000;
+  int32_t observed = doseResponse(trueGain, litres, onTimeUs);
+  int32_t measured = observedDoseGain(gain, observed, litres, onTimeUs);
+  return measured == 0 ? gain : learnDoseGain(gain, measured);
+}
+
+int main() {
+  const uint32_t litres = 200;
+  const int32_t trueGain = DOSE_GAIN_DEFAULT;
+
+  // Minimum-length doses move this tank 10 mpH: below the floor, but the
+  // overestimated gain predicted far more
+  int32_t gain = DOSE_GAIN_MAX;
+  uint32_t minUs = PUMP_MIN_DOSE_MS * 1000;
+  CHECK(doseResponse(trueGain, litres, minUs) < DOSE_MIN_RESPONSE);
+  CHECK(doseResponse(gain, litres, minUs) >= DOSE_EXPECTED_RESPONSE);
+
+  int doses = 0;
+  while (doses < 40 && (gain > trueGain * 11 / 10 || gain < trueGain * 9 / 10)) {
+    gain = correct(gain, trueGain, litres, 500);
+    doses++;
+  }
+  printf("  recovery: gain %ld -> %ld (true %ld) in %d doses\n",
+         (long)DOSE_GAIN_MAX, (long)gain, (long)trueGain, doses);
+  CHECK(doses < 40);
+
+  // A stalled pump (no response at all) counts as the lowest gain
+  CHECK(observedDoseGain(trueGain, 0, litres, 10000000) == DOSE_GAIN_MIN);
+  CHECK(observedDoseGain(trueGain, -15, litres, 10000000) == DOSE_GAIN_MIN);
+
+  // A small dose the gain itself expected to be sub-floor is still just noise
+  CHECK(doseResponse(trueGain, litres, minUs) < DOSE_EXPECTED_RESPONSE);
+  CHECK(observedDoseGain(trueGain, 5, litres, minUs) == 0);
+
+  // A correct gain holds
+  int32_t held = trueGain;
+  for (int i = 0; i < 10; i++) held = correct(held, trueGain, litres, 500);
+  CHECK(held > trueGain * 95 / 100 && held < trueGain * 105 / 100);
+  return hostTestResult("doseGainTest");
+}
@@ -0,0 +1,60 @@
+#ifndef FAKE_ADC_SOURCE_H
+#define FAKE_ADC_SOURCE_H
+
+// Host stand-in for ADCStream: a pH electrode level in ADC counts plus
+// Gaussian noise and optional periodic spikes, quantised to 12 bits and pushed
+// into a SampleRing one sample at a time, as ADCStream::drain() does.
+// With setAveraging(n) each sample is the truncated mean of n conversions,
+// like the continuous driver's avg_read_raw (PH_ADC_CONVERSIONS_PER_SAMPLE).
+
+#include <stdint.h>
+#include <math.h>
+#include <random>
+
+class FakeADCSource {
+private:
+  std::mt19937 rng;
+  std::normal_distribution<double> noise;
+  double level;        // True signal, fractional ADC counts
+  double noiseCounts;  // Standard deviation of the noise
+  uint32_t spikeEvery; // 0 = no spikes
+  int32_t spikeCounts;
+  uint32_t produced;
+  uint32_t averaging;  // Conversions per sample
+
+  uint16_t conversion() {
+    long raw = lround(level + noiseCounts * noise(rng));
+    if (raw < 0) raw = 0;
+    if (raw > 4095) raw = 4095;
+    return (uint16_t)raw;
+  }
+
+public:
+  FakeADCSource(double level, double noiseCounts, uint32_t seed = 1) :
+    rng(seed), noise(0.0, 1.0), level(level), noiseCounts(noiseCounts),
+    spikeEvery(0), spikeCounts(0), produced(0), averaging(1) {}
+
+  void setLevel(double counts) { level = counts; }
+  double getLevel() const { return level; }
+  void setSpikes(uint32_t every, int32_t counts) { spikeEvery = every; spikeCounts = counts; }
+  uint32_t getProduced() const { return produced; }
+  void setAveraging(uint32_t conversions) { averaging = conversions > 0 ? conversions : 1; }
+
+  uint16_t sample() {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < averaging; i++) sum += conversion();
+    long raw = (long)(sum / averaging);
+    produced++;
+    if (spikeEvery > 0 && produced % spikeEvery == 0) raw += spikeCounts;
+    if (raw < 0) raw = 0;
+    if (raw > 4095) raw = 4095;
+    return (uint16_t)raw;
+  }
+
+  template <typename Ring>
+  void fill(Ring& ring, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) ring.push(sample());
+  }
+};
+
+#endif
@@ -0,0 +1,121 @@
+// The filter stages of sensors/filters.h on their own and chained: integer and
+// float channels, constant inputs, steps and single-sample glitches.
+
+#include "sensors/filters.h"
+#include "hostTest.h"
+
+// Output after feeding n copies of x
+template <typename Filter, typename T>
+static T hold(Filter& f, T x, int n) {
+  T out = x;
+  for (int i = 0; i < n; i++) out = f.apply(x);
+  return out;
+}
+
+static void testClamp() {
+  ClampFilter<int32_t, 0, 14000> phClamp;
+  CHECK(phClamp.apply(-5) == 0);
+  CHECK(phClamp.apply(7000) == 7000);
+  CHECK(phClamp.apply(20000) == 14000);
+  ClampFilter<float, -500, 500> floatClamp;
+  CHECK(floatClamp.apply(2.0f) == 0.5f);
+}
+
+static void testMedian() {
+  MedianFilter<int32_t, 5> median;
+  const int32_t in[] = { 10, 10, 900, 10, 11 };
+  int32_t out = 0;
+  for (int32_t v : in) out = median.apply(v);
+  CHECK(out == 10);
+}
+
+static void testOutlierReject() {
+  OutlierReject<int32_t, 500, 2> reject;
+  reject.apply(7000);
+  CHECK(reject.apply(9000) == 7000);   // Glitch held
+  CHECK(reject.apply(7010) == 7010);
+  reject.apply(9000);
+  reject.apply(9000);
+  CHECK(reject.apply(9000) == 9000);   // Persisting step accepted after MaxRejects
+}
+
+static void testEma() {
+  // Integer channel: converges exactly, both directions, for small alphas too
+  EmaFilter<int32_t, 1, 8> ema;
+  ema.apply(7000);
+  int32_t up = hold(ema, (int32_t)7007, 200);
+  int32_t down = hold(ema, (int32_t)6993, 200);
+  printf("  ema 1/8:  7000 -> 7007 gives %ld, -> 6993 gives %ld\n", (long)up, (long)down);
+  CHECK(up == 7007);
+  CHECK(down == 6993);
+
+  EmaFilter<uint16_t, 1, 16> adcEma;
+  adcEma.apply(2048);
+  CHECK(hold(adcEma, (uint16_t)2051, 300) == 2051);
+  CHECK(hold(adcEma, (uint16_t)2040, 300) == 2040);
+
+  // Smoothing: a single glitch moves the output by alpha of the jump
+  EmaFilter<int32_t, 1, 4> quarter;
+  quarter.apply(1000);
+  CHECK(quarter.apply(2000) == 1250);
+
+  EmaFilter<float, 1, 2> half;
+  half.apply(20.0f);
+  CHECK(half.apply(24.0f) == 22.0f);
+}
+
+static void testMovingAverage() {
+  MovingAverage<int32_t, 4> avg;
+  CHECK(avg.apply(10) == 10);
+  CHECK(avg.apply(20) == 15);
+  avg.apply(30);
+  CHECK(avg.apply(40) == 25);
+  CHECK(avg.apply(50) == 35);          // Oldest sample left the window
+  CHECK(avg.apply(51) == 43);          // 42.75 rounds to nearest
+
+  // uint16_t ADC counts: the sum must not wrap in the sample type
+  MovingAverage<uint16_t, 64> adcAvg;
+  CHECK(hold(adcAvg, (uint16_t)4095, 64) == 4095);
+}
+
+static void testRateLimiter() {
+  RateLimiter<int32_t, 100> limit;
+  limit.apply(7000);
+  CHECK(limit.apply(7500) == 7100);
+  CHECK(limit.apply(7500) == 7200);
+  CHECK(limit.apply(7150) == 7150);    // Within the step: passes through
+  CHECK(limit.apply(6000) == 7050);
+
+  // Float channel: the step is 500 milli-units = 0.5 °C
+  RateLimiter<float, 500> temp;
+  temp.apply(25.0f);
+  CHECK(temp.apply(27.0f) == 25.5f);
+  CHECK(temp.apply(25.2f) == 25.2f);
+}
+
+static void testChain() {
+  typedef FilterChain<int32_t,
+    ClampFilter<int32_t, 0, 14000>,
+    OutlierReject<int32_t, 1000, 2>,
+    EmaFilter<int32_t, 1, 2>,
+    RateLimiter<int32_t, 200>
+  > Chain;
+  static_assert(Chain::stageCount == 4, "Four stages");
+  Chain chain;
+  chain.apply(7000);
+  CHECK(chain.apply(30000) == 7000);   // Clamped to 14000, then rejected as a glitch
+  CHECK(hold(chain, (int32_t)7300, 20) == 7300);
+  chain.reset();
+  CHECK(chain.apply(5000) == 5000);    // Reset reseeds every stage
+}
+
+int main() {
+  testClamp();
+  testMedian();
+  testOutlierReject();
+  testEma();
+  testMovingAverage();
+  testRateLimiter();
+  testChain();
+  return hostTestResult("filterTest");
+}
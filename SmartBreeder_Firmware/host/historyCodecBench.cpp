@@ -0,0 +1,173 @@
+// History codec on the host: exact round trip and encode/decode speed of
+// HistoryStream, then a month of 1 s samples through History for a typical
+// tank and for noise that does not compress, reporting what each tier holds.
+// The raw tier must keep its whole span either way; bucket tiers report it.
+// Last, recording across the 2^32 ms point where millis() / 1000 wraps.
+
+#include "config/config.h"
+#include "sensors/historyCodec.h"
+#include "sensors/historyCodec.cpp"
+#include "sensors/history.h"
+#include "sensors/history.cpp"
+#include "hostTest.h"
+#include <math.h>
+#include <random>
+#include <vector>
+
+const uint16_t BENCH_BLOCKS = 64;
+const uint32_t BENCH_RECORDS = 20000;
+const uint32_t MONTH_S = 31 * 24 * 3600;
+
+// Raw-tier-like records: slow pH and temperature, DS18B20 steps, relay toggles,
+// a missed second now and then and the odd NO_DATA
+static std::vector<HistoryRecord> typicalRecords() {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0, 1);
+  std::vector<HistoryRecord> records;
+  int heater = 0;
+  for (uint32_t s = 0; s < BENCH_RECORDS; s++) {
+    if (s % 997 == 0) continue;
+    if (s % 300 == 0) heater = !heater;
+    HistoryRecord r = {};
+    r.slot = s;
+    r.values[HRAW_PH] = s % 5000 == 17 ? HISTORY_NO_DATA : (int16_t)lround(7200 + 50 * sin(s / 5000.0) + 3 * noise(rng));
+    r.values[HRAW_TEMP] = (int16_t)lround(round((2650 + 30 * sin(s / 3000.0)) / 6.25) * 6.25);
+    r.values[HRAW_RELAYS] = heater ? relayBit(REL_WATER_HEATER) : 0;
+    records.push_back(r);
+  }
+  return records;
+}
+
+// Nothing compresses: random values and random steps between slots
+static std::vector<HistoryRecord> worstRecords() {
+  std::mt19937 rng(2);
+  std::vector<HistoryRecord> records;
+  uint32_t slot = 0;
+  for (uint32_t i = 0; i < BENCH_RECORDS; i++) {
+    slot += 1 + rng() % 5000;
+    HistoryRecord r = {};
+    r.slot = slot;
+    for (uint8_t c = 0; c < HRAW_CHANNELS; c++) r.values[c] = (int16_t)rng();
+    records.push_back(r);
+  }
+  return records;
+}
+
+static void roundTrip(const char* name, const std::vector<HistoryRecord>& records) {
+  static HistoryBlock blocks[BENCH_BLOCKS];
+  HistoryStream stream(blocks, BENCH_BLOCKS, HRAW_CHANNELS);
+  double encodeNs = nsPerCall(records.size(), [&](unsigned long i) { stream.append(records[i]); });
+
+  // The stream keeps the newest records; every one must decode exactly
+  size_t first = records.size() - stream.size();
+  size_t matched = 0;
+  HistoryCursor cursor(stream);
+  HistoryRecord out;
+  for (size_t i = first; cursor.next(out); i++) {
+    bool same = i < records.size() && out.slot == records[i].slot;
+    for (uint8_t c = 0; same && c < HRAW_CHANNELS; c++) same = out.values[c] == records[i].values[c];
+    if (same) matched++;
+  }
+  CHECK(stream.size() > 0);
+  CHECK(matched == stream.size());
+
+  double decodeNs = nsPerCall(20, [&](unsigned long) {
+    HistoryCursor pass(stream);
+    HistoryRecord r;
+    while (pass.next(r)) keep(r);
+  }) / stream.size();
+
+  printf("  %-8s %5u records kept, %.2f B/record (13 B as floats), encode %.1f ns, decode %.1f ns per record\n",
+         name, stream.size(), stream.encodedBytes() / (double)stream.size(), encodeNs, decodeNs);
+}
+
+// History holds pointers into its own block arrays: one static object per run
+static History typicalHistory;
+static History noisyHistory;
+static History wrapHistory;
+
+static void monthOfSamples(const char* name, History& history, bool noisy) {
+  std::mt19937 rng(3);
+  std::normal_distribution<double> noise(0, 1);
+  int heater = 0;
+  double temp = 26500;
+  for (uint32_t s = 0; s < MONTH_S; s++) {
+    int32_t ph, tempMilli;
+    uint8_t relays;
+    if (noisy) {
+      ph = 4000 + (int32_t)(rng() % 6000);
+      tempMilli = 15000 + (int32_t)(rng() % 20000);
+      relays = (uint8_t)rng();
+    } else {
+      temp += heater ? 0.5 : -0.2;
+      if (temp < 26000) heater = 1;
+      if (temp > 27000) heater = 0;
+      ph = lround(7200 + 80 * sin(s / 40000.0) + 3 * noise(rng));
+      tempMilli = lround(round(temp / 62.5) * 62.5);
+      relays = (heater ? relayBit(REL_WATER_HEATER) : 0) | relayBit(REL_LIGHT_CTRL);
+    }
+    history.record(s, true, ph, true, tempMilli, relays);
+  }
+
+  static const char* tierNames[] = { "raw", "minute", "quarter" };
+  printf("  %s:\n", name);
+  for (uint8_t t = 0; t < HISTORY_TIER_COUNT; t++) {
+    HistoryTier tier = (HistoryTier)t;
+    const HistoryStream& stream = history.getStream(tier);
+    uint32_t spanS = History::spanOf(tier) * History::periodOf(tier);
+    printf("    %-7s %5u points, %.2f B/point, holds %lu s of %lu s (%.0f%%)\n", tierNames[t], stream.size(),
+           stream.encodedBytes() / (double)stream.size(), (unsigned long)history.coverageS(tier),
+           (unsigned long)spanS, 100.0 * history.coverageS(tier) / spanS);
+
+    // Dropped by time: the oldest block still reaches into the span
+    uint32_t newest = stream.newestSlot();
+    CHECK(stream.getBlock(0).lastSlot + History::spanOf(tier) > newest);
+    if (!noisy || tier == HISTORY_RAW) CHECK(history.coverageS(tier) >= spanS);
+  }
+}
+
+
+static void acrossMillisWrap() {
+  // Seconds from the 64-bit uptime run straight through 2^32 ms
+  const uint32_t wrapS = (uint32_t)(4294967296ULL / 1000);
+  const uint32_t from = wrapS - 2 * 24 * 3600;
+  const uint32_t to = wrapS + 2 * 24 * 3600;
+  for (uint32_t s = from; s < to; s++) {
+    wrapHistory.record(s, true, 7200 + (int32_t)(s % 7), true, 26500, 0);
+  }
+  CHECK(wrapHistory.getRecorded() == to - from);
+  CHECK(wrapHistory.getRestarts() == 0);
+  CHECK(wrapHistory.getStream(HISTORY_RAW).newestSlot() == to - 1);
+  CHECK(wrapHistory.getStream(HISTORY_MINUTE).newestSlot() == (to - 1) / HISTORY_MINUTE_S - 1); // Last closed bucket
+  CHECK(wrapHistory.coverageS(HISTORY_RAW) >= HISTORY_RAW_SPAN);
+  CHECK(wrapHistory.coverageS(HISTORY_MINUTE) >= HISTORY_MINUTE_SPAN * HISTORY_MINUTE_S);
+  printf("  monotonic: %lu s recorded through %lu s, minute tier holds %lu s\n",
+         (unsigned long)wrapHistory.getRecorded(), (unsigned long)wrapS,
+         (unsigned long)wrapHistory.coverageS(HISTORY_MINUTE));
+
+  // A clock that does wrap (millis() / 1000) starts the tiers over instead of stalling
+  for (uint32_t s = 0; s < HISTORY_RAW_SPAN; s++) {
+    wrapHistory.record(s, true, 7200, true, 26500, 0);
+  }
+  CHECK(wrapHistory.getRestarts() == 1);
+  CHECK(wrapHistory.getRecorded() == to - from + HISTORY_RAW_SPAN);
+  CHECK(wrapHistory.getStream(HISTORY_RAW).oldestSlot() == 0);
+  CHECK(wrapHistory.getStream(HISTORY_RAW).newestSlot() == HISTORY_RAW_SPAN - 1);
+  CHECK(wrapHistory.getStream(HISTORY_QUARTER).newestSlot() < wrapS / HISTORY_QUARTER_S);
+  printf("  wrapped:   restarted %lu time(s), raw tier holds %lu s after the wrap\n",
+         (unsigned long)wrapHistory.getRestarts(), (unsigned long)wrapHistory.coverageS(HISTORY_RAW));
+}
+
+int main() {
+  printf("HistoryStream round trip (%u blocks of %u B):\n", BENCH_BLOCKS, HISTORY_BLOCK_BYTES);
+  roundTrip("typical", typicalRecords());
+  roundTrip("worst", worstRecords());
+
+  printf("History, 31 days of 1 s samples (%u bytes static):\n", (unsigned)sizeof(History));
+  monthOfSamples("typical tank", typicalHistory, false);
+  monthOfSamples("random noise", noisyHistory, true);
+
+  printf("History across the millis() wrap:\n");
+  acrossMillisWrap();
+  return hostTestResult("historyCodecBench");
+}
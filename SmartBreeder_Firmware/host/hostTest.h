@@ -0,0 +1,37 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+// Minimal check/timing helpers shared by the host tests. A failed CHECK is
+// reported and counted; main() returns hostTestResult() so `make test` stops.
+
+#include <stdio.h>
+#include <chrono>
+
+static int hostTestFailures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    hostTestFailures++; \
+  } \
+} while (0)
+
+// Nanoseconds per iteration of fn(i) over `iterations` calls
+template <typename Fn>
+double nsPerCall(unsigned long iterations, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++) fn(i);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+// Keeps benchmark results alive without printing them
+template <typename T>
+inline void keep(const T& value) { asm volatile("" : : "g"(&value) : "memory"); }
+
+static int hostTestResult(const char* name) {
+  printf("%s: %s\n", name, hostTestFailures ? "FAILED" : "ok");
+  return hostTestFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,149 @@
+// Synthetic noisy ADC data through both PHSensor acquisition modes:
+// median mode (PHAdcFilter over every sample, 12 bits) against oversample
+// mode (sum the newest 4^n samples and shift right by n, 12 + n bits), the
+// same arithmetic as PHSensor::getOversampledMicrovolts().
+// Everything is compared in oversampled units (1 count = 1 << n units).
+// On the device every ring sample is already the truncated mean of
+// PH_ADC_CONVERSIONS_PER_SAMPLE conversions, which leaves less noise to act as
+// dither; the device case is fed such samples and reports the bit gain left.
+// Errors are taken about their mean: the driver's truncation is a constant
+// offset that pH calibration absorbs.
+
+#include "config/filterConfig.h"
+#include "sensors/sampleRing.h"
+#include "fakeAdcSource.h"
+#include "hostTest.h"
+#include <set>
+
+typedef SampleRing<uint16_t, PH_ADC_RING_SIZE> HostADCRing;
+
+const double UNITS_PER_COUNT = 1 << PH_OVERSAMPLE_EXTRA_BITS;
+
+static uint32_t oversampled(const HostADCRing& ring) {
+  return ring.sumLatest(PH_OVERSAMPLE_COUNT) >> PH_OVERSAMPLE_EXTRA_BITS;
+}
+
+struct ModeResult {
+  double rmsErrorCounts;  // About the mean error
+  size_t levels;       // Distinct outputs over the sweep
+  double stepCounts;   // Smallest change between distinct outputs
+};
+
+static ModeResult summarise(double error, double squaredError, size_t n, const std::set<uint32_t>& seen) {
+  ModeResult r;
+  double mean = error / n;
+  r.rmsErrorCounts = sqrt(squaredError / n - mean * mean) / UNITS_PER_COUNT;
+  r.levels = seen.size();
+  uint32_t step = UINT32_MAX;
+  for (auto it = seen.begin(), next = std::next(it); next != seen.end(); ++it, ++next) {
+    if (*next - *it < step) step = *next - *it;
+  }
+  r.stepCounts = step / UNITS_PER_COUNT;
+  return r;
+}
+
+// Sweep the true level across 2 counts in 1/64-count steps and read both modes;
+// noiseCounts is per conversion, averaging the conversions per ring sample
+static void sweep(double noiseCounts, uint32_t averaging, ModeResult& median, ModeResult& oversample) {
+  HostADCRing ring;
+  FakeADCSource source(2048.0, noiseCounts);
+  source.setAveraging(averaging);
+  PHAdcFilter adcFilter;
+  uint32_t cursor = 0;
+  uint16_t lastADC = 0;
+  double medianError = 0, oversampleError = 0;
+  double medianSquared = 0, oversampleSquared = 0;
+  std::set<uint32_t> medianSeen, oversampleSeen;
+  size_t reads = 0;
+
+  for (int step = 0; step <= 128; step++) {
+    source.setLevel(2048.0 + step / 64.0);
+    for (int read = 0; read < 20; read++) {
+      source.fill(ring, 50);
+      uint16_t fresh[PH_ADC_RING_SIZE];
+      size_t got = ring.readSince(cursor, fresh, PH_ADC_RING_SIZE);
+      for (size_t i = 0; i < got; i++) lastADC = adcFilter.apply(fresh[i]);
+
+      double truth = source.getLevel() * UNITS_PER_COUNT;
+      uint32_t m = (uint32_t)lastADC << PH_OVERSAMPLE_EXTRA_BITS;
+      uint32_t o = oversampled(ring);
+      medianError += m - truth;
+      oversampleError += o - truth;
+      medianSquared += (m - truth) * (m - truth);
+      oversampleSquared += (o - truth) * (o - truth);
+      medianSeen.insert(m);
+      oversampleSeen.insert(o);
+      reads++;
+    }
+  }
+  median = summarise(medianError, medianSquared, reads, medianSeen);
+  oversample = summarise(oversampleError, oversampleSquared, reads, oversampleSeen);
+}
+
+static void report(const char* name, const ModeResult& r) {
+  printf("    %-10s rms error %.3f counts, %3zu levels, finest step %.2f counts\n",
+         name, r.rmsErrorCounts, r.levels, r.stepCounts);
+}
+
+// Effective bits oversampling adds over median mode, from the error ratio
+static double bitGain(const ModeResult& median, const ModeResult& oversample) {
+  return log2(median.rmsErrorCounts / oversample.rmsErrorCounts);
+}
+
+int main() {
+  ModeResult median, oversample;
+
+  // Shipped path: ring samples are driver means of 20 conversions with a few
+  // counts of ESP32 ADC noise each. Finer steps, but about one bit, not n.
+  sweep(2.0, PH_ADC_CONVERSIONS_PER_SAMPLE, median, oversample);
+  printf("  noise 2.0 counts, %lu conversions per sample (device):\n",
+         (unsigned long)PH_ADC_CONVERSIONS_PER_SAMPLE);
+  report("median", median);
+  report("oversample", oversample);
+  printf("    gain %.2f of %u bits\n", bitGain(median, oversample), PH_OVERSAMPLE_EXTRA_BITS);
+  CHECK(oversample.stepCounts == 1.0 / UNITS_PER_COUNT);
+  CHECK(oversample.levels > 2 * median.levels);
+  CHECK(bitGain(median, oversample) > 0.5);
+
+  // Single conversions per sample keep all their noise as dither
+  sweep(1.0, 1, median, oversample);
+  printf("  noise 1.0 count, single conversions:\n");
+  report("median", median);
+  report("oversample", oversample);
+  printf("    gain %.2f of %u bits\n", bitGain(median, oversample), PH_OVERSAMPLE_EXTRA_BITS);
+  CHECK(median.stepCounts == 1.0);
+  CHECK(oversample.stepCounts == 1.0 / UNITS_PER_COUNT);
+  CHECK(oversample.levels > 2 * median.levels);
+  CHECK(oversample.rmsErrorCounts < median.rmsErrorCounts);
+
+  // Without noise there is nothing to dither: no resolution gain, no loss
+  sweep(0.0, PH_ADC_CONVERSIONS_PER_SAMPLE, median, oversample);
+  printf("  noise-free:\n");
+  report("median", median);
+  report("oversample", oversample);
+  CHECK(oversample.rmsErrorCounts <= median.rmsErrorCounts + 0.01);
+
+  // CPU per published reading at a 50 ms tick (50 new samples)
+  HostADCRing ring;
+  FakeADCSource source(2048.0, 1.0);
+  source.fill(ring, PH_ADC_RING_SIZE);
+  uint16_t batch[50];
+  for (int i = 0; i < 50; i++) batch[i] = source.sample();
+  PHAdcFilter adcFilter;
+  uint32_t cursor = 0;
+  double medianNs = nsPerCall(200000, [&](unsigned long) {
+    for (int i = 0; i < 50; i++) ring.push(batch[i]);
+    uint16_t fresh[PH_ADC_RING_SIZE];
+    size_t got = ring.readSince(cursor, fresh, PH_ADC_RING_SIZE);
+    uint16_t last = 0;
+    for (size_t i = 0; i < got; i++) last = adcFilter.apply(fresh[i]);
+    keep(last);
+  });
+  double oversampleNs = nsPerCall(200000, [&](unsigned long) {
+    for (int i = 0; i < 50; i++) ring.push(batch[i]);
+    uint32_t o = oversampled(ring);
+    keep(o);
+  });
+  printf("  per reading incl. 50 pushes: median %.0f ns, oversample %.0f ns\n", medianNs, oversampleNs);
+  return hostTestResult("oversampleTest");
+}
@@ -0,0 +1,103 @@
+// SlidingMedian against the quickselect it replaced (copy the window, then
+// select the middle on every read) for the window sizes we want to run:
+// same median as a full sort, and the per-sample cost of each.
+
+#include "sensors/slidingMedian.h"
+#include "hostTest.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Quickselect as PHSensor::calculateMedian() had it before SlidingMedian
+template <typename T>
+static int partition(T arr[], int left, int right, int pivotIndex) {
+  T pivotValue = arr[pivotIndex];
+  std::swap(arr[pivotIndex], arr[right]);
+  int storeIndex = left;
+  for (int i = left; i < right; i++) {
+    if (arr[i] < pivotValue) {
+      std::swap(arr[storeIndex], arr[i]);
+      storeIndex++;
+    }
+  }
+  std::swap(arr[right], arr[storeIndex]);
+  return storeIndex;
+}
+
+template <typename T>
+static T quickSelect(T arr[], int left, int right, int k) {
+  if (left == right) return arr[left];
+  int pivotIndex = partition(arr, left, right, left + ((right - left) >> 1));
+  if (k == pivotIndex) return arr[k];
+  if (k < pivotIndex) return quickSelect(arr, left, pivotIndex - 1, k);
+  return quickSelect(arr, pivotIndex + 1, right, k);
+}
+
+template <typename T, size_t N>
+struct QuickSelectWindow {
+  T samples[N];
+  size_t head = 0;
+  size_t count = 0;
+
+  T pushAndMedian(T v) {
+    samples[head] = v;
+    head = (head + 1) % N;
+    if (count < N) count++;
+    T temp[N];
+    memcpy(temp, samples, sizeof(T) * count);
+    return quickSelect(temp, 0, (int)count - 1, (int)(count >> 1));
+  }
+};
+
+static std::vector<uint16_t> noisyADC(size_t n) {
+  std::mt19937 rng(7);
+  std::normal_distribution<double> noise(0.0, 6.0);
+  std::vector<uint16_t> v(n);
+  for (size_t i = 0; i < n; i++) {
+    double x = 2048 + 300 * sin(i / 5000.0) + noise(rng);
+    if (i % 97 == 0) x += 900; // Spikes
+    v[i] = (uint16_t)x;
+  }
+  return v;
+}
+
+template <size_t N>
+static void run(const std::vector<uint16_t>& input) {
+  // Correctness against a full sort of the same window
+  SlidingMedian<uint16_t, N> sliding;
+  std::vector<uint16_t> window;
+  bool same = true;
+  for (size_t i = 0; i < 20000; i++) {
+    sliding.push(input[i]);
+    window.push_back(input[i]);
+    if (window.size() > N) window.erase(window.begin());
+    std::vector<uint16_t> sorted = window;
+    std::sort(sorted.begin(), sorted.end());
+    same &= sorted[sorted.size() / 2] == sliding.median();
+  }
+  CHECK(same);
+
+  const size_t iterations = input.size();
+  SlidingMedian<uint16_t, N> timedSliding;
+  double slidingNs = nsPerCall(iterations, [&](unsigned long i) {
+    timedSliding.push(input[i]);
+    uint16_t m = timedSliding.median();
+    keep(m);
+  });
+  QuickSelectWindow<uint16_t, N> timedQuick;
+  double quickNs = nsPerCall(iterations, [&](unsigned long i) {
+    uint16_t m = timedQuick.pushAndMedian(input[i]);
+    keep(m);
+  });
+  printf("  N=%2zu: sliding %6.1f ns/sample, quickselect %6.1f ns/sample (%.1fx)\n",
+         N, slidingNs, quickNs, quickNs / slidingNs);
+}
+
+int main() {
+  std::vector<uint16_t> input = noisyADC(2000000);
+  run<9>(input);
+  run<15>(input);
+  run<31>(input);
+  run<63>(input);
+  return hostTestResult("slidingMedianBench");
+}
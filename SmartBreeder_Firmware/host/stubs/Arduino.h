@@ -0,0 +1,28 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of Arduino.h for config/config.h and the hardware-independent
+// headers to compile on the host. Nothing here talks to hardware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+class String {
+private:
+  std::string s;
+public:
+  String() {}
+  String(const char* c) : s(c ? c : "") {}
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return (unsigned int)s.size(); }
+};
+
+class IPAddress {
+public:
+  IPAddress(uint8_t, uint8_t, uint8_t, uint8_t) {}
+};
+
+#endif
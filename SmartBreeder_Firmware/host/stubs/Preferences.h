@@ -0,0 +1,7 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+// config/config.h includes this; no host code touches NVS
+class Preferences {};
+
+#endif
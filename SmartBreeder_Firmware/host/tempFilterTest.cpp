@@ -0,0 +1,50 @@
+// One DS18B20 probe through TempSensor::collectConversion()'s gate and
+// TempValueFilter: the power-on 85 °C value must never be published.
+
+#include "config/filterConfig.h"
+#include "hostTest.h"
+
+// Published value per conversion, NAN where the probe counts as invalid
+static void feed(const float* readings, size_t n, float* published) {
+  TempValueFilter filter;
+  for (size_t i = 0; i < n; i++) {
+    published[i] = isTempSentinel(readings[i]) ? NAN : filter.apply(readings[i]);
+  }
+}
+
+static void print(const char* name, const float* v, size_t n) {
+  printf("  %-10s", name);
+  for (size_t i = 0; i < n; i++) printf(" %5.1f", v[i]);
+  printf("\n");
+}
+
+int main() {
+  // Power-on: the first read before any conversion finished
+  const float powerOn[] = { 85.0f, 25.0f, 25.0f, 25.0f, 25.0f, 25.0f };
+  float out[6];
+  feed(powerOn, 6, out);
+  print("power-on", out, 6);
+  CHECK(isnan(out[0]));
+  for (size_t i = 1; i < 6; i++) CHECK(out[i] == 25.0f);
+
+  // Probe reset mid-run (brown-out) and a failed read
+  const float midRun[] = { 25.0f, 25.0f, 85.0f, 25.1f, -127.0f, 25.1f };
+  feed(midRun, 6, out);
+  print("reset", out, 6);
+  for (size_t i = 0; i < 6; i++) CHECK(isnan(out[i]) || (out[i] >= 25.0f && out[i] <= 25.1f));
+
+  // Non-sentinel glitch: held by OutlierReject and the median
+  const float glitch[] = { 25.0f, 25.0f, 33.0f, 25.0f, 25.0f, 25.0f };
+  feed(glitch, 6, out);
+  print("glitch", out, 6);
+  for (size_t i = 0; i < 6; i++) CHECK(out[i] < 26.0f);
+
+  // A real step beyond 5 °C is accepted once it persists
+  const float step[] = { 25.0f, 25.0f, 31.0f, 31.0f, 31.0f, 31.0f };
+  feed(step, 6, out);
+  print("step", out, 6);
+  CHECK(out[5] == 31.0f);
+
+  for (size_t i = 0; i < 6; i++) CHECK(out[i] < TEMP_MAX_SAFE);
+  return hostTestResult("tempFilterTest");
+}
@@ -0,0 +1,187 @@
+// Replays a temperature trace through ThermalModel and reports what it learned
+// and how well it predicts the next five minutes.
+//
+//   ./thermalReplay                  synthetic tank with known behaviour (self-check)
+//   ./thermalReplay trace.csv        lines of time_ms,temp_mC,heater,fan ('#' comments)
+//   ./thermalReplay history.json     saved GET /api/history?tier=raw response
+//
+// The synthetic tank heats through an element with a 5 min lag, so the
+// temperature keeps rising after the heater switches off (the coast the
+// model must learn); readings are quantised to the DS18B20's 1/16 °C.
+
+#include "config/config.h"
+#include "control/thermalModel.h"
+#include "control/thermalModel.cpp"
+#include "hostTest.h"
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+struct TracePoint {
+  uint32_t timeMs;
+  int32_t tempMilli;
+  bool heater;
+  bool fan;
+};
+
+static bool readFile(const char* path, std::string& text) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+  fclose(f);
+  return true;
+}
+
+static void parseCSV(const std::string& text, std::vector<TracePoint>& trace) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos) end = text.size();
+    std::string line = text.substr(pos, end - pos);
+    pos = end + 1;
+    unsigned long t;
+    long temp;
+    int heater, fan;
+    if (line.empty() || line[0] == '#') continue;
+    if (sscanf(line.c_str(), "%lu,%ld,%d,%d", &t, &temp, &heater, &fan) == 4) {
+      trace.push_back({ (uint32_t)t, (int32_t)temp, heater != 0, fan != 0 });
+    }
+  }
+}
+
+// Raw-tier points are [t s, ph, temp 0.01 °C, relay mask]; null temperatures are skipped
+static void parseHistoryJSON(const std::string& text, std::vector<TracePoint>& trace) {
+  size_t pos = text.find("\"points\":[");
+  if (pos == std::string::npos) return;
+  const char* p = text.c_str() + pos + 10;
+  while (*p == '[') {
+    char* next;
+    unsigned long t = strtoul(p + 1, &next, 10);
+    next = strchr(next, ',') + 1;             // Skip pH
+    next = strchr(next, ',') + 1;
+    bool valid = strncmp(next, "null", 4) != 0;
+    long tempCenti = strtol(next, &next, 10);
+    next = strchr(next, ',') + 1;
+    unsigned long relays = strtoul(next, &next, 10);
+    if (valid) {
+      trace.push_back({ (uint32_t)(t * 1000), (int32_t)(tempCenti * 10),
+                        (relays & relayBit(REL_WATER_HEATER)) != 0, (relays & relayBit(REL_COOLER_FAN)) != 0 });
+    }
+    p = strchr(next, ']') + 1;
+    if (*p == ',') p++;
+  }
+}
+
+// Tank at 25 °C target with a plain 0.3 °C hysteresis heater, 5 s samples, 24 h
+static void synthesise(std::vector<TracePoint>& trace, double& heatRate, double& driftRate, double& coast) {
+  const double power = 600.0;   // µ°C/s delivered once the element is hot
+  const double loss = 100.0;    // µ°C/s to the room, heater or not
+  const double lagS = 300.0;
+  const double dt = 5.0;
+  double temp = 24000.0, element = 0.0;
+  bool heater = false;
+  double heatSum = 0, driftSum = 0;
+  int heatN = 0, driftN = 0;
+  double offTemp = 0, peak = 0, coastSum = 0;
+  int coasts = 0;
+  bool coasting = false;
+
+  for (uint32_t step = 0; step < 24 * 720; step++) {
+    bool was = heater;
+    if (temp < 25000) heater = true;
+    if (temp >= 25300) heater = false;
+    if (was && !heater) {
+      coasting = true;
+      offTemp = peak = temp;
+    }
+    if (heater) coasting = false;
+
+    double before = temp;
+    element += ((heater ? power : 0.0) - element) * dt / lagS;
+    temp += (element - loss) * dt / 1000.0;
+    if (heater) { heatSum += (temp - before) * 1000.0 / dt; heatN++; }
+    else if (!coasting) { driftSum += (temp - before) * 1000.0 / dt; driftN++; }
+    if (coasting) {
+      if (temp > peak) peak = temp;
+      if (temp < peak - 30) {
+        coastSum += peak - offTemp;
+        coasts++;
+        coasting = false;
+      }
+    }
+    int32_t probe = (int32_t)(lround(temp / 62.5) * 62.5);
+    trace.push_back({ (uint32_t)(step * dt * 1000), probe, heater, false });
+  }
+  heatRate = heatSum / heatN;
+  driftRate = driftSum / driftN;
+  coast = coasts ? coastSum / coasts : 0;
+}
+
+static int32_t absValue(int32_t v) { return v < 0 ? -v : v; }
+
+int main(int argc, char** argv) {
+  std::vector<TracePoint> trace;
+  double heatRate = 0, driftRate = 0, coast = 0;
+  bool synthetic = argc < 2;
+
+  if (synthetic) {
+    synthesise(trace, heatRate, driftRate, coast);
+  } else {
+    std::string text;
+    if (!readFile(argv[1], text)) {
+      printf("cannot read %s\n", argv[1]);
+      return 2;
+    }
+    if (text.find('{') != std::string::npos) parseHistoryJSON(text, trace);
+    else parseCSV(text, trace);
+  }
+  if (trace.size() < 2) {
+    printf("trace has %zu usable points\n", trace.size());
+    return 2;
+  }
+
+  // Learn online, and score each 5 min prediction against what followed
+  ThermalModel model;
+  const uint32_t horizonMs = 300000;
+  int64_t modelError = 0, holdError = 0;
+  uint32_t scored = 0;
+  size_t ahead = 0;
+  for (size_t i = 0; i < trace.size(); i++) {
+    const TracePoint& p = trace[i];
+    model.observe(p.tempMilli, p.timeMs, p.heater, p.fan);
+    if (ahead <= i) ahead = i + 1;
+    while (ahead < trace.size() && trace[ahead].timeMs - p.timeMs < horizonMs) ahead++;
+    if (ahead >= trace.size() || i < trace.size() / 4) continue; // Score once warmed up
+    const TracePoint& later = trace[ahead];
+    bool steady = true;
+    for (size_t k = i + 1; k <= ahead; k++) {
+      steady &= trace[k].heater == p.heater && trace[k].fan == p.fan;
+    }
+    if (!steady) continue;
+    int32_t predicted = model.predict(p.tempMilli, later.timeMs - p.timeMs, p.heater, p.fan);
+    modelError += absValue(predicted - later.tempMilli);
+    holdError += absValue(p.tempMilli - later.tempMilli);
+    scored++;
+  }
+
+  const ThermalParams& learned = model.getParams();
+  printf("  %zu points over %.1f h\n", trace.size(), (trace.back().timeMs - trace.front().timeMs) / 3600000.0);
+  printf("  learned: heat %ld, fan %ld, drift %ld uC/s; coast heat %ld, fan %ld mC (%lu coasts, %lu slopes)\n",
+         (long)learned.heatRate, (long)learned.fanRate, (long)learned.driftRate,
+         (long)learned.heatCoast, (long)learned.fanCoast,
+         (unsigned long)model.getCoastCount(), (unsigned long)learned.samples);
+  if (scored > 0) {
+    printf("  5 min prediction: mean error %.1f mC (holding the last reading: %.1f mC) over %lu points\n",
+           (double)modelError / scored, (double)holdError / scored, (unsigned long)scored);
+  }
+  if (!synthetic) return 0;
+
+  printf("  tank:    heat %.0f, drift %.0f uC/s; coast %.0f mC\n", heatRate, driftRate, coast);
+  CHECK(fabs(learned.heatRate - heatRate) < 0.3 * heatRate);
+  CHECK(fabs(learned.driftRate - driftRate) < 0.3 * fabs(driftRate));
+  CHECK(learned.heatCoast > 0.5 * coast && learned.heatCoast < 1.5 * coast + 62.5);
+  CHECK(scored > 0 && modelError < holdError);
+  return hostTestResult("thermalReplay");
+}